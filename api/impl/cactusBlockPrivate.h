@@ -23,9 +23,10 @@ struct _block_instanceIterator {
 ////////////////////////////////////////////////
 
 /*
- * Constructs the block, but not its ends.
+ * Constructs the block and its ends. The 5 prime end is given the name, the block name+1 and
+ * the 3 prime end name+2.
  */
-Block *block_construct2(Name name, int64_t length, End *leftEnd, End *rightEnd, Flower *flower);
+Block *block_construct2(Name name, int64_t length, Flower *flower);
 
 /*
  * Destructs the block and all segments it contains.
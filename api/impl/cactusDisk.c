@@ -16,29 +16,43 @@
 #endif
 
 /*
- * Functions on meta sequences.
+ * Gets the shard holding the object with the given name. Names are mostly issued sequentially, so they
+ * are hashed to spread neighbouring names between the shards.
  */
+static CactusDiskShard *cactusDisk_getShard(CactusDisk *cactusDisk, Name name) {
+    return &(cactusDisk->shards[((uint64_t)name * 0x9E3779B97F4A7C15ULL) >> (64 - CACTUS_DISK_SHARD_BITS)]);
+}
 
-void cactusDisk_addSequence(CactusDisk *cactusDisk, Sequence *sequence) {
+static void cactusDiskShard_lock(CactusDiskShard *shard) {
 #if defined(_OPENMP)
-    omp_set_lock(&(cactusDisk->writelock));
+    omp_set_lock(&(shard->lock));
 #endif
-    assert(stSortedSet_search(cactusDisk->sequences, sequence) == NULL);
-    stSortedSet_insert(cactusDisk->sequences, sequence);
+}
+
+static void cactusDiskShard_unlock(CactusDiskShard *shard) {
 #if defined(_OPENMP)
-    omp_unset_lock(&(cactusDisk->writelock));
+    omp_unset_lock(&(shard->lock));
 #endif
 }
 
+/*
+ * Functions on meta sequences.
+ */
+
+void cactusDisk_addSequence(CactusDisk *cactusDisk, Sequence *sequence) {
+    CactusDiskShard *shard = cactusDisk_getShard(cactusDisk, sequence_getName(sequence));
+    cactusDiskShard_lock(shard);
+    assert(stSortedSet_search(shard->sequences, sequence) == NULL);
+    stSortedSet_insert(shard->sequences, sequence);
+    cactusDiskShard_unlock(shard);
+}
+
 void cactusDisk_removeSequence(CactusDisk *cactusDisk, Sequence *sequence) {
-#if defined(_OPENMP)
-    omp_set_lock(&(cactusDisk->writelock));
-#endif
-    assert(stSortedSet_search(cactusDisk->sequences, sequence) != NULL);
-    stSortedSet_remove(cactusDisk->sequences, sequence);
-#if defined(_OPENMP)
-    omp_unset_lock(&(cactusDisk->writelock));
-#endif
+    CactusDiskShard *shard = cactusDisk_getShard(cactusDisk, sequence_getName(sequence));
+    cactusDiskShard_lock(shard);
+    assert(stSortedSet_search(shard->sequences, sequence) != NULL);
+    stSortedSet_remove(shard->sequences, sequence);
+    cactusDiskShard_unlock(shard);
 }
 
 /*
@@ -50,14 +64,32 @@ Name cactusDisk_addString(CactusDisk *cactusDisk, const char *string) {
      * Adds a string to the database.
      */
     Name name = cactusDisk_getUniqueID(cactusDisk);
+    cactusDisk_addString2(cactusDisk, name, string, strlen(string));
+    return name;
+}
+
+void cactusDisk_addString2(CactusDisk *cactusDisk, Name name, const char *string, int64_t length) {
+    // Pack the string before taking the lock
+    CactusPackedString *packedString = packedString_construct(string, length);
 #if defined(_OPENMP)
-    omp_set_lock(&(cactusDisk->writelock));
+    omp_set_lock(&(cactusDisk->stringLock));
 #endif
-    stHash_insert(cactusDisk->allStrings, (void *)name, stString_copy(string)); // Cheeky 64bit to pointer conversion
+    assert(stHash_search(cactusDisk->allStrings, (void *)name) == NULL);
+    stHash_insert(cactusDisk->allStrings, (void *)name, packedString); // Cheeky 64bit to pointer conversion
 #if defined(_OPENMP)
-    omp_unset_lock(&(cactusDisk->writelock));
+    omp_unset_lock(&(cactusDisk->stringLock));
 #endif
-    return name;
+}
+
+const CactusPackedString *cactusDisk_getStoredString(CactusDisk *cactusDisk, Name name) {
+#if defined(_OPENMP)
+    omp_set_lock(&(cactusDisk->stringLock));
+#endif
+    CactusPackedString *packedString = stHash_search(cactusDisk->allStrings, (void *)name); // Cheeky 64bit int to pointer conversion
+#if defined(_OPENMP)
+    omp_unset_lock(&(cactusDisk->stringLock));
+#endif
+    return packedString;
 }
 
 char *cactusDisk_getString(CactusDisk *cactusDisk, Name name, int64_t start, int64_t length, int64_t strand,
@@ -70,23 +102,9 @@ char *cactusDisk_getString(CactusDisk *cactusDisk, Name name, int64_t start, int
     if (length == 0) {
         return stString_copy("");
     }
-
-#if defined(_OPENMP)
-    omp_set_lock(&(cactusDisk->writelock));
-#endif
-    char *string = stHash_search(cactusDisk->allStrings, (void *)name); // Cheeky 64bit int to pointer conversion
-#if defined(_OPENMP)
-    omp_unset_lock(&(cactusDisk->writelock));
-#endif
-
-    assert(string != NULL);
-    string = stString_getSubString(string, start, length);
-    if(!strand) {
-        char *reverseComplement = stString_reverseComplementString(string);
-        free(string);
-        return reverseComplement;
-    }
-    return string;
+    const CactusPackedString *packedString = cactusDisk_getStoredString(cactusDisk, name);
+    assert(packedString != NULL);
+    return packedString_getSubString(packedString, start, length, strand);
 }
 
 ////////////////////////////////////////////////
@@ -109,31 +127,58 @@ static int cactusDisk_constructSequencesP(const void *o1, const void *o2) {
  * The following two functions compress and decompress the data in the cactus disk..
  */
 
+static int64_t cactusDiskInstances = 0; // Counter used to give each cactus disk its instance number
+
 CactusDisk *cactusDisk_construct() {
     CactusDisk *cactusDisk = st_calloc(1, sizeof(CactusDisk));
-    cactusDisk->sequences = stSortedSet_construct3(cactusDisk_constructSequencesP, NULL);
-    cactusDisk->flowers = stSortedSet_construct3(cactusDisk_constructFlowersP, NULL);
+    for (int64_t i = 0; i < CACTUS_DISK_SHARDS; i++) {
+        CactusDiskShard *shard = &(cactusDisk->shards[i]);
+        shard->sequences = stSortedSet_construct3(cactusDisk_constructSequencesP, NULL);
+        shard->flowers = stSortedSet_construct3(cactusDisk_constructFlowersP, NULL);
+#if defined(_OPENMP)
+        omp_init_lock(&(shard->lock));
+#endif
+    }
     cactusDisk->eventTree = NULL;
-    cactusDisk->allStrings = stHash_construct2(NULL, free);
+    cactusDisk->allStrings = stHash_construct2(NULL, (void (*)(void *)) packedString_destruct);
     cactusDisk->currentName = 1; // Start the naming of objects from 1
+    int64_t instance;
+#if defined(_OPENMP)
+#pragma omp atomic capture
+#endif
+    instance = ++cactusDiskInstances;
+    cactusDisk->instance = instance;
 #if defined(_OPENMP)
-        omp_init_lock(&(cactusDisk->writelock));
+        omp_init_lock(&(cactusDisk->stringLock));
 #endif
     return cactusDisk;
 }
 
 void cactusDisk_destruct(CactusDisk *cactusDisk) {
-    Flower *flower;
-    while ((flower = stSortedSet_getFirst(cactusDisk->flowers)) != NULL) {
-        flower_destruct(flower, FALSE, FALSE);
+    for (int64_t i = 0; i < CACTUS_DISK_SHARDS; i++) {
+        CactusDiskShard *shard = &(cactusDisk->shards[i]);
+        Flower *flower;
+        while ((flower = stSortedSet_getFirst(shard->flowers)) != NULL) {
+            flower_destruct(flower, FALSE, FALSE);
+        }
+    }
+
+    for (int64_t i = 0; i < CACTUS_DISK_SHARDS; i++) {
+        CactusDiskShard *shard = &(cactusDisk->shards[i]);
+        Sequence *sequence;
+        while ((sequence = stSortedSet_getFirst(shard->sequences)) != NULL) {
+            sequence_destruct(sequence);
+        }
     }
-    stSortedSet_destruct(cactusDisk->flowers);
 
-    Sequence *sequence;
-    while ((sequence = stSortedSet_getFirst(cactusDisk->sequences)) != NULL) {
-        sequence_destruct(sequence);
+    for (int64_t i = 0; i < CACTUS_DISK_SHARDS; i++) {
+        CactusDiskShard *shard = &(cactusDisk->shards[i]);
+        stSortedSet_destruct(shard->flowers);
+        stSortedSet_destruct(shard->sequences);
+#if defined(_OPENMP)
+        omp_destroy_lock(&(shard->lock));
+#endif
     }
-    stSortedSet_destruct(cactusDisk->sequences);
     stHash_destruct(cactusDisk->allStrings); // cleanup the library of strings we hold in memory
 
     if(cactusDisk->eventTree != NULL) {
@@ -141,7 +186,7 @@ void cactusDisk_destruct(CactusDisk *cactusDisk) {
     }
 
 #if defined(_OPENMP)
-    omp_destroy_lock(&(cactusDisk->writelock));
+    omp_destroy_lock(&(cactusDisk->stringLock));
 #endif
 
     free(cactusDisk);
@@ -150,26 +195,20 @@ void cactusDisk_destruct(CactusDisk *cactusDisk) {
 Flower *cactusDisk_getFlower(CactusDisk *cactusDisk, Name flowerName) {
     Flower flower;
     flower.name = flowerName;
-#if defined(_OPENMP)
-        omp_set_lock(&(cactusDisk->writelock));
-#endif
-        Flower *flower2 = stSortedSet_search(cactusDisk->flowers, &flower);
-#if defined(_OPENMP)
-        omp_unset_lock(&(cactusDisk->writelock));
-#endif
+    CactusDiskShard *shard = cactusDisk_getShard(cactusDisk, flowerName);
+    cactusDiskShard_lock(shard);
+    Flower *flower2 = stSortedSet_search(shard->flowers, &flower);
+    cactusDiskShard_unlock(shard);
     return flower2;
 }
 
 Sequence *cactusDisk_getSequence(CactusDisk *cactusDisk, Name sequenceName) {
     Sequence sequence;
     sequence.name = sequenceName;
-#if defined(_OPENMP)
-    omp_set_lock(&(cactusDisk->writelock));
-#endif
-    Sequence *sequence2 = stSortedSet_search(cactusDisk->sequences, &sequence);
-#if defined(_OPENMP)
-    omp_unset_lock(&(cactusDisk->writelock));
-#endif
+    CactusDiskShard *shard = cactusDisk_getShard(cactusDisk, sequenceName);
+    cactusDiskShard_lock(shard);
+    Sequence *sequence2 = stSortedSet_search(shard->sequences, &sequence);
+    cactusDiskShard_unlock(shard);
     return sequence2;
 }
 
@@ -178,25 +217,47 @@ Sequence *cactusDisk_getSequence(CactusDisk *cactusDisk, Name sequenceName) {
  */
 
 void cactusDisk_addFlower(CactusDisk *cactusDisk, Flower *flower) {
-#if defined(_OPENMP)
-        omp_set_lock(&(cactusDisk->writelock));
-#endif
-        assert(stSortedSet_search(cactusDisk->flowers, flower) == NULL);
-        stSortedSet_insert(cactusDisk->flowers, flower);
-#if defined(_OPENMP)
-        omp_unset_lock(&(cactusDisk->writelock));
-#endif
+    CactusDiskShard *shard = cactusDisk_getShard(cactusDisk, flower_getName(flower));
+    cactusDiskShard_lock(shard);
+    assert(stSortedSet_search(shard->flowers, flower) == NULL);
+    stSortedSet_insert(shard->flowers, flower);
+    cactusDiskShard_unlock(shard);
 }
 
 void cactusDisk_removeFlower(CactusDisk *cactusDisk, Flower *flower) {
-#if defined(_OPENMP)
-        omp_set_lock(&(cactusDisk->writelock));
-#endif
-        assert(stSortedSet_search(cactusDisk->flowers, flower) != NULL);
-        stSortedSet_remove(cactusDisk->flowers, flower);
-#if defined(_OPENMP)
-        omp_unset_lock(&(cactusDisk->writelock));
-#endif
+    CactusDiskShard *shard = cactusDisk_getShard(cactusDisk, flower_getName(flower));
+    cactusDiskShard_lock(shard);
+    assert(stSortedSet_search(shard->flowers, flower) != NULL);
+    stSortedSet_remove(shard->flowers, flower);
+    cactusDiskShard_unlock(shard);
+}
+
+/*
+ * Gets the contents of the given set of every shard, sorted with cmpFn.
+ */
+static stList *cactusDisk_getAll(CactusDisk *cactusDisk, bool flowers, int (*cmpFn)(const void *, const void *)) {
+    stList *objects = stList_construct();
+    for (int64_t i = 0; i < CACTUS_DISK_SHARDS; i++) {
+        CactusDiskShard *shard = &(cactusDisk->shards[i]);
+        cactusDiskShard_lock(shard);
+        stSortedSetIterator *it = stSortedSet_getIterator(flowers ? shard->flowers : shard->sequences);
+        void *o;
+        while ((o = stSortedSet_getNext(it)) != NULL) {
+            stList_append(objects, o);
+        }
+        stSortedSet_destructIterator(it);
+        cactusDiskShard_unlock(shard);
+    }
+    stList_sort(objects, cmpFn);
+    return objects;
+}
+
+stList *cactusDisk_getSequences(CactusDisk *cactusDisk) {
+    return cactusDisk_getAll(cactusDisk, 0, cactusDisk_constructSequencesP);
+}
+
+stList *cactusDisk_getFlowers(CactusDisk *cactusDisk) {
+    return cactusDisk_getAll(cactusDisk, 1, cactusDisk_constructFlowersP);
 }
 
 void cactusDisk_setEventTree(CactusDisk *cactusDisk, EventTree *eventTree) {
@@ -207,15 +268,42 @@ void cactusDisk_setEventTree(CactusDisk *cactusDisk, EventTree *eventTree) {
  * Function to get unique ID.
  */
 
-int64_t cactusDisk_getUniqueIDInterval(CactusDisk *cactusDisk, int64_t intervalSize) {
+/*
+ * The block of ids each thread is currently handing out, from next (inclusive) to end (exclusive).
+ */
+typedef struct _uniqueIDBlock {
+    int64_t instance; // The instance of the cactus disk the block was taken from
+    Name next;
+    Name end;
+} UniqueIDBlock;
+
+static UniqueIDBlock threadIDBlock = { 0, 0, 0 };
+static UniqueIDBlock savedThreadIDBlock = { 0, 0, 0 }; // The block put aside by cactusDisk_setUniqueIDInterval
 #if defined(_OPENMP)
-    omp_set_lock(&(cactusDisk->writelock));
+#pragma omp threadprivate(threadIDBlock, savedThreadIDBlock)
 #endif
-    Name n = cactusDisk->currentName;
-    cactusDisk->currentName += intervalSize;
+
+static Name cactusDisk_takeIDs(CactusDisk *cactusDisk, int64_t intervalSize) {
+    Name n;
 #if defined(_OPENMP)
-    omp_unset_lock(&(cactusDisk->writelock));
+#pragma omp atomic capture
 #endif
+    { n = cactusDisk->currentName; cactusDisk->currentName += intervalSize; }
+    return n;
+}
+
+int64_t cactusDisk_getUniqueIDInterval(CactusDisk *cactusDisk, int64_t intervalSize) {
+    UniqueIDBlock *block = &threadIDBlock;
+    if (block->instance != cactusDisk->instance || block->end - block->next < intervalSize) {
+        // Take a new block. The remainder of the old one is abandoned, so the ids issued to a thread always increase,
+        // which keeps the insertion of objects into the (sorted) lists of a flower cheap
+        int64_t blockSize = intervalSize > CACTUS_DISK_ID_BLOCK_SIZE ? intervalSize : CACTUS_DISK_ID_BLOCK_SIZE;
+        block->instance = cactusDisk->instance;
+        block->next = cactusDisk_takeIDs(cactusDisk, blockSize);
+        block->end = block->next + blockSize;
+    }
+    Name n = block->next;
+    block->next += intervalSize;
     return n;
 }
 
@@ -223,6 +311,20 @@ int64_t cactusDisk_getUniqueID(CactusDisk *cactusDisk) {
     return cactusDisk_getUniqueIDInterval(cactusDisk, 1);
 }
 
+void cactusDisk_setUniqueIDInterval(CactusDisk *cactusDisk, int64_t start, int64_t intervalSize) {
+    savedThreadIDBlock = threadIDBlock;
+    threadIDBlock.instance = cactusDisk->instance;
+    threadIDBlock.next = start;
+    threadIDBlock.end = start + intervalSize;
+}
+
+bool cactusDisk_restoreUniqueIDInterval(CactusDisk *cactusDisk, int64_t start, int64_t intervalSize) {
+    // A new block is only taken once the interval runs out
+    bool withinInterval = threadIDBlock.instance == cactusDisk->instance && threadIDBlock.end == start + intervalSize;
+    threadIDBlock = savedThreadIDBlock;
+    return withinInterval;
+}
+
 EventTree *cactusDisk_getEventTree(CactusDisk *cactusDisk) {
     return cactusDisk->eventTree;
 }
@@ -12,15 +12,35 @@
 #include <omp.h>
 #endif
 
-struct _cactusDisk {
+/*
+ * The flowers and sequences are split by name between shards, each with its own lock, so that threads
+ * adding and looking up different objects rarely contend.
+ */
+#define CACTUS_DISK_SHARD_BITS 6
+#define CACTUS_DISK_SHARDS (1 << CACTUS_DISK_SHARD_BITS)
+
+/*
+ * Unique ids are handed to each thread in blocks of this size, so that threads rarely touch the shared counter.
+ */
+#define CACTUS_DISK_ID_BLOCK_SIZE 1024
+
+typedef struct _cactusDiskShard {
     stSortedSet *sequences;
     stSortedSet *flowers;
+#if defined(_OPENMP)
+    omp_lock_t lock; // Gates access to the sequences and flowers of the shard
+#endif
+} CactusDiskShard;
+
+struct _cactusDisk {
+    CactusDiskShard shards[CACTUS_DISK_SHARDS];
     EventTree *eventTree;
 #if defined(_OPENMP)
-    omp_lock_t writelock; // This lock used to gate access to concurrently accessed variables
+    omp_lock_t stringLock; // Gates access to allStrings
 #endif
-    stHash *allStrings; // If the strings are being all stored in memory, a map of names to strings
-    Name currentName; // Used as a counter for issuing names
+    stHash *allStrings; // If the strings are being all stored in memory, a map of names to packed strings
+    Name currentName; // Used as a counter for issuing names, updated atomically
+    int64_t instance; // Distinguishes the cactus disk from any other constructed in the process, for the per thread id blocks
 };
 
 ////////////////////////////////////////////////
@@ -72,6 +92,27 @@ Name cactusDisk_addString(CactusDisk *cactusDisk, const char *string);
 char *cactusDisk_getString(CactusDisk *cactusDisk, Name name,
         int64_t start, int64_t length, int64_t strand, int64_t totalSequenceLength);
 
+/*
+ * Returns the stored string with the given name. Strings are never changed or freed until the cactus disk
+ * is destructed, so the result can be kept and read without any locking.
+ */
+const CactusPackedString *cactusDisk_getStoredString(CactusDisk *cactusDisk, Name name);
+
+/*
+ * Stores a string under the given name, which must not already be in use.
+ */
+void cactusDisk_addString2(CactusDisk *cactusDisk, Name name, const char *string, int64_t length);
+
+/*
+ * Returns the sequences of the cactus disk, sorted by name.
+ */
+stList *cactusDisk_getSequences(CactusDisk *cactusDisk);
+
+/*
+ * Returns the flowers of the cactus disk, sorted by name.
+ */
+stList *cactusDisk_getFlowers(CactusDisk *cactusDisk);
+
 /*
  * Set the event tree for this disk. (Hopefully this only happens once.)
  */
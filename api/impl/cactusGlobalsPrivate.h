@@ -50,6 +50,8 @@
 #include "cactusDisk.h"
 #include "cactusDiskPrivate.h"
 #include "cactusMisc.h"
+#include "cactusProfiler.h"
+#include "cactusPackedString.h"
 #include "cactusFlowerPrivate.h"
 #include "cactusTestCommon.h"
 
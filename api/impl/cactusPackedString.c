@@ -0,0 +1,270 @@
+/*
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+#include <ctype.h>
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Packed strings
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+/*
+ * A run of positions [start, start+length).
+ */
+typedef struct _packedStringRun {
+    int64_t start;
+    int64_t length;
+} PackedStringRun;
+
+typedef struct _packedStringException {
+    int64_t position;
+    char c;
+} PackedStringException;
+
+struct _cactusPackedString {
+    int64_t length;
+    uint8_t *bases; // Four bases per byte, two bits each (A=0, C=1, G=2, T=3); other characters are stored as A
+    int64_t nRunNumber;
+    PackedStringRun *nRuns; // Runs of N or n, in order
+    int64_t maskRunNumber;
+    PackedStringRun *maskRuns; // Runs of lower case characters, in order
+    int64_t exceptionNumber;
+    PackedStringException *exceptions; // Characters other than ACGTN (in either case), in order
+};
+
+static int64_t encodeBase(char c) {
+    switch (toupper(c)) {
+        case 'A':
+            return 0;
+        case 'C':
+            return 1;
+        case 'G':
+            return 2;
+        case 'T':
+            return 3;
+        default:
+            return -1;
+    }
+}
+
+static const char decodedBases[4] = { 'A', 'C', 'G', 'T' };
+
+/*
+ * Complements a character, preserving its case. Characters other than ACGT are returned unchanged.
+ */
+static char complementChar(char c) {
+    switch (c) {
+        case 'A':
+            return 'T';
+        case 'T':
+            return 'A';
+        case 'C':
+            return 'G';
+        case 'G':
+            return 'C';
+        case 'a':
+            return 't';
+        case 't':
+            return 'a';
+        case 'c':
+            return 'g';
+        case 'g':
+            return 'c';
+        default:
+            return c;
+    }
+}
+
+/*
+ * Extends the last run in runs if it ends at position, else appends a new run.
+ */
+static void addToRuns(PackedStringRun **runs, int64_t *runNumber, int64_t *maxRuns, int64_t position) {
+    if (*runNumber > 0 && (*runs)[*runNumber - 1].start + (*runs)[*runNumber - 1].length == position) {
+        (*runs)[*runNumber - 1].length++;
+        return;
+    }
+    if (*runNumber == *maxRuns) {
+        *maxRuns = *maxRuns * 2 + 1;
+        *runs = st_realloc(*runs, sizeof(PackedStringRun) * (*maxRuns));
+    }
+    (*runs)[*runNumber].start = position;
+    (*runs)[*runNumber].length = 1;
+    (*runNumber)++;
+}
+
+CactusPackedString *packedString_construct(const char *string, int64_t length) {
+    CactusPackedString *packedString = st_calloc(1, sizeof(CactusPackedString));
+    packedString->length = length;
+    packedString->bases = st_calloc((length + 3) / 4, sizeof(uint8_t));
+    int64_t maxNRuns = 0, maxMaskRuns = 0, maxExceptions = 0;
+    for (int64_t i = 0; i < length; i++) {
+        char c = string[i];
+        int64_t code = encodeBase(c);
+        if (code != -1) {
+            packedString->bases[i >> 2] |= code << ((i & 3) << 1);
+        } else if (toupper(c) == 'N') {
+            addToRuns(&packedString->nRuns, &packedString->nRunNumber, &maxNRuns, i);
+        } else {
+            if (packedString->exceptionNumber == maxExceptions) {
+                maxExceptions = maxExceptions * 2 + 1;
+                packedString->exceptions = st_realloc(packedString->exceptions, sizeof(PackedStringException) * maxExceptions);
+            }
+            packedString->exceptions[packedString->exceptionNumber].position = i;
+            packedString->exceptions[packedString->exceptionNumber++].c = c;
+            continue; // Exceptions are stored with their case
+        }
+        if (islower(c)) {
+            addToRuns(&packedString->maskRuns, &packedString->maskRunNumber, &maxMaskRuns, i);
+        }
+    }
+    // Trim the side tables to size
+    packedString->nRuns = st_realloc(packedString->nRuns, sizeof(PackedStringRun) * (packedString->nRunNumber + 1));
+    packedString->maskRuns = st_realloc(packedString->maskRuns, sizeof(PackedStringRun) * (packedString->maskRunNumber + 1));
+    packedString->exceptions = st_realloc(packedString->exceptions,
+                                          sizeof(PackedStringException) * (packedString->exceptionNumber + 1));
+    return packedString;
+}
+
+void packedString_destruct(CactusPackedString *packedString) {
+    free(packedString->bases);
+    free(packedString->nRuns);
+    free(packedString->maskRuns);
+    free(packedString->exceptions);
+    free(packedString);
+}
+
+int64_t packedString_getLength(const CactusPackedString *packedString) {
+    return packedString->length;
+}
+
+int64_t packedString_getMemoryUsage(const CactusPackedString *packedString) {
+    return sizeof(CactusPackedString) + (packedString->length + 3) / 4
+           + sizeof(PackedStringRun) * (packedString->nRunNumber + packedString->maskRunNumber)
+           + sizeof(PackedStringException) * packedString->exceptionNumber;
+}
+
+/*
+ * Returns the index of the first run that ends after position, or runNumber if there is none.
+ */
+static int64_t getFirstRun(const PackedStringRun *runs, int64_t runNumber, int64_t position) {
+    int64_t low = 0, high = runNumber;
+    while (low < high) {
+        int64_t mid = low + (high - low) / 2;
+        if (runs[mid].start + runs[mid].length <= position) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static int64_t getFirstException(const PackedStringException *exceptions, int64_t exceptionNumber, int64_t position) {
+    int64_t low = 0, high = exceptionNumber;
+    while (low < high) {
+        int64_t mid = low + (high - low) / 2;
+        if (exceptions[mid].position < position) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+char packedString_getChar(const CactusPackedString *packedString, int64_t position) {
+    char buffer[2];
+    packedString_copySubString(packedString, position, 1, 1, buffer);
+    return buffer[0];
+}
+
+void packedString_copySubString(const CactusPackedString *packedString, int64_t start, int64_t length, bool strand,
+                                char *buffer) {
+    assert(start >= 0);
+    assert(length >= 0);
+    assert(start + length <= packedString->length);
+    int64_t end = start + length;
+
+    // Decode the bases
+    for (int64_t i = start; i < end; i++) {
+        buffer[i - start] = decodedBases[(packedString->bases[i >> 2] >> ((i & 3) << 1)) & 3];
+    }
+
+    // Overlay the Ns
+    for (int64_t j = getFirstRun(packedString->nRuns, packedString->nRunNumber, start);
+         j < packedString->nRunNumber && packedString->nRuns[j].start < end; j++) {
+        int64_t runStart = packedString->nRuns[j].start > start ? packedString->nRuns[j].start : start;
+        int64_t runEnd = packedString->nRuns[j].start + packedString->nRuns[j].length;
+        runEnd = runEnd < end ? runEnd : end;
+        memset(buffer + runStart - start, 'N', runEnd - runStart);
+    }
+
+    // Lower case the soft-masked runs
+    for (int64_t j = getFirstRun(packedString->maskRuns, packedString->maskRunNumber, start);
+         j < packedString->maskRunNumber && packedString->maskRuns[j].start < end; j++) {
+        int64_t runStart = packedString->maskRuns[j].start > start ? packedString->maskRuns[j].start : start;
+        int64_t runEnd = packedString->maskRuns[j].start + packedString->maskRuns[j].length;
+        runEnd = runEnd < end ? runEnd : end;
+        for (int64_t i = runStart; i < runEnd; i++) {
+            buffer[i - start] = tolower(buffer[i - start]);
+        }
+    }
+
+    // Put back any other characters
+    for (int64_t j = getFirstException(packedString->exceptions, packedString->exceptionNumber, start);
+         j < packedString->exceptionNumber && packedString->exceptions[j].position < end; j++) {
+        buffer[packedString->exceptions[j].position - start] = packedString->exceptions[j].c;
+    }
+
+    // Reverse complement in place
+    if (!strand) {
+        for (int64_t i = 0, j = length - 1; i <= j; i++, j--) {
+            char c = complementChar(buffer[i]);
+            buffer[i] = complementChar(buffer[j]);
+            buffer[j] = c;
+        }
+    }
+    buffer[length] = '\0';
+}
+
+char *packedString_getSubString(const CactusPackedString *packedString, int64_t start, int64_t length, bool strand) {
+    char *string = st_malloc(length + 1);
+    packedString_copySubString(packedString, start, length, strand, string);
+    return string;
+}
+
+void packedString_initIterator(PackedStringIterator *iterator, const CactusPackedString *packedString,
+                               int64_t start, int64_t length, bool strand) {
+    assert(start >= 0 && length >= 0 && start + length <= packedString->length);
+    iterator->packedString = packedString;
+    iterator->start = start;
+    iterator->length = length;
+    iterator->strand = strand;
+    iterator->offset = 0;
+    iterator->bufferOffset = 0;
+    iterator->bufferLength = 0;
+}
+
+char packedString_getNext(PackedStringIterator *iterator) {
+    if (iterator->offset == iterator->length) {
+        return '\0';
+    }
+    if (iterator->offset == iterator->bufferOffset + iterator->bufferLength) {
+        // Decode the next chunk. On the reverse strand the chunks are taken from the end of the substring backwards.
+        iterator->bufferOffset = iterator->offset;
+        iterator->bufferLength = iterator->length - iterator->offset;
+        if (iterator->bufferLength > PACKED_STRING_ITERATOR_BUFFER_SIZE - 1) {
+            iterator->bufferLength = PACKED_STRING_ITERATOR_BUFFER_SIZE - 1;
+        }
+        int64_t chunkStart = iterator->strand ? iterator->start + iterator->offset
+                                              : iterator->start + iterator->length - iterator->offset - iterator->bufferLength;
+        packedString_copySubString(iterator->packedString, chunkStart, iterator->bufferLength, iterator->strand,
+                                   iterator->buffer);
+    }
+    return iterator->buffer[iterator->offset++ - iterator->bufferOffset];
+}
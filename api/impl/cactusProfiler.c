@@ -0,0 +1,180 @@
+/*
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+#include <stdarg.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Stage profiler
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+typedef struct _profilerSample {
+    double wallTime; // Monotonic, in seconds
+    double userTime; // Cpu time of the process, in seconds
+    double systemTime;
+    int64_t maxRss; // Peak resident set size of the process, in kilobytes
+} ProfilerSample;
+
+typedef struct _profilerStage {
+    char *name;
+    int64_t depth;
+    int64_t parent; // Index of the enclosing stage, or -1
+    int64_t threads; // Threads available to the stage
+    ProfilerSample start;
+    ProfilerSample end;
+    bool ended;
+} ProfilerStage;
+
+static bool profilerEnabled = 0;
+static stList *profilerStages = NULL; // All the stages, in the order they were started
+static int64_t currentStage = -1;
+static ProfilerSample profilerStart;
+
+static double timevalToSeconds(struct timeval *tv) {
+    return tv->tv_sec + tv->tv_usec / 1.0e6;
+}
+
+static void profilerSample_fill(ProfilerSample *sample) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    sample->wallTime = ts.tv_sec + ts.tv_nsec / 1.0e9;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    sample->userTime = timevalToSeconds(&usage.ru_utime);
+    sample->systemTime = timevalToSeconds(&usage.ru_stime);
+    sample->maxRss = usage.ru_maxrss;
+}
+
+static int64_t getThreadNumber(void) {
+#if defined(_OPENMP)
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+static void profilerStage_destruct(ProfilerStage *stage) {
+    free(stage->name);
+    free(stage);
+}
+
+void cactusProfiler_enable(void) {
+    if (!profilerEnabled) {
+        profilerEnabled = 1;
+        profilerStages = stList_construct3(0, (void (*)(void *)) profilerStage_destruct);
+        currentStage = -1;
+        profilerSample_fill(&profilerStart);
+    }
+}
+
+bool cactusProfiler_isEnabled(void) {
+    return profilerEnabled;
+}
+
+void cactusProfiler_startStage(const char *stageName, ...) {
+    if (!profilerEnabled) {
+        return;
+    }
+    ProfilerStage *stage = st_calloc(1, sizeof(ProfilerStage));
+    va_list ap;
+    va_start(ap, stageName);
+    int64_t nameLength = vsnprintf(NULL, 0, stageName, ap);
+    va_end(ap);
+    stage->name = st_malloc(nameLength + 1);
+    va_start(ap, stageName);
+    vsnprintf(stage->name, nameLength + 1, stageName, ap);
+    va_end(ap);
+    stage->parent = currentStage;
+    stage->depth = currentStage == -1 ? 0 : ((ProfilerStage *) stList_get(profilerStages, currentStage))->depth + 1;
+    stage->threads = getThreadNumber();
+    profilerSample_fill(&stage->start);
+    currentStage = stList_length(profilerStages);
+    stList_append(profilerStages, stage);
+}
+
+void cactusProfiler_endStage(void) {
+    if (!profilerEnabled) {
+        return;
+    }
+    if (currentStage == -1) {
+        st_errAbort("Tried to end a profiler stage when no stage has been started");
+    }
+    ProfilerStage *stage = stList_get(profilerStages, currentStage);
+    profilerSample_fill(&stage->end);
+    stage->ended = 1;
+    currentStage = stage->parent;
+}
+
+static void writeJsonString(FILE *fileHandle, const char *string) {
+    fputc('"', fileHandle);
+    for (const char *c = string; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            fputc('\\', fileHandle);
+            fputc(*c, fileHandle);
+        } else if ((unsigned char) *c < 0x20) {
+            fprintf(fileHandle, "\\u%04x", (unsigned char) *c);
+        } else {
+            fputc(*c, fileHandle);
+        }
+    }
+    fputc('"', fileHandle);
+}
+
+static void writeJsonStage(FILE *fileHandle, ProfilerStage *stage, ProfilerSample *now) {
+    ProfilerSample *end = stage->ended ? &stage->end : now;
+    double wallTime = end->wallTime - stage->start.wallTime;
+    double userTime = end->userTime - stage->start.userTime;
+    double systemTime = end->systemTime - stage->start.systemTime;
+    // The fraction of the available threads kept busy over the stage
+    double threadUtilisation = wallTime > 0 ? (userTime + systemTime) / (wallTime * stage->threads) : 0.0;
+    fprintf(fileHandle, "{\"name\": ");
+    writeJsonString(fileHandle, stage->name);
+    fprintf(fileHandle, ", \"depth\": %" PRIi64 ", \"parent\": %" PRIi64 ", \"threads\": %" PRIi64 ", "
+            "\"startSeconds\": %.6f, \"wallSeconds\": %.6f, \"userSeconds\": %.6f, \"systemSeconds\": %.6f, "
+            "\"threadUtilisation\": %.4f, \"peakRssKb\": %" PRIi64 ", \"peakRssDeltaKb\": %" PRIi64 ", \"ended\": %s}",
+            stage->depth, stage->parent, stage->threads, stage->start.wallTime - profilerStart.wallTime,
+            wallTime, userTime, systemTime, threadUtilisation, end->maxRss, end->maxRss - stage->start.maxRss,
+            stage->ended ? "true" : "false");
+}
+
+void cactusProfiler_writeJson(const char *jsonFile) {
+    if (!profilerEnabled) {
+        return;
+    }
+    FILE *fileHandle = fopen(jsonFile, "w");
+    if (fileHandle == NULL) {
+        st_errAbort("Could not open profile file for writing: %s", jsonFile);
+    }
+    ProfilerSample now;
+    profilerSample_fill(&now);
+    fprintf(fileHandle, "{\"threads\": %" PRIi64 ", \"wallSeconds\": %.6f, \"userSeconds\": %.6f, "
+            "\"systemSeconds\": %.6f, \"peakRssKb\": %" PRIi64 ", \"stages\": [",
+            getThreadNumber(), now.wallTime - profilerStart.wallTime, now.userTime, now.systemTime, now.maxRss);
+    for (int64_t i = 0; i < stList_length(profilerStages); i++) {
+        fprintf(fileHandle, i == 0 ? "\n  " : ",\n  ");
+        writeJsonStage(fileHandle, stList_get(profilerStages, i), &now);
+    }
+    fprintf(fileHandle, "\n]}\n");
+    fclose(fileHandle);
+}
+
+void cactusProfiler_destruct(void) {
+    if (profilerEnabled) {
+        stList_destruct(profilerStages);
+        profilerStages = NULL;
+        currentStage = -1;
+        profilerEnabled = 0;
+    }
+}
@@ -18,10 +18,10 @@
 ////////////////////////////////////////////////
 
 /*
- * Constructs segment with the two caps, which must both have the same instance name.
+ * Constructs a segment with the given instance name, which is the name of its 5 prime cap.
+ * The segment and 3 prime cap are named instance+1 and instance+2, respectively.
  */
-Segment *segment_construct3(Name name, Block *block,
-		Cap *_5Cap, Cap *_3Cap);
+Segment *segment_construct3(Name instance, Block *block, Event *event);
 
 /*
  * Destruct the segment, does not destruct ends.
@@ -25,6 +25,7 @@ Sequence *sequence_construct2(Name name, int64_t start,
 	sequence->start = start;
 	sequence->length = length;
 	sequence->stringName = stringName;
+	sequence->string = cactusDisk_getStoredString(cactusDisk, stringName);
 	sequence->event = event;
 	sequence->cactusDisk = cactusDisk;
 	sequence->header = stString_copy(header != NULL ? header : "");
@@ -75,7 +76,21 @@ char *sequence_getString(Sequence *sequence, int64_t start, int64_t length, int6
 	assert(start >= sequence_getStart(sequence));
 	assert(length >= 0);
 	assert(start + length <= sequence_getStart(sequence) + sequence_getLength(sequence));
-	return cactusDisk_getString(sequence->cactusDisk, sequence->stringName, start - sequence_getStart(sequence), length, strand, sequence->length);
+	return packedString_getSubString(sequence->string, start - sequence_getStart(sequence), length, strand);
+}
+
+void sequence_copyString(Sequence *sequence, int64_t start, int64_t length, int64_t strand, char *buffer) {
+	assert(start >= sequence_getStart(sequence));
+	assert(length >= 0);
+	assert(start + length <= sequence_getStart(sequence) + sequence_getLength(sequence));
+	packedString_copySubString(sequence->string, start - sequence_getStart(sequence), length, strand, buffer);
+}
+
+void sequence_getStringIterator(Sequence *sequence, int64_t start, int64_t length, int64_t strand,
+                                PackedStringIterator *iterator) {
+	assert(start >= sequence_getStart(sequence));
+	assert(start + length <= sequence_getStart(sequence) + sequence_getLength(sequence));
+	packedString_initIterator(iterator, sequence->string, start - sequence_getStart(sequence), length, strand);
 }
 
 const char *sequence_getHeader(Sequence *sequence) {
@@ -12,6 +12,7 @@
 struct _sequence {
 	Name name;
 	Name stringName;
+	const CactusPackedString *string; // The stored string, cached so it can be read without locking the cactus disk
 	int64_t start;
 	int64_t length;
 	Event *event;
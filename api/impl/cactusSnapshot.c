@@ -0,0 +1,600 @@
+/*
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//Snapshots of the cactus disk.
+//
+//A snapshot is a flat binary file of int64 values (and strings, written
+//as a length followed by the characters), written in the byte order of the
+//machine. It is laid out as follows:
+//
+//header: magic, version, the next unused name
+//event tree: root name, number of other events, then each event in
+//  pre-order (name, parent name, header, branch length, outgroup status)
+//strings: number of strings, then each (name, string)
+//sequences: number of sequences, then each (name, string name, start, length,
+//  event name, header, is trivial)
+//flowers: number of root flowers, then each root flower hierarchy as
+//  described in writeFlower.
+//
+//Objects are rebuilt with the same constructors used to build them
+//originally, so a loaded cactus disk is indistinguishable from the one
+//written, including the names of all objects and the order of ends in groups,
+//caps in ends and segments in blocks.
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+#define SNAPSHOT_MAGIC 0x50414e5354434143LL // "CACTSNAP"
+#define SNAPSHOT_VERSION 1
+
+#define SNAPSHOT_STUB_END 0
+#define SNAPSHOT_BLOCK 1
+
+////////////////////////////////////////////////
+//Writing
+////////////////////////////////////////////////
+
+static void writeInt(FILE *fileHandle, int64_t i) {
+    if (fwrite(&i, sizeof(int64_t), 1, fileHandle) != 1) {
+        st_errAbort("Failed to write to cactus disk snapshot");
+    }
+}
+
+static void writeDouble(FILE *fileHandle, double d) {
+    if (fwrite(&d, sizeof(double), 1, fileHandle) != 1) {
+        st_errAbort("Failed to write to cactus disk snapshot");
+    }
+}
+
+static void writeString(FILE *fileHandle, const char *string) {
+    int64_t length = strlen(string);
+    writeInt(fileHandle, length);
+    if (length > 0 && fwrite(string, sizeof(char), length, fileHandle) != length) {
+        st_errAbort("Failed to write to cactus disk snapshot");
+    }
+}
+
+static void writeEvents(FILE *fileHandle, Event *event, int64_t *eventNumber, bool write) {
+    for (int64_t i = 0; i < event_getChildNumber(event); i++) {
+        Event *child = event_getChild(event, i);
+        if (write) {
+            writeInt(fileHandle, event_getName(child));
+            writeInt(fileHandle, event_getName(event));
+            writeString(fileHandle, event_getHeader(child));
+            writeDouble(fileHandle, event_getBranchLength(child));
+            writeInt(fileHandle, event_isOutgroup(child));
+        }
+        (*eventNumber)++;
+        writeEvents(fileHandle, child, eventNumber, write);
+    }
+}
+
+static void writeEventTree(FILE *fileHandle, EventTree *eventTree) {
+    Event *rootEvent = eventTree_getRootEvent(eventTree);
+    writeInt(fileHandle, event_getName(rootEvent));
+    int64_t eventNumber = 0;
+    writeEvents(fileHandle, rootEvent, &eventNumber, 0);
+    writeInt(fileHandle, eventNumber);
+    writeEvents(fileHandle, rootEvent, &eventNumber, 1);
+}
+
+static int sortStringNames(const void *a, const void *b) {
+    return cactusMisc_nameCompare((Name) a, (Name) b);
+}
+
+static void writeStrings(FILE *fileHandle, CactusDisk *cactusDisk) {
+    stList *names = stHash_getKeys(cactusDisk->allStrings);
+    stList_sort(names, sortStringNames); // So that the snapshot is deterministic
+    writeInt(fileHandle, stList_length(names));
+    for (int64_t i = 0; i < stList_length(names); i++) {
+        void *name = stList_get(names, i);
+        writeInt(fileHandle, (Name) name); // Cheeky pointer to 64bit int conversion
+        CactusPackedString *packedString = stHash_search(cactusDisk->allStrings, name);
+        char *string = packedString_getSubString(packedString, 0, packedString_getLength(packedString), 1);
+        writeString(fileHandle, string);
+        free(string);
+    }
+    stList_destruct(names);
+}
+
+static void writeSequences(FILE *fileHandle, CactusDisk *cactusDisk) {
+    stList *sequences = cactusDisk_getSequences(cactusDisk);
+    writeInt(fileHandle, stList_length(sequences));
+    for (int64_t i = 0; i < stList_length(sequences); i++) {
+        Sequence *sequence = stList_get(sequences, i);
+        writeInt(fileHandle, sequence->name);
+        writeInt(fileHandle, sequence->stringName);
+        writeInt(fileHandle, sequence->start);
+        writeInt(fileHandle, sequence->length);
+        writeInt(fileHandle, event_getName(sequence->event));
+        writeString(fileHandle, sequence->header);
+        writeInt(fileHandle, sequence->isTrivialSequence);
+    }
+    stList_destruct(sequences);
+}
+
+/*
+ * Writes the coordinate, strand and sequence (or event, if the cap has no sequence) of a cap.
+ */
+static void writeCapCoordinates(FILE *fileHandle, Cap *cap) {
+    writeInt(fileHandle, cap_getCoordinate(cap));
+    writeInt(fileHandle, cap_getStrand(cap));
+    Sequence *sequence = cap_getSequence(cap);
+    writeInt(fileHandle, sequence != NULL);
+    writeInt(fileHandle, sequence != NULL ? sequence_getName(sequence) : event_getName(cap_getEvent(cap)));
+}
+
+static void writeStubEnd(FILE *fileHandle, End *end) {
+    writeInt(fileHandle, SNAPSHOT_STUB_END);
+    writeInt(fileHandle, end_getName(end));
+    writeInt(fileHandle, end_isAttached(end));
+    writeInt(fileHandle, end_getSide(end));
+    // The caps are written in reverse, as they are prepended to the end when loaded
+    stList *caps = stList_construct();
+    End_InstanceIterator *capIt = end_getInstanceIterator(end);
+    Cap *cap;
+    while ((cap = end_getNext(capIt)) != NULL) {
+        stList_append(caps, cap);
+    }
+    end_destructInstanceIterator(capIt);
+    writeInt(fileHandle, stList_length(caps));
+    while (stList_length(caps) > 0) {
+        cap = stList_pop(caps);
+        writeInt(fileHandle, cap_getName(cap));
+        writeCapCoordinates(fileHandle, cap);
+    }
+    stList_destruct(caps);
+}
+
+static void writeBlock(FILE *fileHandle, Block *block) {
+    writeInt(fileHandle, SNAPSHOT_BLOCK);
+    writeInt(fileHandle, end_getName(block_get5End(block)));
+    writeInt(fileHandle, block_getLength(block));
+    // The segments are written in reverse, as they are prepended to the block when loaded
+    stList *segments = stList_construct();
+    Block_InstanceIterator *segmentIt = block_getInstanceIterator(block);
+    Segment *segment;
+    while ((segment = block_getNext(segmentIt)) != NULL) {
+        stList_append(segments, segment_getPositiveOrientation(segment));
+    }
+    block_destructInstanceIterator(segmentIt);
+    writeInt(fileHandle, stList_length(segments));
+    while (stList_length(segments) > 0) {
+        segment = stList_pop(segments);
+        Cap *cap = segment_get5Cap(segment);
+        writeInt(fileHandle, cap_getName(cap));
+        writeCapCoordinates(fileHandle, cap);
+    }
+    stList_destruct(segments);
+}
+
+static void writeGroup(FILE *fileHandle, Group *group) {
+    writeInt(fileHandle, group_getName(group));
+    writeInt(fileHandle, group_isLeaf(group));
+    // The ends are written in reverse, as they are prepended to the group when loaded
+    stList *ends = stList_construct();
+    Group_EndIterator *endIt = group_getEndIterator(group);
+    End *end;
+    while ((end = group_getNextEnd(endIt)) != NULL) {
+        stList_append(ends, end);
+    }
+    group_destructEndIterator(endIt);
+    writeInt(fileHandle, stList_length(ends));
+    while (stList_length(ends) > 0) {
+        writeInt(fileHandle, end_getName(stList_pop(ends)));
+    }
+    stList_destruct(ends);
+}
+
+static void writeChain(FILE *fileHandle, Chain *chain) {
+    writeInt(fileHandle, chain_getName(chain));
+    int64_t linkNumber = 0;
+    for (Link *link = chain_getFirst(chain); link != NULL; link = link_getNextLink(link)) {
+        linkNumber++;
+    }
+    writeInt(fileHandle, linkNumber);
+    for (Link *link = chain_getFirst(chain); link != NULL; link = link_getNextLink(link)) {
+        writeInt(fileHandle, group_getName(link_getGroup(link)));
+        writeInt(fileHandle, end_getName(link_get3End(link)));
+        writeInt(fileHandle, end_getName(link_get5End(link)));
+    }
+}
+
+/*
+ * Writes a flower and, recursively, its nested flowers. A flower is written as:
+ * name, built blocks flag, sequence names, ends and blocks (in end order), adjacencies, groups, chains,
+ * then the nested flower of each non-leaf group, in group order.
+ */
+static void writeFlower(FILE *fileHandle, Flower *flower) {
+    writeInt(fileHandle, flower_getName(flower));
+    writeInt(fileHandle, flower_builtBlocks(flower));
+
+    writeInt(fileHandle, flower_getSequenceNumber(flower));
+    Flower_SequenceIterator *sequenceIt = flower_getSequenceIterator(flower);
+    Sequence *sequence;
+    while ((sequence = flower_getNextSequence(sequenceIt)) != NULL) {
+        writeInt(fileHandle, sequence_getName(sequence));
+    }
+    flower_destructSequenceIterator(sequenceIt);
+
+    writeInt(fileHandle, flower_getStubEndNumber(flower) + flower_getBlockNumber(flower));
+    Flower_EndIterator *endIt = flower_getEndIterator(flower);
+    End *end;
+    while ((end = flower_getNextEnd(endIt)) != NULL) {
+        if (end_isStubEnd(end)) {
+            writeStubEnd(fileHandle, end);
+        } else if (end_left(end)) {
+            writeBlock(fileHandle, block_getPositiveOrientation(end_getBlock(end)));
+        }
+    }
+    flower_destructEndIterator(endIt);
+
+    // Each adjacency is written once, from the positive orientation of the cap with the smaller name
+    stList *adjacencies = stList_construct();
+    Flower_CapIterator *capIt = flower_getCapIterator(flower);
+    Cap *cap;
+    while ((cap = flower_getNextCap(capIt)) != NULL) {
+        Cap *adjacentCap = cap_getAdjacency(cap);
+        if (adjacentCap != NULL && cap_getName(cap) < cap_getName(adjacentCap)) {
+            stList_append(adjacencies, cap);
+        }
+    }
+    flower_destructCapIterator(capIt);
+    writeInt(fileHandle, stList_length(adjacencies));
+    for (int64_t i = 0; i < stList_length(adjacencies); i++) {
+        cap = stList_get(adjacencies, i);
+        Cap *adjacentCap = cap_getAdjacency(cap);
+        writeInt(fileHandle, cap_getName(cap));
+        writeInt(fileHandle, cap_getName(adjacentCap));
+        writeInt(fileHandle, cap_getOrientation(adjacentCap));
+    }
+    stList_destruct(adjacencies);
+
+    writeInt(fileHandle, flower_getGroupNumber(flower));
+    Flower_GroupIterator *groupIt = flower_getGroupIterator(flower);
+    Group *group;
+    while ((group = flower_getNextGroup(groupIt)) != NULL) {
+        writeGroup(fileHandle, group);
+    }
+    flower_destructGroupIterator(groupIt);
+
+    writeInt(fileHandle, flower_getChainNumber(flower));
+    Flower_ChainIterator *chainIt = flower_getChainIterator(flower);
+    Chain *chain;
+    while ((chain = flower_getNextChain(chainIt)) != NULL) {
+        writeChain(fileHandle, chain);
+    }
+    flower_destructChainIterator(chainIt);
+
+    groupIt = flower_getGroupIterator(flower);
+    while ((group = flower_getNextGroup(groupIt)) != NULL) {
+        if (!group_isLeaf(group)) {
+            writeFlower(fileHandle, group_getNestedFlower(group));
+        }
+    }
+    flower_destructGroupIterator(groupIt);
+}
+
+void cactusDisk_writeSnapshot(CactusDisk *cactusDisk, const char *snapshotFile) {
+    // Write to a temporary file and then rename, so that a partially written snapshot is never left behind
+    char *tempFile = stString_print("%s.tmp", snapshotFile);
+    FILE *fileHandle = fopen(tempFile, "wb");
+    if (fileHandle == NULL) {
+        st_errAbort("Could not open cactus disk snapshot for writing: %s", tempFile);
+    }
+
+    writeInt(fileHandle, SNAPSHOT_MAGIC);
+    writeInt(fileHandle, SNAPSHOT_VERSION);
+    writeInt(fileHandle, cactusDisk->currentName);
+
+    if (cactusDisk->eventTree == NULL) {
+        st_errAbort("Can not write a snapshot of a cactus disk without an event tree");
+    }
+    writeEventTree(fileHandle, cactusDisk->eventTree);
+    writeStrings(fileHandle, cactusDisk);
+    writeSequences(fileHandle, cactusDisk);
+
+    // The roots of the flower hierarchies, from which all the flowers are written
+    stList *rootFlowers = stList_construct();
+    stList *flowers = cactusDisk_getFlowers(cactusDisk);
+    for (int64_t i = 0; i < stList_length(flowers); i++) {
+        Flower *flower = stList_get(flowers, i);
+        if (!flower_hasParentGroup(flower)) {
+            stList_append(rootFlowers, flower);
+        }
+    }
+    stList_destruct(flowers);
+    writeInt(fileHandle, stList_length(rootFlowers));
+    for (int64_t i = 0; i < stList_length(rootFlowers); i++) {
+        writeFlower(fileHandle, stList_get(rootFlowers, i));
+    }
+    stList_destruct(rootFlowers);
+
+    if (fclose(fileHandle) != 0) {
+        st_errAbort("Failed to write cactus disk snapshot: %s", tempFile);
+    }
+    if (rename(tempFile, snapshotFile) != 0) {
+        st_errAbort("Could not move cactus disk snapshot %s to %s", tempFile, snapshotFile);
+    }
+    free(tempFile);
+}
+
+////////////////////////////////////////////////
+//Loading
+////////////////////////////////////////////////
+
+typedef struct _snapshotReader {
+    const char *snapshotFile;
+    char *map;
+    size_t mapLength;
+    size_t offset;
+} SnapshotReader;
+
+static void checkRemaining(SnapshotReader *reader, size_t length) {
+    if (length > reader->mapLength - reader->offset) {
+        st_errAbort("Cactus disk snapshot is truncated: %s", reader->snapshotFile);
+    }
+}
+
+static int64_t readInt(SnapshotReader *reader) {
+    checkRemaining(reader, sizeof(int64_t));
+    int64_t i;
+    memcpy(&i, reader->map + reader->offset, sizeof(int64_t));
+    reader->offset += sizeof(int64_t);
+    return i;
+}
+
+static double readDouble(SnapshotReader *reader) {
+    checkRemaining(reader, sizeof(double));
+    double d;
+    memcpy(&d, reader->map + reader->offset, sizeof(double));
+    reader->offset += sizeof(double);
+    return d;
+}
+
+/*
+ * Returns a newly allocated copy of the next string.
+ */
+static char *readString(SnapshotReader *reader) {
+    int64_t length = readInt(reader);
+    if (length < 0) {
+        st_errAbort("Cactus disk snapshot is corrupt: %s", reader->snapshotFile);
+    }
+    checkRemaining(reader, length);
+    char *string = st_malloc(length + 1);
+    memcpy(string, reader->map + reader->offset, length);
+    string[length] = '\0';
+    reader->offset += length;
+    return string;
+}
+
+static void readEventTree(SnapshotReader *reader, CactusDisk *cactusDisk) {
+    EventTree *eventTree = eventTree_construct(cactusDisk, readInt(reader));
+    int64_t eventNumber = readInt(reader);
+    for (int64_t i = 0; i < eventNumber; i++) {
+        Name name = readInt(reader);
+        Event *parentEvent = eventTree_getEvent(eventTree, readInt(reader));
+        assert(parentEvent != NULL);
+        char *header = readString(reader);
+        double branchLength = readDouble(reader);
+        Event *event = event_construct(name, header, branchLength, parentEvent, eventTree);
+        event_setOutgroupStatus(event, readInt(reader));
+        free(header);
+    }
+}
+
+static void readStrings(SnapshotReader *reader, CactusDisk *cactusDisk) {
+    int64_t stringNumber = readInt(reader);
+    for (int64_t i = 0; i < stringNumber; i++) {
+        Name name = readInt(reader);
+        int64_t length = readInt(reader);
+        if (length < 0) {
+            st_errAbort("Cactus disk snapshot is corrupt: %s", reader->snapshotFile);
+        }
+        checkRemaining(reader, length);
+        // Pack the string straight from the mapped file
+        cactusDisk_addString2(cactusDisk, name, reader->map + reader->offset, length);
+        reader->offset += length;
+    }
+}
+
+static void readSequences(SnapshotReader *reader, CactusDisk *cactusDisk) {
+    int64_t sequenceNumber = readInt(reader);
+    for (int64_t i = 0; i < sequenceNumber; i++) {
+        Name name = readInt(reader);
+        Name stringName = readInt(reader);
+        int64_t start = readInt(reader);
+        int64_t length = readInt(reader);
+        Event *event = eventTree_getEvent(cactusDisk->eventTree, readInt(reader));
+        assert(event != NULL);
+        char *header = readString(reader);
+        bool isTrivialSequence = readInt(reader);
+        sequence_construct2(name, start, length, stringName, header, event, isTrivialSequence, cactusDisk);
+        free(header);
+    }
+}
+
+/*
+ * Sets the coordinates of a cap from those written by writeCapCoordinates.
+ */
+static void readCapCoordinates(SnapshotReader *reader, Cap *cap, CactusDisk *cactusDisk) {
+    int64_t coordinate = readInt(reader);
+    bool strand = readInt(reader);
+    bool hasSequence = readInt(reader);
+    Name name = readInt(reader);
+    cap_setCoordinates(cap, coordinate, strand, hasSequence ? cactusDisk_getSequence(cactusDisk, name) : NULL);
+}
+
+/*
+ * Gets the event of a cap without constructing it, by peeking ahead at its coordinates.
+ */
+static Event *peekCapEvent(SnapshotReader *reader, CactusDisk *cactusDisk) {
+    size_t offset = reader->offset;
+    readInt(reader); // coordinate
+    readInt(reader); // strand
+    bool hasSequence = readInt(reader);
+    Name name = readInt(reader);
+    reader->offset = offset;
+    return hasSequence ? sequence_getEvent(cactusDisk_getSequence(cactusDisk, name))
+                       : eventTree_getEvent(cactusDisk->eventTree, name);
+}
+
+static void readEndOrBlock(SnapshotReader *reader, Flower *flower, CactusDisk *cactusDisk) {
+    int64_t type = readInt(reader);
+    if (type == SNAPSHOT_STUB_END) {
+        Name name = readInt(reader);
+        bool isAttached = readInt(reader);
+        bool side = readInt(reader);
+        End *end = end_construct3(name, isAttached, side, flower);
+        int64_t capNumber = readInt(reader);
+        for (int64_t i = 0; i < capNumber; i++) {
+            Name capName = readInt(reader);
+            Cap *cap = cap_construct3(capName, peekCapEvent(reader, cactusDisk), end);
+            readCapCoordinates(reader, cap, cactusDisk);
+        }
+    } else if (type == SNAPSHOT_BLOCK) {
+        Name name = readInt(reader);
+        int64_t length = readInt(reader);
+        Block *block = block_construct2(name, length, flower);
+        int64_t segmentNumber = readInt(reader);
+        for (int64_t i = 0; i < segmentNumber; i++) {
+            Name capName = readInt(reader);
+            Segment *segment = segment_construct3(capName, block, peekCapEvent(reader, cactusDisk));
+            readCapCoordinates(reader, segment_get5Cap(segment), cactusDisk);
+        }
+    } else {
+        st_errAbort("Cactus disk snapshot is corrupt: %s", reader->snapshotFile);
+    }
+}
+
+static void readFlower(SnapshotReader *reader, Flower *flower, CactusDisk *cactusDisk) {
+    if (readInt(reader) != flower_getName(flower)) {
+        st_errAbort("Cactus disk snapshot is corrupt: %s", reader->snapshotFile);
+    }
+    flower_setBuiltBlocks(flower, readInt(reader));
+
+    int64_t sequenceNumber = readInt(reader);
+    for (int64_t i = 0; i < sequenceNumber; i++) {
+        Sequence *sequence = cactusDisk_getSequence(cactusDisk, readInt(reader));
+        assert(sequence != NULL);
+        flower_addSequence(flower, sequence);
+    }
+
+    // Use the sorted sets while adding ends and caps, which may be out of order
+    flower_setFastCapsAndEnds(flower, 1);
+    int64_t endNumber = readInt(reader);
+    for (int64_t i = 0; i < endNumber; i++) {
+        readEndOrBlock(reader, flower, cactusDisk);
+    }
+    flower_setFastCapsAndEnds(flower, 0);
+
+    int64_t adjacencyNumber = readInt(reader);
+    for (int64_t i = 0; i < adjacencyNumber; i++) {
+        Cap *cap = flower_getCap(flower, readInt(reader));
+        Cap *adjacentCap = flower_getCap(flower, readInt(reader));
+        assert(cap != NULL && adjacentCap != NULL);
+        cap_makeAdjacent(cap, readInt(reader) ? adjacentCap : cap_getReverse(adjacentCap));
+    }
+
+    int64_t groupNumber = readInt(reader);
+    for (int64_t i = 0; i < groupNumber; i++) {
+        Group *group = group_construct3(flower, readInt(reader));
+        group_setLeaf(group, readInt(reader)); // Nested flowers are made below, resetting this flag
+        int64_t groupEndNumber = readInt(reader);
+        for (int64_t j = 0; j < groupEndNumber; j++) {
+            End *end = flower_getEnd(flower, readInt(reader));
+            assert(end != NULL);
+            end_setGroup(end, group);
+        }
+    }
+
+    int64_t chainNumber = readInt(reader);
+    for (int64_t i = 0; i < chainNumber; i++) {
+        Chain *chain = chain_construct2(readInt(reader), flower);
+        int64_t linkNumber = readInt(reader);
+        for (int64_t j = 0; j < linkNumber; j++) {
+            Group *group = flower_getGroup(flower, readInt(reader));
+            End *_3End = flower_getEnd(flower, readInt(reader));
+            End *_5End = flower_getEnd(flower, readInt(reader));
+            assert(group != NULL && _3End != NULL && _5End != NULL);
+            link_construct(_3End, _5End, group, chain);
+        }
+    }
+
+    Flower_GroupIterator *groupIt = flower_getGroupIterator(flower);
+    Group *group;
+    while ((group = flower_getNextGroup(groupIt)) != NULL) {
+        if (!group_isLeaf(group)) {
+            group_setLeaf(group, 1);
+            readFlower(reader, group_makeEmptyNestedFlower(group), cactusDisk);
+        }
+    }
+    flower_destructGroupIterator(groupIt);
+}
+
+CactusDisk *cactusDisk_loadSnapshot(const char *snapshotFile, Flower **rootFlower) {
+    int fd = open(snapshotFile, O_RDONLY);
+    if (fd == -1) {
+        st_errAbort("Could not open cactus disk snapshot: %s", snapshotFile);
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0) {
+        st_errAbort("Could not stat cactus disk snapshot: %s", snapshotFile);
+    }
+    SnapshotReader reader;
+    reader.snapshotFile = snapshotFile;
+    reader.mapLength = fileStat.st_size;
+    reader.offset = 0;
+    if (reader.mapLength == 0) {
+        st_errAbort("Cactus disk snapshot is empty: %s", snapshotFile);
+    }
+    reader.map = mmap(NULL, reader.mapLength, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (reader.map == MAP_FAILED) {
+        st_errAbort("Could not mmap cactus disk snapshot: %s", snapshotFile);
+    }
+    close(fd);
+    madvise(reader.map, reader.mapLength, MADV_SEQUENTIAL);
+
+    if (readInt(&reader) != SNAPSHOT_MAGIC) {
+        st_errAbort("File is not a cactus disk snapshot: %s", snapshotFile);
+    }
+    int64_t version = readInt(&reader);
+    if (version != SNAPSHOT_VERSION) {
+        st_errAbort("Cactus disk snapshot has unsupported version %" PRIi64 ": %s", version, snapshotFile);
+    }
+    Name currentName = readInt(&reader);
+
+    CactusDisk *cactusDisk = cactusDisk_construct();
+    // Names issued from here on must not clash with those in the snapshot
+    cactusDisk->currentName = currentName;
+    readEventTree(&reader, cactusDisk);
+    readStrings(&reader, cactusDisk);
+    readSequences(&reader, cactusDisk);
+
+    *rootFlower = NULL;
+    int64_t rootFlowerNumber = readInt(&reader);
+    for (int64_t i = 0; i < rootFlowerNumber; i++) {
+        size_t offset = reader.offset;
+        Flower *flower = flower_construct2(readInt(&reader), cactusDisk);
+        reader.offset = offset;
+        readFlower(&reader, flower, cactusDisk);
+        if (*rootFlower == NULL) {
+            *rootFlower = flower;
+        }
+    }
+    if (reader.offset != reader.mapLength) {
+        st_errAbort("Cactus disk snapshot has trailing data: %s", snapshotFile);
+    }
+
+    munmap(reader.map, reader.mapLength);
+    return cactusDisk;
+}
@@ -33,3 +33,33 @@ Name testCommon_addThreadToFlower(Flower *flower, char *header, int64_t length)
     free(dna);
     return cap_getName(cap1);
 }
+
+Flower *testCommon_constructFlowerWithThreads(int64_t threadNumber, int64_t threadLength, stList *threadNames) {
+    CactusDisk *cactusDisk = cactusDisk_construct();
+    eventTree_construct2(cactusDisk);
+    Flower *flower = flower_construct2(0, cactusDisk);
+    group_construct2(flower);
+    for (int64_t i = 0; i < threadNumber; i++) {
+        char *header = stString_print("thread%" PRIi64, i);
+        Name name = testCommon_addThreadToFlower(flower, header, threadLength);
+        if (threadNames != NULL) {
+            Name *n = st_malloc(sizeof(Name));
+            *n = name;
+            stList_append(threadNames, n);
+        }
+        free(header);
+    }
+    return flower;
+}
+
+stPinch testCommon_getRandomPinch(stList *threadNames, int64_t threadLength) {
+    stPinch pinch;
+    pinch.name1 = *(Name *)stList_get(threadNames, st_randomInt(0, stList_length(threadNames)));
+    pinch.name2 = *(Name *)stList_get(threadNames, st_randomInt(0, stList_length(threadNames)));
+    pinch.length = st_randomInt(1, 10);
+    // The sequences of the threads start at 2, after the 5' cap
+    pinch.start1 = 2 + st_randomInt(0, threadLength - pinch.length);
+    pinch.start2 = 2 + st_randomInt(0, threadLength - pinch.length);
+    pinch.strand = st_random() > 0.3;
+    return pinch;
+}
@@ -21,6 +21,8 @@
 #include "cactusFlower.h"
 #include "cactusDisk.h"
 #include "cactusMisc.h"
+#include "cactusProfiler.h"
+#include "cactusPackedString.h"
 #include "cactusTestCommon.h"
 #include "cactus_params_parser.h"
 
@@ -41,6 +41,19 @@ int64_t cactusDisk_getUniqueID(CactusDisk *cactusDisk);
  */
 int64_t cactusDisk_getUniqueIDInterval(CactusDisk *cactusDisk, int64_t intervalSize);
 
+/*
+ * Makes the calling thread hand out ids from the interval start to start + intervalSize (exclusive), previously
+ * retrieved with cactusDisk_getUniqueIDInterval, so that the names it gives to objects do not depend on the other
+ * threads. Once the interval runs out the thread goes back to taking ids from the cactus disk.
+ */
+void cactusDisk_setUniqueIDInterval(CactusDisk *cactusDisk, int64_t start, int64_t intervalSize);
+
+/*
+ * Puts back the ids the calling thread handed out before cactusDisk_setUniqueIDInterval was called with the given
+ * interval. Returns false if the interval ran out.
+ */
+bool cactusDisk_restoreUniqueIDInterval(CactusDisk *cactusDisk, int64_t start, int64_t intervalSize);
+
 /*
  * Gets a flower the cactusDisk contains. If the flower is not in memory it will be loaded. If not in memory or on disk, returns NULL.
  */
@@ -56,4 +69,17 @@ Sequence *cactusDisk_getSequence(CactusDisk *cactusDisk, Name sequenceName);
  */
 EventTree *cactusDisk_getEventTree(CactusDisk *cactusDisk);
 
+/*
+ * Writes a snapshot of the cactus disk, including the event tree, sequences and every flower hierarchy,
+ * to the given file. The snapshot is written to a temporary file which is then renamed, so an
+ * interrupted write never leaves a partial snapshot in place.
+ */
+void cactusDisk_writeSnapshot(CactusDisk *cactusDisk, const char *snapshotFile);
+
+/*
+ * Loads a cactus disk from a snapshot written by cactusDisk_writeSnapshot. All object names are preserved.
+ * Sets rootFlower to the root of the first flower hierarchy in the snapshot.
+ */
+CactusDisk *cactusDisk_loadSnapshot(const char *snapshotFile, Flower **rootFlower);
+
 #endif
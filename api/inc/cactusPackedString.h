@@ -0,0 +1,82 @@
+/*
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef CACTUS_PACKED_STRING_H_
+#define CACTUS_PACKED_STRING_H_
+
+#include "cactusGlobals.h"
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//A DNA string packed into two bits per base, with side tables
+//recording runs of Ns, runs of soft-masked (lower case) bases and
+//any other characters, so that the original string is recovered exactly.
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+typedef struct _cactusPackedString CactusPackedString;
+
+#define PACKED_STRING_ITERATOR_BUFFER_SIZE 256
+
+/*
+ * Iterates over a substring of a packed string, on either strand, decoding a small buffer at a time.
+ * Can be allocated on the stack.
+ */
+typedef struct _packedStringIterator {
+    const CactusPackedString *packedString;
+    int64_t start; // The substring being iterated over, in forward strand coordinates
+    int64_t length;
+    bool strand;
+    int64_t offset; // The number of characters returned so far
+    int64_t bufferOffset; // The offset of the first character in the buffer
+    int64_t bufferLength;
+    char buffer[PACKED_STRING_ITERATOR_BUFFER_SIZE];
+} PackedStringIterator;
+
+/*
+ * Packs the first length characters of string.
+ */
+CactusPackedString *packedString_construct(const char *string, int64_t length);
+
+void packedString_destruct(CactusPackedString *packedString);
+
+int64_t packedString_getLength(const CactusPackedString *packedString);
+
+/*
+ * Returns the number of bytes used by the packed string.
+ */
+int64_t packedString_getMemoryUsage(const CactusPackedString *packedString);
+
+/*
+ * Gets the character at the given position.
+ */
+char packedString_getChar(const CactusPackedString *packedString, int64_t position);
+
+/*
+ * Writes the substring of length characters starting at start into buffer, which must have space for length + 1
+ * characters, and terminates it. If strand is false the reverse complement of the substring is written.
+ */
+void packedString_copySubString(const CactusPackedString *packedString, int64_t start, int64_t length, bool strand,
+                                char *buffer);
+
+/*
+ * Returns a newly allocated copy of the substring, reverse complemented if strand is false.
+ */
+char *packedString_getSubString(const CactusPackedString *packedString, int64_t start, int64_t length, bool strand);
+
+/*
+ * Starts iterating over the substring of length characters starting at start. If strand is false the iterator returns
+ * the reverse complement of the substring.
+ */
+void packedString_initIterator(PackedStringIterator *iterator, const CactusPackedString *packedString,
+                               int64_t start, int64_t length, bool strand);
+
+/*
+ * Returns the next character of the iterator, or '\0' once the substring is exhausted.
+ */
+char packedString_getNext(PackedStringIterator *iterator);
+
+#endif
@@ -0,0 +1,52 @@
+/*
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef CACTUS_PROFILER_H_
+#define CACTUS_PROFILER_H_
+
+#include "cactusGlobals.h"
+
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+//A process wide profiler, recording the wall time, cpu time and
+//memory usage of nested stages of a run.
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+////////////////////////////////////////////////
+
+/*
+ * Turns on the profiler. Until this is called starting and ending stages does nothing, so
+ * stages can be marked unconditionally throughout the code.
+ */
+void cactusProfiler_enable(void);
+
+/*
+ * Returns non-zero if the profiler is enabled.
+ */
+bool cactusProfiler_isEnabled(void);
+
+/*
+ * Starts a stage with the given printf style name. Stages started before the current stage is ended are
+ * nested within it. Must only be called from outside of parallel regions.
+ */
+void cactusProfiler_startStage(const char *stageName, ...);
+
+/*
+ * Ends the most recently started stage that has not yet been ended.
+ */
+void cactusProfiler_endStage(void);
+
+/*
+ * Writes a single JSON record describing the run and each stage recorded (in the order the stages were started)
+ * to the given file. Stages that have not been ended are reported as ending now.
+ */
+void cactusProfiler_writeJson(const char *jsonFile);
+
+/*
+ * Disables the profiler and frees the recorded stages.
+ */
+void cactusProfiler_destruct(void);
+
+#endif
@@ -8,6 +8,7 @@
 #define CACTUS_SEQUENCE_H_
 
 #include "cactusGlobals.h"
+#include "cactusPackedString.h"
 
 ////////////////////////////////////////////////
 ////////////////////////////////////////////////
@@ -56,6 +57,19 @@ Event *sequence_getEvent(Sequence *sequence);
  */
 char *sequence_getString(Sequence *sequence, int64_t start, int64_t length, int64_t strand);
 
+/*
+ * As sequence_getString, but writes the string into buffer, which must have space for length + 1 characters,
+ * rather than allocating it.
+ */
+void sequence_copyString(Sequence *sequence, int64_t start, int64_t length, int64_t strand, char *buffer);
+
+/*
+ * Initialises iterator to return the characters of the subsequence one at a time, reverse complemented if
+ * strand is false, without copying the subsequence.
+ */
+void sequence_getStringIterator(Sequence *sequence, int64_t start, int64_t length, int64_t strand,
+                                PackedStringIterator *iterator);
+
 /*
  * Gets the header line associated with the meta sequence.
  */
@@ -8,6 +8,7 @@
 #define CACTUS_TEST_COMMON_H_
 
 #include "cactusGlobals.h"
+#include "stPinchGraphs.h"
 
 ////////////////////////////////////////////////
 ////////////////////////////////////////////////
@@ -27,4 +28,17 @@ char *testCommon_getTmpTestDir(const char *testName);
  */
  Name testCommon_addThreadToFlower(Flower *flower, char *header, int64_t length);
 
+/*
+ * Makes a flower in a new cactus disk, with an event tree, a group and the given number of threads of random
+ * nucleotides added by testCommon_addThreadToFlower. If threadNames is not NULL the names of the threads are appended
+ * to it, each as a malloced Name.
+ */
+Flower *testCommon_constructFlowerWithThreads(int64_t threadNumber, int64_t threadLength, stList *threadNames);
+
+/*
+ * Returns a random pinch of up to ten bases between two of the given threads, each made by
+ * testCommon_addThreadToFlower with the given length. The pinch avoids the caps at the ends of the threads.
+ */
+stPinch testCommon_getRandomPinch(stList *threadNames, int64_t threadLength);
+
 #endif
@@ -20,6 +20,8 @@ CuSuite *cactusDiskTestSuite();
 CuSuite *cactusMiscTestSuite();
 CuSuite *cactusFlowerTestSuite();
 CuSuite *cactusParamsTestSuite(void);
+CuSuite *cactusProfilerTestSuite(void);
+CuSuite *cactusPackedStringTestSuite(void);
 
 int cactusAPIRunAllTests(void) {
 	CuString *output = CuStringNew();
@@ -38,6 +40,8 @@ int cactusAPIRunAllTests(void) {
 	CuSuiteAddSuite(suite, cactusMiscTestSuite());
 	CuSuiteAddSuite(suite, cactusFlowerTestSuite());
     CuSuiteAddSuite(suite, cactusParamsTestSuite());
+    CuSuiteAddSuite(suite, cactusProfilerTestSuite());
+    CuSuiteAddSuite(suite, cactusPackedStringTestSuite());
 	CuSuiteRun(suite);
 	CuSuiteSummary(suite, output);
 	CuSuiteDetails(suite, output);
@@ -5,6 +5,7 @@
  */
 
 #include "cactusGlobalsPrivate.h"
+#include "cactusChainsTestShared.h"
 
 void testCactusDisk_constructAndDestruct(CuTest* testCase) {
     CactusDisk *cactusDisk = cactusDisk_construct();
@@ -85,6 +86,130 @@ void testCactusDisk_getUniqueID_UniqueIntervals(CuTest* testCase) {
     cactusDisk_destruct(cactusDisk);
 }
 
+void testCactusDisk_getUniqueID_Parallel(CuTest* testCase) {
+    CactusDisk *cactusDisk = cactusDisk_construct();
+    int64_t namesPerIteration = 4; // An id and an interval of three, as used for segments
+    int64_t iterations = 100000;
+    Name *names = st_malloc(sizeof(Name) * namesPerIteration * iterations);
+#if defined(_OPENMP)
+#pragma omp parallel for
+#endif
+    for (int64_t i = 0; i < iterations; i++) {
+        names[i * namesPerIteration] = cactusDisk_getUniqueID(cactusDisk);
+        Name interval = cactusDisk_getUniqueIDInterval(cactusDisk, 3);
+        for (int64_t j = 0; j < 3; j++) {
+            names[i * namesPerIteration + 1 + j] = interval + j;
+        }
+    }
+    stSortedSet *uniqueNames = stSortedSet_construct();
+    for (int64_t i = 0; i < namesPerIteration * iterations; i++) {
+        CuAssertTrue(testCase, names[i] > 0);
+        CuAssertTrue(testCase, names[i] < cactusDisk->currentName);
+        CuAssertTrue(testCase, stSortedSet_search(uniqueNames, (void *)names[i]) == NULL);
+        stSortedSet_insert(uniqueNames, (void *)names[i]);
+    }
+    stSortedSet_destruct(uniqueNames);
+    free(names);
+    cactusDisk_destruct(cactusDisk);
+}
+
+void testCactusDisk_getSequence_Parallel(CuTest* testCase) {
+    CactusDisk *cactusDisk = cactusDisk_construct();
+    int64_t sequenceNumber = 1000;
+    Sequence **sequences = st_malloc(sizeof(Sequence *) * sequenceNumber);
+#if defined(_OPENMP)
+#pragma omp parallel for
+#endif
+    for (int64_t i = 0; i < sequenceNumber; i++) {
+        sequences[i] = sequence_construct(1, 4, "ACTG", "FOO", NULL, cactusDisk);
+    }
+    for (int64_t i = 0; i < sequenceNumber; i++) {
+        CuAssertTrue(testCase, cactusDisk_getSequence(cactusDisk, sequence_getName(sequences[i])) == sequences[i]);
+        char *string = sequence_getString(sequences[i], 2, 2, 1);
+        CuAssertStrEquals(testCase, "CT", string);
+        free(string);
+    }
+    stList *allSequences = cactusDisk_getSequences(cactusDisk);
+    CuAssertIntEquals(testCase, sequenceNumber, stList_length(allSequences));
+    for (int64_t i = 1; i < stList_length(allSequences); i++) {
+        CuAssertTrue(testCase, sequence_getName(stList_get(allSequences, i - 1)) < sequence_getName(stList_get(allSequences, i)));
+    }
+    stList_destruct(allSequences);
+    free(sequences);
+    cactusDisk_destruct(cactusDisk);
+}
+
+static char *readSnapshot(const char *snapshotFile, int64_t *length) {
+    FILE *fileHandle = fopen(snapshotFile, "rb");
+    assert(fileHandle != NULL);
+    fseek(fileHandle, 0, SEEK_END);
+    *length = ftell(fileHandle);
+    fseek(fileHandle, 0, SEEK_SET);
+    char *bytes = st_malloc(*length);
+    size_t bytesRead = fread(bytes, sizeof(char), *length, fileHandle);
+    assert(bytesRead == *length);
+    fclose(fileHandle);
+    return bytes;
+}
+
+void testCactusDisk_snapshot(CuTest* testCase) {
+    cactusChainsSharedTestSetup(NULL);
+    char *snapshotFile = "tempFileForCactusDiskTest.snapshot";
+    char *snapshotFile2 = "tempFileForCactusDiskTest2.snapshot";
+    cactusDisk_writeSnapshot(cactusDisk, snapshotFile);
+
+    Flower *loadedFlower;
+    CactusDisk *loadedCactusDisk = cactusDisk_loadSnapshot(snapshotFile, &loadedFlower);
+    CuAssertIntEquals(testCase, flower_getName(flower), flower_getName(loadedFlower));
+    CuAssertIntEquals(testCase, cactusDisk->currentName, loadedCactusDisk->currentName);
+    CuAssertIntEquals(testCase, flower_getEndNumber(flower), flower_getEndNumber(loadedFlower));
+    CuAssertIntEquals(testCase, flower_getBlockNumber(flower), flower_getBlockNumber(loadedFlower));
+    CuAssertIntEquals(testCase, flower_getGroupNumber(flower), flower_getGroupNumber(loadedFlower));
+    CuAssertIntEquals(testCase, flower_getChainNumber(flower), flower_getChainNumber(loadedFlower));
+    CuAssertIntEquals(testCase, flower_builtBlocks(flower), flower_builtBlocks(loadedFlower));
+
+    // Check a segment kept its coordinates, sequence and adjacency
+    Block *loadedBlock = flower_getBlock(loadedFlower, block_getName(block2));
+    CuAssertTrue(testCase, loadedBlock != NULL);
+    Segment *loadedSegment = block_getInstance(loadedBlock, segment_getName(segment1));
+    CuAssertTrue(testCase, loadedSegment != NULL);
+    CuAssertIntEquals(testCase, segment_getStart(segment1), segment_getStart(loadedSegment));
+    CuAssertIntEquals(testCase, segment_getStrand(segment1), segment_getStrand(loadedSegment));
+    char *string = segment_getString(segment1);
+    char *loadedString = segment_getString(loadedSegment);
+    CuAssertStrEquals(testCase, string, loadedString);
+    free(string);
+    free(loadedString);
+    CuAssertIntEquals(testCase, cap_getName(cap_getAdjacency(segment_get3Cap(segment1))),
+                      cap_getName(cap_getAdjacency(segment_get3Cap(loadedSegment))));
+
+    // Check the nested flowers and chains were rebuilt
+    Group *loadedGroup = flower_getGroup(loadedFlower, group_getName(group4));
+    CuAssertTrue(testCase, loadedGroup != NULL);
+    CuAssertTrue(testCase, group_getNestedFlower(loadedGroup) != NULL);
+    CuAssertTrue(testCase, group_getLink(loadedGroup) != NULL);
+    Chain *loadedChain = flower_getChain(loadedFlower, chain_getName(chain));
+    CuAssertTrue(testCase, loadedChain != NULL);
+    CuAssertIntEquals(testCase, end_getName(link_get5End(chain_getLast(chain))),
+                      end_getName(link_get5End(chain_getLast(loadedChain))));
+    CuAssertIntEquals(testCase, end_getName(link_get3End(link1)), end_getName(link_get3End(chain_getFirst(loadedChain))));
+
+    // A snapshot of the loaded cactus disk is identical to the original snapshot
+    cactusDisk_writeSnapshot(loadedCactusDisk, snapshotFile2);
+    int64_t length, length2;
+    char *bytes = readSnapshot(snapshotFile, &length);
+    char *bytes2 = readSnapshot(snapshotFile2, &length2);
+    CuAssertIntEquals(testCase, length, length2);
+    CuAssertTrue(testCase, memcmp(bytes, bytes2, length) == 0);
+    free(bytes);
+    free(bytes2);
+
+    stFile_rmtree(snapshotFile);
+    stFile_rmtree(snapshotFile2);
+    cactusDisk_destruct(loadedCactusDisk);
+    cactusChainsSharedTestTeardown(NULL);
+}
+
 CuSuite* cactusDiskTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testCactusDisk_getFlower);
@@ -92,6 +217,9 @@ CuSuite* cactusDiskTestSuite(void) {
     SUITE_ADD_TEST(suite, testCactusDisk_getUniqueID);
     SUITE_ADD_TEST(suite, testCactusDisk_getUniqueID_Unique);
     SUITE_ADD_TEST(suite, testCactusDisk_getUniqueID_UniqueIntervals);
+    SUITE_ADD_TEST(suite, testCactusDisk_getUniqueID_Parallel);
+    SUITE_ADD_TEST(suite, testCactusDisk_getSequence_Parallel);
     SUITE_ADD_TEST(suite, testCactusDisk_constructAndDestruct);
+    SUITE_ADD_TEST(suite, testCactusDisk_snapshot);
     return suite;
 }
@@ -0,0 +1,103 @@
+/*
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+#include <ctype.h>
+
+/*
+ * Makes a random string with runs of each kind of character the packed string handles specially.
+ */
+static char *getRandomString(int64_t length) {
+    const char *alphabet = "ACGTacgtNnRYry-";
+    char *string = st_malloc(length + 1);
+    int64_t i = 0;
+    while (i < length) {
+        char c = alphabet[st_randomInt(0, strlen(alphabet))];
+        int64_t runLength = st_randomInt(1, 20);
+        for (int64_t j = 0; j < runLength && i < length; j++) {
+            // Mostly bases, within a run of the chosen case
+            string[i++] = st_random() > 0.3 ? c : (islower(c) ? "acgt" : "ACGT")[st_randomInt(0, 4)];
+        }
+    }
+    string[length] = '\0';
+    return string;
+}
+
+static void testPackedString_getSubString(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        int64_t length = st_randomInt(0, 1000);
+        char *string = getRandomString(length);
+        CactusPackedString *packedString = packedString_construct(string, length);
+        CuAssertIntEquals(testCase, length, packedString_getLength(packedString));
+
+        char *copy = packedString_getSubString(packedString, 0, length, 1);
+        CuAssertStrEquals(testCase, string, copy);
+        free(copy);
+
+        for (int64_t i = 0; i < 10; i++) {
+            int64_t start = st_randomInt(0, length + 1);
+            int64_t subLength = st_randomInt(0, length - start + 1);
+            char *expected = stString_getSubString(string, start, subLength);
+            char *subString = packedString_getSubString(packedString, start, subLength, 1);
+            CuAssertStrEquals(testCase, expected, subString);
+            free(subString);
+
+            char *expectedReverse = stString_reverseComplementString(expected);
+            subString = packedString_getSubString(packedString, start, subLength, 0);
+            CuAssertStrEquals(testCase, expectedReverse, subString);
+            free(subString);
+
+            if (subLength > 0) {
+                CuAssertIntEquals(testCase, string[start], packedString_getChar(packedString, start));
+            }
+            free(expected);
+            free(expectedReverse);
+        }
+        packedString_destruct(packedString);
+        free(string);
+    }
+}
+
+static void testPackedString_iterator(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        int64_t length = st_randomInt(0, 2000);
+        char *string = getRandomString(length);
+        CactusPackedString *packedString = packedString_construct(string, length);
+        int64_t start = st_randomInt(0, length + 1);
+        int64_t subLength = st_randomInt(0, length - start + 1);
+        for (int64_t strand = 0; strand < 2; strand++) {
+            char *expected = packedString_getSubString(packedString, start, subLength, strand);
+            PackedStringIterator iterator;
+            packedString_initIterator(&iterator, packedString, start, subLength, strand);
+            for (int64_t i = 0; i < subLength; i++) {
+                CuAssertIntEquals(testCase, expected[i], packedString_getNext(&iterator));
+            }
+            CuAssertIntEquals(testCase, '\0', packedString_getNext(&iterator));
+            free(expected);
+        }
+        packedString_destruct(packedString);
+        free(string);
+    }
+}
+
+static void testPackedString_memoryUsage(CuTest *testCase) {
+    int64_t length = 100000;
+    char *string = st_malloc(length + 1);
+    for (int64_t i = 0; i < length; i++) {
+        string[i] = "ACGT"[st_randomInt(0, 4)];
+    }
+    string[length] = '\0';
+    CactusPackedString *packedString = packedString_construct(string, length);
+    CuAssertTrue(testCase, packedString_getMemoryUsage(packedString) <= length / 4 + 1000);
+    packedString_destruct(packedString);
+    free(string);
+}
+
+CuSuite* cactusPackedStringTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testPackedString_getSubString);
+    SUITE_ADD_TEST(suite, testPackedString_iterator);
+    SUITE_ADD_TEST(suite, testPackedString_memoryUsage);
+    return suite;
+}
@@ -0,0 +1,59 @@
+/*
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "cactusGlobalsPrivate.h"
+
+static void testCactusProfiler_disabled(CuTest* testCase) {
+    // Stages are ignored until the profiler is enabled
+    CuAssertTrue(testCase, !cactusProfiler_isEnabled());
+    cactusProfiler_startStage("ignored");
+    cactusProfiler_endStage();
+    cactusProfiler_writeJson("profilerTest.json");
+    CuAssertTrue(testCase, !stFile_exists("profilerTest.json"));
+}
+
+static void testCactusProfiler_nestedStages(CuTest* testCase) {
+    cactusProfiler_enable();
+    CuAssertTrue(testCase, cactusProfiler_isEnabled());
+    cactusProfiler_startStage("outer");
+    for (int64_t i = 0; i < 3; i++) {
+        cactusProfiler_startStage("inner %" PRIi64 "", i);
+        cactusProfiler_endStage();
+    }
+    cactusProfiler_endStage();
+    cactusProfiler_startStage("unfinished \"stage\"");
+    cactusProfiler_writeJson("profilerTest.json");
+
+    FILE *fileHandle = fopen("profilerTest.json", "r");
+    CuAssertTrue(testCase, fileHandle != NULL);
+    char *json = stFile_getLineFromFile(fileHandle);
+    CuAssertTrue(testCase, strstr(json, "\"stages\": [") != NULL);
+    free(json);
+    json = stFile_getLineFromFile(fileHandle);
+    CuAssertTrue(testCase, strstr(json, "\"name\": \"outer\", \"depth\": 0, \"parent\": -1") != NULL);
+    free(json);
+    for (int64_t i = 0; i < 3; i++) {
+        json = stFile_getLineFromFile(fileHandle);
+        char *expected = stString_print("\"name\": \"inner %" PRIi64 "\", \"depth\": 1, \"parent\": 0", i);
+        CuAssertTrue(testCase, strstr(json, expected) != NULL);
+        free(expected);
+        free(json);
+    }
+    json = stFile_getLineFromFile(fileHandle);
+    CuAssertTrue(testCase, strstr(json, "\"name\": \"unfinished \\\"stage\\\"\", \"depth\": 0") != NULL);
+    CuAssertTrue(testCase, strstr(json, "\"ended\": false") != NULL);
+    free(json);
+    fclose(fileHandle);
+
+    stFile_rmtree("profilerTest.json");
+    cactusProfiler_destruct();
+    CuAssertTrue(testCase, !cactusProfiler_isEnabled());
+}
+
+CuSuite* cactusProfilerTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testCactusProfiler_disabled);
+    SUITE_ADD_TEST(suite, testCactusProfiler_nestedStages);
+    return suite;
+}
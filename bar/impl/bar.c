@@ -49,119 +49,195 @@ bool blockFilterFn(stPinchBlock *pinchBlock, void *extraArg) {
     return !stCaf_containsRequiredSpecies(pinchBlock, f->flower, f->minimumIngroupDegree, f->minimumOutgroupDegree, f->minimumDegree, f->minimumNumberOfSpecies);
 }
 
-void bar(stList *flowers, CactusParams *params, CactusDisk *cactusDisk, stList *listOfEndAlignmentFiles) {
+struct _barParameters {
+    stList *listOfEndAlignmentFiles;
+    int64_t maximumLength;
+    int64_t usePoa;
+
+    // Pecan params
+    int64_t spanningTrees;
+    bool useProgressiveMerging;
+    float matchGamma;
+    PairwiseAlignmentParameters *pairwiseAlignmentParameters;
+    StateMachine *sM;
+    bool pruneOutStubAlignments;
+
+    // Poa params
+    int64_t poaWindow;
+    int64_t poaMinWindow;
+    int64_t poaMaxMemory;
+    bool poaParallelWindows;
+    int64_t maskFilter;
+    abpoa_para_t *poaParameters;
+
+    // Block filter params
+    int64_t minimumIngroupDegree;
+    int64_t minimumOutgroupDegree;
+    int64_t minimumDegree;
+    int64_t minimumNumberOfSpecies;
+};
+
+BarParameters *barParameters_construct(CactusParams *params, stList *listOfEndAlignmentFiles) {
     //////////////////////////////////////////////
     //Parse the many, many necessary parameters from the params file
     //////////////////////////////////////////////
 
-    int64_t maximumLength = cactusParams_get_int(params, 2, "bar", "bandingLimit");
-    int64_t usePoa = cactusParams_get_int(params, 2, "bar", "partialOrderAlignment");
+    BarParameters *b = st_calloc(1, sizeof(BarParameters));
+    b->listOfEndAlignmentFiles = listOfEndAlignmentFiles;
+    b->maximumLength = cactusParams_get_int(params, 2, "bar", "bandingLimit");
+    b->usePoa = cactusParams_get_int(params, 2, "bar", "partialOrderAlignment");
 
     // Pecan prams
-    int64_t spanningTrees = cactusParams_get_int(params, 3, "bar", "pecan", "spanningTrees");
-    bool useProgressiveMerging = cactusParams_get_int(params, 3, "bar", "pecan", "useProgressiveMerging");
-    float matchGamma = cactusParams_get_float(params, 3, "bar", "pecan", "matchGamma");
-    PairwiseAlignmentParameters *pairwiseAlignmentParameters = pairwiseAlignmentParameters_constructFromCactusParams(params);
-    StateMachine *sM = stateMachine5_construct(fiveState);
-    bool pruneOutStubAlignments = cactusParams_get_int(params, 3, "bar", "pecan", "pruneOutStubAlignments");
+    b->spanningTrees = cactusParams_get_int(params, 3, "bar", "pecan", "spanningTrees");
+    b->useProgressiveMerging = cactusParams_get_int(params, 3, "bar", "pecan", "useProgressiveMerging");
+    b->matchGamma = cactusParams_get_float(params, 3, "bar", "pecan", "matchGamma");
+    b->pairwiseAlignmentParameters = pairwiseAlignmentParameters_constructFromCactusParams(params);
+    b->sM = stateMachine5_construct(fiveState);
+    b->pruneOutStubAlignments = cactusParams_get_int(params, 3, "bar", "pecan", "pruneOutStubAlignments");
 
     // Poa params
     // toggle from pecan to abpoa for multiple alignment, by setting to non-zero
     // Note that poa uses about N^2 memory, so maximum value is generally in 10s of kb
-    int64_t poaWindow = cactusParams_get_int(params, 3, "bar", "poa", "partialOrderAlignmentWindow");
-    int64_t maskFilter = cactusParams_get_int(params, 3, "bar", "poa", "partialOrderAlignmentMaskFilter");
-    abpoa_para_t *poaParameters = usePoa ? abpoaParamaters_constructFromCactusParams(params) : NULL;
-
-    //////////////////////////////////////////////
-    //Run the bar algorithm
-    //////////////////////////////////////////////
+    b->poaWindow = cactusParams_get_int(params, 3, "bar", "poa", "partialOrderAlignmentWindow");
+    // choose the window for each set of sequences between these bounds, to align within the memory limit
+    b->poaMinWindow = cactusParams_get_int(params, 3, "bar", "poa", "partialOrderAlignmentMinWindow");
+    b->poaMaxMemory = cactusParams_get_int(params, 3, "bar", "poa", "partialOrderAlignmentMaxMemory");
+    // align the windows of long sequences concurrently, rather than one after another
+    b->poaParallelWindows = cactusParams_get_int(params, 3, "bar", "poa", "partialOrderAlignmentParallelWindows");
+    b->maskFilter = cactusParams_get_int(params, 3, "bar", "poa", "partialOrderAlignmentMaskFilter");
+    b->poaParameters = b->usePoa ? abpoaParamaters_constructFromCactusParams(params) : NULL;
+
+    // These are all variables used by the filter fns
+    b->minimumIngroupDegree = cactusParams_get_int(params, 2, "bar", "minimumIngroupDegree");
+    b->minimumOutgroupDegree = cactusParams_get_int(params, 2, "bar", "minimumOutgroupDegree");
+    b->minimumDegree = cactusParams_get_int(params, 2, "bar", "minimumBlockDegree");
+    b->minimumNumberOfSpecies = cactusParams_get_int(params, 2, "bar", "minimumNumberOfSpecies");
+    return b;
+}
 
-    if (listOfEndAlignmentFiles != NULL && stList_length(flowers) != 1) {
-        st_errAbort("We have precomputed alignments but %" PRIi64 " flowers to align.\n", stList_length(flowers));
+void barParameters_destruct(BarParameters *barParameters) {
+    pairwiseAlignmentBandingParameters_destruct(barParameters->pairwiseAlignmentParameters);
+    stateMachine_destruct(barParameters->sM);
+    if (barParameters->poaParameters) {
+        abpoa_free_para(barParameters->poaParameters);
     }
+    free(barParameters);
+}
+
+static int64_t activeFlowerNumber = 0; // The number of flowers being aligned by bar_alignFlower
 
+int64_t bar_getActiveFlowerNumber(void) {
+    int64_t n;
 #if defined(_OPENMP)
-#pragma omp parallel for schedule(dynamic, 1)
+#pragma omp atomic read
 #endif
-    for (int64_t j = 0; j<stList_length(flowers); j++) {
-        Flower *flower = stList_get(flowers, j);
-
-        // These are all variables used by the filter fns
-        FilterArgs *fa = st_calloc(1, sizeof(FilterArgs));
-        fa->minimumIngroupDegree = cactusParams_get_int(params, 2, "bar", "minimumIngroupDegree");
-        fa->minimumOutgroupDegree = cactusParams_get_int(params, 2, "bar", "minimumOutgroupDegree");
-        fa->minimumDegree = cactusParams_get_int(params, 2, "bar", "minimumBlockDegree");
-        fa->minimumNumberOfSpecies = cactusParams_get_int(params, 2, "bar", "minimumNumberOfSpecies");
-        fa->flower = flower;
-
-        void *alignments;
-        if (usePoa) {
-            /*
-             * This makes a consistent set of alignments using abPoa.
-             *
-             * It does not use any precomputed alignments, if they are provided they will be ignored
-             */
-            alignments = make_flower_alignment_poa(flower, maximumLength, poaWindow, maskFilter, poaParameters);
-            st_logDebug("Created the poa alignments: %" PRIi64 " poa alignment blocks for flower\n", stList_length(alignments));
-        } else {
-            alignments = makeFlowerAlignment3(sM, flower, listOfEndAlignmentFiles, spanningTrees, maximumLength,
-                                              useProgressiveMerging, matchGamma, pairwiseAlignmentParameters,
-                                              pruneOutStubAlignments);
-            st_logDebug("Created the alignment: %" PRIi64 " pairs for flower\n", stSortedSet_size(alignments));
-        }
-
-        stPinchIterator *pinchIterator = NULL;
-        if(usePoa) {
-            pinchIterator = stPinchIterator_constructFromAlignedBlocks(alignments);
-        }
-        else {
-            pinchIterator = stPinchIterator_constructFromAlignedPairs(alignments, getNextAlignedPairAlignment);
-        }
+    n = activeFlowerNumber;
+    return n;
+}
+
+void bar_alignFlower(Flower *flower, BarParameters *b) {
+#if defined(_OPENMP)
+#pragma omp atomic
+#endif
+    activeFlowerNumber++;
+
+    // These are all variables used by the filter fns
+    FilterArgs *fa = st_calloc(1, sizeof(FilterArgs));
+    fa->minimumIngroupDegree = b->minimumIngroupDegree;
+    fa->minimumOutgroupDegree = b->minimumOutgroupDegree;
+    fa->minimumDegree = b->minimumDegree;
+    fa->minimumNumberOfSpecies = b->minimumNumberOfSpecies;
+    fa->flower = flower;
+
+    void *alignments;
+    if (b->usePoa) {
         /*
-         * Run the cactus caf functions to build cactus.
+         * This makes a consistent set of alignments using abPoa.
+         *
+         * It does not use any precomputed alignments, if they are provided they will be ignored
          */
+        alignments = make_flower_alignment_poa(flower, b->maximumLength, b->poaWindow, b->poaMinWindow,
+                                               b->poaMaxMemory, b->poaParallelWindows, b->maskFilter,
+                                               b->poaParameters);
+        st_logDebug("Created the poa alignments: %" PRIi64 " poa alignment blocks for flower\n", stList_length(alignments));
+    } else {
+        alignments = makeFlowerAlignment3(b->sM, flower, b->listOfEndAlignmentFiles, b->spanningTrees, b->maximumLength,
+                                          b->useProgressiveMerging, b->matchGamma, b->pairwiseAlignmentParameters,
+                                          b->pruneOutStubAlignments);
+        st_logDebug("Created the alignment: %" PRIi64 " pairs for flower\n", stSortedSet_size(alignments));
+    }
 
-        stPinchThreadSet *threadSet = stCaf_setup(flower);
+    stPinchIterator *pinchIterator = NULL;
+    if(b->usePoa) {
+        pinchIterator = stPinchIterator_constructFromAlignedBlocks(alignments);
+    }
+    else {
+        pinchIterator = stPinchIterator_constructFromAlignedPairs(alignments, getNextAlignedPairAlignment);
+    }
+    /*
+     * Run the cactus caf functions to build cactus.
+     */
 
-        stCaf_anneal(threadSet, pinchIterator, NULL, flower);
+    stPinchThreadSet *threadSet = stCaf_setup(flower);
 
-        if (fa->minimumDegree < 2) {
-            stCaf_makeDegreeOneBlocks(threadSet);
-        }
+    stCaf_anneal(threadSet, pinchIterator, NULL, flower);
 
-        if (fa->minimumIngroupDegree > 0 || fa->minimumOutgroupDegree > 0 || fa->minimumDegree > 1) {
-            stCaf_melt(flower, threadSet, blockFilterFn, fa, 0, 0, 0, INT64_MAX);
-        }
+    if (fa->minimumDegree < 2) {
+        stCaf_makeDegreeOneBlocks(threadSet);
+    }
 
-        stCaf_finish(flower, threadSet, INT64_MAX, INT64_MAX); //Flower now destroyed.
+    if (fa->minimumIngroupDegree > 0 || fa->minimumOutgroupDegree > 0 || fa->minimumDegree > 1) {
+        stCaf_melt(flower, threadSet, blockFilterFn, fa, 0, 0, 0, INT64_MAX);
+    }
 
-        stPinchThreadSet_destruct(threadSet);
-        st_logDebug("Ran the cactus core script.\n");
+    stCaf_finish(flower, threadSet, INT64_MAX, INT64_MAX); //Flower now destroyed.
 
-        /*
-         * Cleanup
-         */
-        //Clean up the sorted set after cleaning up the iterator
-        stPinchIterator_destruct(pinchIterator);
-        if(usePoa) {
-            stList_destruct(alignments);
-        }
-        else {
-            stSortedSet_destruct(alignments);
-        }
-        free(fa);
-
-        st_logDebug("Finished filling in the alignments for the flower\n");
+    stPinchThreadSet_destruct(threadSet);
+    st_logDebug("Ran the cactus core script.\n");
+
+    /*
+     * Cleanup
+     */
+    //Clean up the sorted set after cleaning up the iterator
+    stPinchIterator_destruct(pinchIterator);
+    if(b->usePoa) {
+        stList_destruct(alignments);
+    }
+    else {
+        stSortedSet_destruct(alignments);
     }
+    free(fa);
+
+    st_logDebug("Finished filling in the alignments for the flower\n");
+
+#if defined(_OPENMP)
+#pragma omp atomic
+#endif
+    activeFlowerNumber--;
+}
+
+void bar(stList *flowers, CactusParams *params, CactusDisk *cactusDisk, stList *listOfEndAlignmentFiles) {
+    if (listOfEndAlignmentFiles != NULL && stList_length(flowers) != 1) {
+        st_errAbort("We have precomputed alignments but %" PRIi64 " flowers to align.\n", stList_length(flowers));
+    }
+
+    BarParameters *barParameters = barParameters_construct(params, listOfEndAlignmentFiles);
 
     //////////////////////////////////////////////
-    //Clean up
+    //Run the bar algorithm
     //////////////////////////////////////////////
 
-    pairwiseAlignmentBandingParameters_destruct(pairwiseAlignmentParameters);
-    stateMachine_destruct(sM);
-
-    if (poaParameters) {
-        abpoa_free_para(poaParameters);
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic, 1)
+#endif
+    for (int64_t j = 0; j<stList_length(flowers); j++) {
+        bar_alignFlower(stList_get(flowers, j), barParameters);
     }
+
+    //////////////////////////////////////////////
+    //Clean up
+    //////////////////////////////////////////////
+
+    msa_release_poa_contexts(); // So the memory of the abpoa alignments is not held for the rest of the run
+    barParameters_destruct(barParameters);
 }
@@ -10,6 +10,7 @@
 
 #include <stdio.h>
 #include <ctype.h>
+#include <math.h>
 
 // FOR DEBUGGING ONLY: Specify directory where abpoa inputs get dumped
 //#define CACTUS_ABPOA_MSA_DUMP_DIR "/home/hickey/dev/cactus/dump"
@@ -17,9 +18,30 @@
 //#define CACTUS_ABPOA_FROM_COMMAND_LINE
 
 // OpenMP
-//#if defined(_OPENMP)
-//#include <omp.h>
-//#endif
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+// The k-mer length, and the number and length of sequence prefixes compared, to estimate the divergence of a set of
+// sequences when choosing a poa window size
+#define POA_DIVERGENCE_KMER_LENGTH 12
+#define POA_DIVERGENCE_SAMPLE_SIZE 16
+#define POA_DIVERGENCE_SAMPLE_LENGTH 1000
+
+// The number of ends whose alignments are made at a time, deciding for each batch whether to spread it across threads
+#define POA_END_BATCH_SIZE 64
+
+/*
+ * Returns true if the ends of a flower should be aligned as tasks, which is the case when the threads of the enclosing
+ * parallel region outnumber the flowers being aligned, so that some of them are idle.
+ */
+static bool align_ends_in_parallel(void) {
+#if defined(_OPENMP)
+    return omp_in_parallel() && bar_getActiveFlowerNumber() < omp_get_num_threads();
+#else
+    return 0;
+#endif
+}
 
 abpoa_para_t *abpoaParamaters_constructFromCactusParams(CactusParams *params) {
     abpoa_para_t *abpt = abpoa_init_para();
@@ -111,6 +133,153 @@ static abpoa_para_t *copy_abpoa_params(abpoa_para_t *abpt) {
     return abpt_cpy;
 }
 
+static bool abpoa_params_equal(abpoa_para_t *abpt1, abpoa_para_t *abpt2) {
+    return abpt1->align_mode == abpt2->align_mode && abpt1->wb == abpt2->wb && abpt1->wf == abpt2->wf &&
+           abpt1->match == abpt2->match && abpt1->mismatch == abpt2->mismatch && abpt1->gap_mode == abpt2->gap_mode &&
+           abpt1->gap_open1 == abpt2->gap_open1 && abpt1->gap_ext1 == abpt2->gap_ext1 &&
+           abpt1->gap_open2 == abpt2->gap_open2 && abpt1->gap_ext2 == abpt2->gap_ext2 &&
+           abpt1->disable_seeding == abpt2->disable_seeding && abpt1->k == abpt2->k && abpt1->w == abpt2->w &&
+           abpt1->min_w == abpt2->min_w && abpt1->progressive_poa == abpt2->progressive_poa &&
+           abpt1->use_score_matrix == abpt2->use_score_matrix && abpt1->max_mat == abpt2->max_mat &&
+           abpt1->min_mis == abpt2->min_mis && abpt1->m == abpt2->m &&
+           memcmp(abpt1->mat, abpt2->mat, abpt1->m * abpt1->m * sizeof(int)) == 0;
+}
+
+/*
+ * The abpoa context, parameters and input buffers used by a thread to make partial order alignments, reused between
+ * windows and between flowers rather than rebuilt for each window. A thread's context lives until released by
+ * msa_release_poa_contexts or until the process exits.
+ */
+typedef struct _poaContext {
+    abpoa_t *ab;
+    abpoa_para_t *parameters; // A copy of the parameters the context was last used with
+    abpoa_para_t *working_parameters; // Reset from parameters before each alignment, as abpoa can write to them
+    int64_t row_no; // The number of rows allocated in the buffers below
+    int64_t *row_capacities; // The allocated length of each row of bseqs
+    uint8_t **bseqs; // The poa input
+    bool *empty_seqs; // The rows of the poa input phonied in for empty windows
+    int64_t *seq_offsets; // The sliding window's start, end and overlap with the previous window in each row
+    int64_t *window_ends;
+    int64_t *row_overlaps;
+    struct _poaContext *next; // The next context in poa_contexts
+} PoaContext;
+
+/*
+ * Every context made by any thread, so they can all be freed from one thread. Releasing them bumps
+ * poa_contexts_generation, which tells each thread its own poa_context pointer is stale.
+ */
+static PoaContext *poa_contexts = NULL;
+static int64_t poa_contexts_generation = 0;
+
+static PoaContext *poa_context = NULL;
+static int64_t poa_context_generation = 0; // The value of poa_contexts_generation when poa_context was made
+#if defined(_OPENMP)
+#pragma omp threadprivate(poa_context, poa_context_generation)
+#endif
+
+static void poa_context_destruct(PoaContext *context) {
+    abpoa_free(context->ab);
+    if (context->parameters != NULL) {
+        abpoa_free_para(context->parameters);
+        abpoa_free_para(context->working_parameters);
+    }
+    for (int64_t i = 0; i < context->row_no; ++i) {
+        free(context->bseqs[i]);
+    }
+    free(context->row_capacities);
+    free(context->bseqs);
+    free(context->empty_seqs);
+    free(context->seq_offsets);
+    free(context->window_ends);
+    free(context->row_overlaps);
+    free(context);
+}
+
+void msa_release_poa_contexts(void) {
+    while (poa_contexts != NULL) {
+        PoaContext *context = poa_contexts;
+        poa_contexts = context->next;
+        poa_context_destruct(context);
+    }
+    poa_contexts_generation++;
+}
+
+/*
+ * Gets the calling thread's context, with room for seq_no rows, set up with the given parameters.
+ */
+static PoaContext *get_poa_context(abpoa_para_t *poa_parameters, int64_t seq_no) {
+    if (poa_context == NULL || poa_context_generation != poa_contexts_generation) {
+        poa_context = st_calloc(1, sizeof(PoaContext));
+        poa_context->ab = abpoa_init();
+        static bool release_at_exit = 0;
+#if defined(_OPENMP)
+#pragma omp critical(poa_contexts)
+#endif
+        {
+            if (!release_at_exit) {
+                atexit(msa_release_poa_contexts);
+                release_at_exit = 1;
+            }
+            poa_context->next = poa_contexts;
+            poa_contexts = poa_context;
+            poa_context_generation = poa_contexts_generation;
+        }
+    }
+    PoaContext *context = poa_context;
+    if (context->parameters == NULL || !abpoa_params_equal(context->parameters, poa_parameters)) {
+        if (context->parameters != NULL) {
+            abpoa_free_para(context->parameters);
+            abpoa_free_para(context->working_parameters);
+        }
+        context->parameters = copy_abpoa_params(poa_parameters);
+        context->working_parameters = copy_abpoa_params(poa_parameters);
+    }
+    if (seq_no > context->row_no) {
+        context->row_capacities = st_realloc(context->row_capacities, sizeof(int64_t) * seq_no);
+        context->bseqs = st_realloc(context->bseqs, sizeof(uint8_t *) * seq_no);
+        for (int64_t i = context->row_no; i < seq_no; ++i) {
+            context->row_capacities[i] = 0;
+            context->bseqs[i] = NULL;
+        }
+        context->empty_seqs = st_realloc(context->empty_seqs, sizeof(bool) * seq_no);
+        context->seq_offsets = st_realloc(context->seq_offsets, sizeof(int64_t) * seq_no);
+        context->window_ends = st_realloc(context->window_ends, sizeof(int64_t) * seq_no);
+        context->row_overlaps = st_realloc(context->row_overlaps, sizeof(int64_t) * seq_no);
+        context->row_no = seq_no;
+    }
+    return context;
+}
+
+/*
+ * Makes sure each row of the context's poa input buffer has room for the window of its sequence from starts[i] to
+ * ends[i].
+ */
+static void reserve_poa_context_rows(PoaContext *context, int64_t *starts, int64_t *ends, int64_t seq_no) {
+    assert(seq_no <= context->row_no);
+    for (int64_t i = 0; i < seq_no; ++i) {
+        int64_t row_size = ends[i] - starts[i];
+        if (row_size < 1) {
+            row_size = 1; // Room for the N put in empty rows
+        }
+        if (row_size > context->row_capacities[i]) {
+            context->bseqs[i] = st_realloc(context->bseqs[i], sizeof(uint8_t) * row_size);
+            context->row_capacities[i] = row_size;
+        }
+    }
+}
+
+/*
+ * Returns the context's working parameters, reset to the parameters it was last used with.
+ */
+static abpoa_para_t *get_poa_context_parameters(PoaContext *context) {
+    abpoa_para_t *abpt = context->working_parameters;
+    int *mat = abpt->mat;
+    *abpt = *context->parameters;
+    abpt->mat = mat;
+    memcpy(abpt->mat, context->parameters->mat, context->parameters->m * context->parameters->m * sizeof(int));
+    return abpt;
+}
+
 // char <--> uint8_t conversion copied over from abPOA example
 // AaCcGgTtNn ==> 0,1,2,3,4
 static unsigned char nst_nt4_table[256] = {
@@ -281,6 +450,7 @@ void msa_destruct(Msa *msa) {
     free(msa->seqs);
     free(msa->msa_seq);
     free(msa->seq_lens);
+    free(msa->column_scores);
     free(msa);
 }
 
@@ -297,10 +467,17 @@ void msa_print(Msa *msa, FILE *f) {
 }
 
 /**
- * flip msa to its reverse complement (for trimming purposees)
+ * flip msa to its reverse complement (for trimming purposees), along with its column scores
  */
 static void flip_msa_seq(Msa* msa) {
     if (msa != NULL) {
+        if (msa->column_scores != NULL) {
+            for (int64_t j = 0, k = msa->column_no - 1; j < k; ++j, --k) {
+                float buf = msa->column_scores[j];
+                msa->column_scores[j] = msa->column_scores[k];
+                msa->column_scores[k] = buf;
+            }
+        }
         int64_t middle = msa->column_no / 2;
         bool odd = msa->column_no % 2 == 1;
         for (int64_t i = 0; i < msa->seq_no; ++i) {
@@ -434,7 +611,7 @@ static void trim(int64_t row1, Msa *msa1, float *column_scores1,
 }
 
 /**
- * recompute the seq_lens of a trimmed msa and clip off empty suffix columns
+ * recompute the seq_lens of a trimmed msa and clip off empty suffix columns, whose scores are zero
  * (todo: can this be built into trimming code?)
  */
 static void msa_fix_trimmed(Msa* msa) {
@@ -460,58 +637,303 @@ static void msa_fix_trimmed(Msa* msa) {
     msa->column_no -= empty_columns;
 }
 
-Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no, int64_t window_size,
-                                      abpoa_para_t *poa_parameters) {
+/*
+ * Fills kmers with the k-mers of the first length bases of seq that contain only ACGT, encoded two bits per base,
+ * and returns the number of them.
+ */
+static int64_t get_kmers(char *seq, int64_t length, uint32_t *kmers) {
+    int64_t kmer_no = 0, run_length = 0;
+    uint32_t kmer = 0, mask = (((uint32_t)1) << (2 * POA_DIVERGENCE_KMER_LENGTH)) - 1;
+    for (int64_t i = 0; i < length; ++i) {
+        unsigned char b = nst_nt4_table[(unsigned char)seq[i]];
+        if (b > 3) {
+            run_length = 0;
+            continue;
+        }
+        kmer = ((kmer << 2) | b) & mask;
+        if (++run_length >= POA_DIVERGENCE_KMER_LENGTH) {
+            kmers[kmer_no++] = kmer;
+        }
+    }
+    return kmer_no;
+}
 
-    assert(seq_no > 0);
+static int uint32_cmp(const void *a, const void *b) {
+    uint32_t i = *(const uint32_t *)a, j = *(const uint32_t *)b;
+    return i < j ? -1 : (i > j ? 1 : 0);
+}
 
-    // only one input sequence: no point sending into abpoa; just return it instead
-    // (note: current version of abpoa will crash in progressive mode on one sequence)
-    // todo: can we filter this out at higher level?
-    if (seq_no == 1) {
-        Msa *msa = st_malloc(sizeof(Msa));
-        msa->seq_no = seq_no;
-        msa->seqs = seqs;
-        msa->seq_lens = seq_lens;
-        msa->column_no = seq_lens[0];
-        msa->msa_seq = st_malloc(sizeof(uint8_t*));
-        msa->msa_seq[0] = st_malloc(msa->column_no * sizeof(uint8_t));
-        for (int64_t i = 0; i < msa->column_no; ++i) {
-            msa->msa_seq[0][i] = msa_to_byte(msa->seqs[0][i]);
+/*
+ * Estimates the fraction of bases of the sequences that differ from the longest of them, from the fraction of the
+ * k-mers of a sample of sequence prefixes found in the prefix of the longest sequence.
+ */
+static double estimate_divergence(char **seqs, int *seq_lens, int64_t seq_no) {
+    int64_t longest = 0;
+    for (int64_t i = 1; i < seq_no; ++i) {
+        if (seq_lens[i] > seq_lens[longest]) {
+            longest = i;
         }
-        return msa;
     }
-    
-    // we overlap the sliding window, and use the trimming logic to find the best cut point between consecutive windows
-    // todo: cli-facing parameter
-    float window_overlap_frac = 0.5;
-    int64_t window_overlap_size = window_overlap_frac * window_size;
-    if (window_overlap_size > 0) {
-        --window_overlap_size; // don't want empty window when fully trimmed on each end
+    uint32_t *kmers = st_malloc(sizeof(uint32_t) * POA_DIVERGENCE_SAMPLE_LENGTH);
+    uint32_t *longest_kmers = st_malloc(sizeof(uint32_t) * POA_DIVERGENCE_SAMPLE_LENGTH);
+    int64_t longest_kmer_no = get_kmers(seqs[longest], seq_lens[longest] < POA_DIVERGENCE_SAMPLE_LENGTH ?
+                                                       seq_lens[longest] : POA_DIVERGENCE_SAMPLE_LENGTH, longest_kmers);
+    qsort(longest_kmers, longest_kmer_no, sizeof(uint32_t), uint32_cmp);
+
+    // compare an evenly spaced sample of the other sequences
+    int64_t kmer_no = 0, shared_kmer_no = 0;
+    int64_t step = (seq_no + POA_DIVERGENCE_SAMPLE_SIZE - 1) / POA_DIVERGENCE_SAMPLE_SIZE;
+    for (int64_t i = 0; i < seq_no && longest_kmer_no > 0; i += step) {
+        if (i == longest) {
+            continue;
+        }
+        int64_t n = get_kmers(seqs[i], seq_lens[i] < POA_DIVERGENCE_SAMPLE_LENGTH ?
+                                       seq_lens[i] : POA_DIVERGENCE_SAMPLE_LENGTH, kmers);
+        for (int64_t j = 0; j < n; ++j) {
+            if (bsearch(&kmers[j], longest_kmers, longest_kmer_no, sizeof(uint32_t), uint32_cmp) != NULL) {
+                ++shared_kmer_no;
+            }
+        }
+        kmer_no += n;
+    }
+    free(kmers);
+    free(longest_kmers);
+
+    if (kmer_no == 0) {
+        return 0.0; // too short to tell, and too short for the window size to matter
+    }
+    // a k-mer is shared if none of its bases differ
+    return 1.0 - pow((double)shared_kmer_no / kmer_no, 1.0 / POA_DIVERGENCE_KMER_LENGTH);
+}
+
+/*
+ * Estimates the memory abpoa uses to align seq_no sequences in windows of window_size, where divergence is the
+ * fraction of the bases of each sequence that add new nodes to the poa graph.
+ */
+static int64_t estimate_poa_memory(int64_t window_size, int64_t seq_no, double divergence,
+                                   abpoa_para_t *poa_parameters) {
+    // the graph has a node for each base of the first sequence, plus one for each divergent base of the others
+    double node_no = window_size * (1.0 + divergence * (seq_no - 1));
+    // abpoa allocates each node a dp row of the full query length for each score matrix, whatever the band, so
+    // memory is quadratic in the window
+    int64_t matrix_no = poa_parameters->gap_mode == ABPOA_LINEAR_GAP ? 1 :
+                        (poa_parameters->gap_mode == ABPOA_AFFINE_GAP ? 3 : 5);
+    double dp_memory = node_no * (window_size + 1) * matrix_no * sizeof(int32_t);
+    // plus the query profile, a row of scores for each letter of the alphabet
+    double query_profile_memory = (double)poa_parameters->m * (window_size + 1) * sizeof(int32_t);
+    return (int64_t)(dp_memory + query_profile_memory) + seq_no * window_size;
+}
+
+int64_t msa_get_window_size(char **seqs, int *seq_lens, int64_t seq_no, int64_t window_size, int64_t min_window_size,
+                            int64_t max_window_memory, abpoa_para_t *poa_parameters) {
+    if (min_window_size <= 0 || min_window_size >= window_size || max_window_memory <= 0 || seq_no < 2) {
+        return window_size;
+    }
+    // no window need be longer than the longest sequence
+    int64_t max_length = 0, total_length = 0;
+    for (int64_t i = 0; i < seq_no; ++i) {
+        max_length = seq_lens[i] > max_length ? seq_lens[i] : max_length;
+        total_length += seq_lens[i];
+    }
+    if (max_length <= min_window_size) {
+        return min_window_size;
+    }
+    int64_t upper = max_length < window_size ? max_length : window_size;
+
+    // bases of the longest sequence that the others have no counterpart for are divergent too
+    double divergence = estimate_divergence(seqs, seq_lens, seq_no);
+    double length_spread = 1.0 - (double)total_length / (seq_no * max_length);
+    divergence = divergence + (1.0 - divergence) * length_spread;
+
+    // find the largest window within the bounds whose alignment fits within the memory cap
+    if (estimate_poa_memory(upper, seq_no, divergence, poa_parameters) <= max_window_memory) {
+        return upper;
+    }
+    int64_t lower = min_window_size;
+    while (lower < upper) {
+        int64_t mid = lower + (upper - lower + 1) / 2;
+        if (estimate_poa_memory(mid, seq_no, divergence, poa_parameters) <= max_window_memory) {
+            lower = mid;
+        } else {
+            upper = mid - 1;
+        }
+    }
+    return lower;
+}
+
+/**
+ * Aligns the window of each sequence from starts[i] to ends[i] with abpoa, using the calling thread's context.
+ * The returned msa's seqs is NULL.
+ */
+static Msa *align_window(char **seqs, int64_t seq_no, int64_t *starts, int64_t *ends, abpoa_para_t *poa_parameters) {
+    PoaContext *context = get_poa_context(poa_parameters, seq_no);
+    reserve_poa_context_rows(context, starts, ends, seq_no);
+    uint8_t **bseqs = context->bseqs;
+    bool *empty_seqs = context->empty_seqs;
+
+    // Make Msa object
+    Msa *msa = st_malloc(sizeof(Msa));
+    msa->seq_no = seq_no;
+    msa->seqs = NULL;
+    msa->seq_lens = st_malloc(sizeof(int) * msa->seq_no);
+    msa->column_scores = NULL;
+
+    // load the window of each sequence into the input matrix for poa
+    for (int64_t i = 0; i < msa->seq_no; ++i) {
+        msa->seq_lens[i] = 0;
+        for (int64_t j = starts[i]; j < ends[i]; ++j, ++msa->seq_lens[i]) {
+            // todo: support iupac characters?
+            bseqs[i][msa->seq_lens[i]] = msa_to_byte(seqs[i][j]);
+        }
+    }
+
+    // poa can't handle empty sequences.  this is a hack to get around that
+    int emptyCount = 0;
+    for (int64_t i = 0; i < msa->seq_no; ++i) {
+        if (msa->seq_lens[i] == 0) {
+            empty_seqs[i] = true;
+            msa->seq_lens[i] = 1;
+            bseqs[i][0] = msa_to_byte('N');
+            ++emptyCount;
+        } else {
+            empty_seqs[i] = false;
+        }
+    }
+
+    // reuse the thread's abpoa context, which abpoa_msa resets
+    abpoa_t *ab = context->ab;
+    abpoa_para_t *abpt = get_poa_context_parameters(context);
+
+#ifdef CACTUS_ABPOA_MSA_DUMP_DIR
+    // dump the input to file
+    char abpoa_input_path[1024], abpoa_matrix_path[1024], abpoa_command_path[1024], abpoa_output_path[1024];
+    sprintf(abpoa_input_path, "%s/ap_in_%ld.fa", CACTUS_ABPOA_MSA_DUMP_DIR, (int64_t)msa);
+    sprintf(abpoa_matrix_path, "%s.mat", abpoa_input_path);
+    sprintf(abpoa_command_path, "%s.cmd", abpoa_input_path);
+    sprintf(abpoa_output_path, "%s.out", abpoa_input_path);
+    char* abpoa_command_line = dump_abpoa_input(msa, abpt, bseqs,
+                                                abpoa_input_path, abpoa_matrix_path, abpoa_command_path, abpoa_output_path);
+#endif
+
+#ifdef CACTUS_ABPOA_FROM_COMMAND_LINE
+    // run abpoa from the command line
+    abpoa_msa_from_command_line(abpoa_command_line, abpoa_output_path, &(msa->msa_seq), &(msa->column_no));
+
+    int test_cols = 0;
+    uint8_t** test_msa = NULL;
+    abpoa_msa(ab, abpt, msa->seq_no, NULL, msa->seq_lens, bseqs, NULL, NULL);
+    // abpoa's interface has changed a bit -- instead of passing in pointers to the results, they
+    // end up in the ab->abc struct -- we extract them here
+    test_msa = ab->abc->msa_base;
+    ab->abc->msa_base = NULL;
+    test_cols = ab->abc->msa_len;
+
+    // sanity check to make sure we get the same output
+    assert(msa->column_no == test_cols);
+    for (int i = 0; i < msa->seq_no; ++i) {
+      for (int j = 0; j < test_cols; ++j) {
+          //todo: not sure why this doesn't work anymore !!!!
+          //assert(test_msa[i][j] == msa->msa_seq[i][j]);
+      }
+      free(test_msa[i]);
+    }
+    free(test_msa);
+#else
+    // perform abpoa-msa
+    abpoa_msa(ab, abpt, msa->seq_no, NULL, msa->seq_lens, bseqs, NULL, NULL);
+    // abpoa's interface has changed a bit -- instead of passing in pointers to the results, they
+    // end up in the ab->abc struct -- we extract them here
+    msa->msa_seq = ab->abc->msa_base;
+    ab->abc->msa_base = NULL;
+    msa->column_no = ab->abc->msa_len;
+#endif
+
+#ifdef CACTUS_ABPOA_MSA_DUMP_DIR
+    // we got this far without crashing, so delete the dumped file (they can really pile up otherwise)
+    remove(abpoa_input_path);
+    remove(abpoa_matrix_path);
+    remove(abpoa_command_path);
+    remove(abpoa_output_path);
+    free(abpoa_command_line);
+#endif
+
+    // mask out empty sequences that were phonied in as Ns above
+    for (int64_t i = 0; i < msa->seq_no && emptyCount > 0; ++i) {
+        if (empty_seqs[i] == true) {
+            for (int j = 0; j < msa->column_no; ++j) {
+                if (msa_to_base(msa->msa_seq[i][j]) != '-') {
+                    assert(msa_to_base(msa->msa_seq[i][j]) == 'N');
+                    msa->msa_seq[i][j] = msa_to_byte('-');
+                    --msa->seq_lens[i];
+                    assert(msa->seq_lens[i] == 0);
+                    --emptyCount;
+                    break;
+                }
+            }
+        }
+    }
+    assert(emptyCount == 0);
+
+    for (int64_t i = 0; i < msa->seq_no; ++i) {
+        //////////////////////////////////////////////////////////////////////////////////////
+        // todo: why is this hack necessary?  using it in order for trim to work properly   //
+        // after abpoa switched to weirdo 256-bit values  (nst_nt256_table)                //
+        for (int64_t j = 0; j < msa->column_no; ++j) {
+            msa->msa_seq[i][j] = msa_to_byte(msa_to_base(msa->msa_seq[i][j]));
+        }
     }
+
+    // score the columns once, to be updated as the window is trimmed
+    msa->column_scores = make_column_scores(msa);
+    return msa;
+}
+
+/**
+ * Makes an msa consistent with the msa of the previous window, where row_overlaps gives the number of bases of each
+ * row shared by the end of the previous window and the start of this one.
+ */
+static void trim_window_overlaps(Msa *prev_msa, Msa *msa, int64_t *row_overlaps) {
+    // trim() presently assumes we're looking at reverse-complement sequence:
+    flip_msa_seq(msa);
+
+    // trim with the previous alignment, using the column scores kept with each window
+    for (int64_t i = 0; i < msa->seq_no; ++i) {
+        int64_t overlap = msa->seq_lens[i] < row_overlaps[i] ? msa->seq_lens[i] : row_overlaps[i];
+        if (overlap > 0) {
+            trim(i, msa, msa->column_scores, i, prev_msa, prev_msa->column_scores, overlap);
+        }
+    }
+    // todo: can this be done as part of trim?
+    msa_fix_trimmed(msa);
+    msa_fix_trimmed(prev_msa);
+    // flip our msa back to its original strand
+    flip_msa_seq(msa);
+}
+
+/**
+ * Aligns the windows in a sliding window, each window starting where the alignment of the previous one left off,
+ * less the overlap, and adds them to msa_windows.
+ */
+static void align_sliding_windows(char **seqs, int *seq_lens, int64_t seq_no, int64_t window_size,
+                                  int64_t window_overlap_size, abpoa_para_t *poa_parameters, stList *msa_windows) {
+    // get this thread's scratch space
+    PoaContext *context = get_poa_context(poa_parameters, seq_no);
     // keep track of what's left to align for the sliding window
     int64_t bases_remaining = 0;
     // keep track of current offsets
-    int64_t* seq_offsets = (int64_t*)st_calloc(seq_no, sizeof(int64_t));
-    // keep track of empty chunks
-    bool* empty_seqs = (bool*)st_calloc(seq_no, sizeof(bool));
+    int64_t* seq_offsets = context->seq_offsets;
+    int64_t* window_ends = context->window_ends;
     // keep track of overlaps
-    int64_t* row_overlaps = (int64_t*)st_calloc(seq_no, sizeof(int64_t));
-
-    // allocate the poa input buffer
-    uint8_t **bseqs = (uint8_t**)st_malloc(sizeof(uint8_t*) * seq_no);
+    int64_t* row_overlaps = context->row_overlaps;
     for (int64_t i = 0; i < seq_no; ++i) {
-        int64_t row_size = seq_lens[i] < window_size ? seq_lens[i] : window_size;
-        bseqs[i] = (uint8_t*)st_malloc(sizeof(uint8_t) * row_size);
+        seq_offsets[i] = 0;
+        row_overlaps[i] = 0;
         bases_remaining += seq_lens[i];
     }
-     
-    // collect our windowed outputs here, to be stiched at the end. 
-    stList* msa_windows = stList_construct3(0, (void(*)(void *)) msa_destruct);
-    
+
     // remember the previous window
     Msa* prev_msa = NULL;
-    
+
     int64_t prev_bases_remaining = bases_remaining;
     for (int64_t iteration = 0; bases_remaining > 0; ++iteration) {
 
@@ -533,166 +955,180 @@ Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no
             }
         }
 
-        // Make Msa object
-        Msa *msa = st_malloc(sizeof(Msa));
-        msa->seq_no = seq_no;
-        msa->seqs = NULL;
-        msa->seq_lens = st_malloc(sizeof(int) * msa->seq_no);
-        
-        // load up to window_size of each sequence into the input matrix for poa
-        for (int64_t i = 0; i < msa->seq_no; ++i) {
-            msa->seq_lens[i] = 0;
-            for (int64_t j = seq_offsets[i]; j < seq_lens[i] && msa->seq_lens[i] < window_size; ++j, ++msa->seq_lens[i]) {
-                // todo: support iupac characters?
-                bseqs[i][msa->seq_lens[i]] = msa_to_byte(seqs[i][j]);
-            }
-        }
-
-        // poa can't handle empty sequences.  this is a hack to get around that
-        int emptyCount = 0;
-        for (int64_t i = 0; i < msa->seq_no; ++i) {
-            if (msa->seq_lens[i] == 0) {
-                empty_seqs[i] = true;
-                msa->seq_lens[i] = 1;
-                bseqs[i][0] = msa_to_byte('N');
-                ++emptyCount;
-            } else {
-                empty_seqs[i] = false;
-            }
-        }
-
-        // init abpoa
-        abpoa_t *ab = abpoa_init();
-        abpoa_para_t *abpt = copy_abpoa_params(poa_parameters);
-        
-#ifdef CACTUS_ABPOA_MSA_DUMP_DIR
-        // dump the input to file
-        char abpoa_input_path[1024], abpoa_matrix_path[1024], abpoa_command_path[1024], abpoa_output_path[1024];
-        sprintf(abpoa_input_path, "%s/ap_in_%ld.fa", CACTUS_ABPOA_MSA_DUMP_DIR, (int64_t)msa);
-        sprintf(abpoa_matrix_path, "%s.mat", abpoa_input_path);
-        sprintf(abpoa_command_path, "%s.cmd", abpoa_input_path);
-        sprintf(abpoa_output_path, "%s.out", abpoa_input_path);
-        char* abpoa_command_line = dump_abpoa_input(msa, abpt, bseqs,
-                                                    abpoa_input_path, abpoa_matrix_path, abpoa_command_path, abpoa_output_path);
-#endif
-
-#ifdef CACTUS_ABPOA_FROM_COMMAND_LINE
-        // run abpoa from the command line
-        abpoa_msa_from_command_line(abpoa_command_line, abpoa_output_path, &(msa->msa_seq), &(msa->column_no));
-
-        int test_cols = 0;
-        uint8_t** test_msa = NULL;
-        abpoa_msa(ab, abpt, msa->seq_no, NULL, msa->seq_lens, bseqs, NULL, NULL);
-        // abpoa's interface has changed a bit -- instead of passing in pointers to the results, they
-        // end up in the ab->abc struct -- we extract them here
-        test_msa = ab->abc->msa_base;
-        ab->abc->msa_base = NULL;
-        test_cols = ab->abc->msa_len;
-
-        // sanity check to make sure we get the same output
-        assert(msa->column_no == test_cols);        
-        for (int i = 0; i < msa->seq_no; ++i) {
-          for (int j = 0; j < test_cols; ++j) {
-              //todo: not sure why this doesn't work anymore !!!!
-              //assert(test_msa[i][j] == msa->msa_seq[i][j]);
-          }
-          free(test_msa[i]);
+        // align up to window_size of each sequence
+        for (int64_t i = 0; i < seq_no; ++i) {
+            window_ends[i] = seq_offsets[i] + window_size < seq_lens[i] ? seq_offsets[i] + window_size : seq_lens[i];
         }
-        free(test_msa);
-#else
-        // perform abpoa-msa
-        abpoa_msa(ab, abpt, msa->seq_no, NULL, msa->seq_lens, bseqs, NULL, NULL);
-        // abpoa's interface has changed a bit -- instead of passing in pointers to the results, they
-        // end up in the ab->abc struct -- we extract them here
-        msa->msa_seq = ab->abc->msa_base;
-        ab->abc->msa_base = NULL;
-        msa->column_no = ab->abc->msa_len;
-#endif
-
-#ifdef CACTUS_ABPOA_MSA_DUMP_DIR
-        // we got this far without crashing, so delete the dumped file (they can really pile up otherwise)
-        remove(abpoa_input_path);
-        remove(abpoa_matrix_path);
-        remove(abpoa_command_path);
-        remove(abpoa_output_path);
-        free(abpoa_command_line);
-#endif
+        Msa *msa = align_window(seqs, seq_no, seq_offsets, window_ends, poa_parameters);
 
-        // free abpoa
-        abpoa_free(ab);
-        abpoa_free_para(abpt);
-
-        // mask out empty sequences that were phonied in as Ns above
-        for (int64_t i = 0; i < msa->seq_no && emptyCount > 0; ++i) {
-            if (empty_seqs[i] == true) {
-                for (int j = 0; j < msa->column_no; ++j) {
-                    if (msa_to_base(msa->msa_seq[i][j]) != '-') {
-                        assert(msa_to_base(msa->msa_seq[i][j]) == 'N');
-                        msa->msa_seq[i][j] = msa_to_byte('-');
-                        --msa->seq_lens[i];
-                        assert(msa->seq_lens[i] == 0);
-                        --emptyCount;
-                        break;
-                    }
-                }
-            }
-        }
-        assert(emptyCount == 0);
-
-        //if (prev_msa) {
-        //    fprintf(stderr, "PREV MSA\n");
-        //    msa_print(prev_msa, stderr);
-        //}
-        //fprintf(stderr, "CUR MSA\n");
-        //msa_print(msa, stderr);
         // remember how much we aligned this round
         for (int64_t i = 0; i < msa->seq_no; ++i) {
-            //////////////////////////////////////////////////////////////////////////////////////
-            // todo: why is this hack necessary?  using it in order for trim to work properly   //
-            // after abpoa switched to weirdo 256-bit values  (nst_nt256_table)                //
-            for (int64_t j = 0; j < msa->column_no; ++j) {
-                msa->msa_seq[i][j] = msa_to_byte(msa_to_base(msa->msa_seq[i][j]));
-            }
             bases_remaining -= msa->seq_lens[i];
             seq_offsets[i] += msa->seq_lens[i];
         }
 
-        // todo: there is obviously room for optimization here, as we compute full scores twice for each msa
-        //       in addition to flipping the prev_msa back and forth
-        //       (not sure if this is at all noticeable on top of abpoa running time though)
         if (prev_msa) {
-            // trim() presently assumes we're looking at reverse-complement sequence:
-            flip_msa_seq(msa);
-            float* prev_column_scores = make_column_scores(prev_msa);
-            float* column_scores = make_column_scores(msa);
-
-            // trim with the previous alignment
-            for (int64_t i = 0; i < msa->seq_no; ++i) {
-                int64_t overlap = msa->seq_lens[i] < row_overlaps[i] ? msa->seq_lens[i] : row_overlaps[i];
-                if (overlap > 0) {
-                    trim(i, msa, column_scores, i, prev_msa, prev_column_scores, overlap);
-                }
-            }
-            // todo: can this be done as part of trim?
-            msa_fix_trimmed(msa);
-            msa_fix_trimmed(prev_msa);            
-            // flip our msa back to its original strand
-            flip_msa_seq(msa);
-
-            free(prev_column_scores);
-            free(column_scores);
+            trim_window_overlaps(prev_msa, msa, row_overlaps);
         }
 
         // add the msa to our list
         stList_append(msa_windows, msa);
-        
-        // sanity check        
+
+        // sanity check
         assert(prev_bases_remaining > bases_remaining && bases_remaining >= 0);
 
         prev_msa = msa;
-        
+
         //used only for sanity check
-        prev_bases_remaining = bases_remaining; 
+        prev_bases_remaining = bases_remaining;
+    }
+}
+
+static void align_windows(char **seqs, int64_t seq_no, int64_t window_no, int64_t *starts, int64_t *ends,
+                          abpoa_para_t *poa_parameters, Msa **windows) {
+#if defined(_OPENMP)
+#pragma omp taskloop grainsize(1)
+#endif
+    for (int64_t k = 0; k < window_no; ++k) {
+        windows[k] = align_window(seqs, seq_no, starts + k * seq_no, ends + k * seq_no, poa_parameters);
+    }
+}
+
+/**
+ * Aligns the windows concurrently, rather than each waiting for the alignment of the previous one. The windows of
+ * each sequence are seeded at the same relative positions along the sequences, overlapping by about
+ * window_overlap_size, and the overlaps are then trimmed as for the sliding window, in order. The msas are added to
+ * msa_windows.
+ */
+static void align_windows_in_parallel(char **seqs, int *seq_lens, int64_t seq_no, int64_t window_size,
+                                      int64_t window_overlap_size, abpoa_para_t *poa_parameters, stList *msa_windows) {
+    int64_t max_length = 1;
+    for (int64_t i = 0; i < seq_no; ++i) {
+        max_length = seq_lens[i] > max_length ? seq_lens[i] : max_length;
+    }
+    int64_t stride = window_size - window_overlap_size;
+    assert(stride > 0);
+    int64_t window_no = max_length <= window_size ? 1 : (max_length - window_size + stride - 1) / stride + 1;
+
+    // Seed the windows. The window of the longest sequence is slid by stride, and those of the other sequences
+    // by the same fraction of their length. Each window overlaps the next, and the overlaps of a window with the
+    // previous and next windows are kept apart, so that trimming one does not affect the other.
+    int64_t *starts = st_malloc(sizeof(int64_t) * window_no * seq_no);
+    int64_t *ends = st_malloc(sizeof(int64_t) * window_no * seq_no);
+    for (int64_t i = 0; i < seq_no; ++i) {
+        int64_t length = seq_lens[i];
+        for (int64_t k = 0; k < window_no; ++k) {
+            int64_t start = k * stride * length / max_length;
+            if (k >= 2 && start < ends[(k - 2) * seq_no + i]) {
+                start = ends[(k - 2) * seq_no + i];
+            }
+            int64_t end = ((k * stride + window_size) * length + max_length - 1) / max_length;
+            if (k + 1 < window_no && end > start + window_size) {
+                end = start + window_size;
+            }
+            if (k > 0 && end < ends[(k - 1) * seq_no + i]) {
+                end = ends[(k - 1) * seq_no + i];
+            }
+            if (k + 1 == window_no || end > length) {
+                end = length;
+            }
+            assert(k == 0 || (start >= starts[(k - 1) * seq_no + i] && start <= ends[(k - 1) * seq_no + i]));
+            starts[k * seq_no + i] = start;
+            ends[k * seq_no + i] = end;
+        }
+    }
+
+    // Align the windows as tasks, starting a parallel region if not already in one
+    Msa **windows = st_malloc(sizeof(Msa *) * window_no);
+#if defined(_OPENMP)
+    if (!omp_in_parallel()) {
+#pragma omp parallel
+#pragma omp single
+        align_windows(seqs, seq_no, window_no, starts, ends, poa_parameters, windows);
+    } else
+#endif
+    {
+        align_windows(seqs, seq_no, window_no, starts, ends, poa_parameters, windows);
+    }
+
+    // Trim the overlaps between consecutive windows
+    int64_t *row_overlaps = st_malloc(sizeof(int64_t) * seq_no);
+    for (int64_t k = 0; k < window_no; ++k) {
+        if (k > 0) {
+            for (int64_t i = 0; i < seq_no; ++i) {
+                int64_t overlap = ends[(k - 1) * seq_no + i] - starts[k * seq_no + i];
+                assert(overlap <= windows[k - 1]->seq_lens[i]);
+                row_overlaps[i] = overlap > 0 ? overlap : 0;
+            }
+            trim_window_overlaps(windows[k - 1], windows[k], row_overlaps);
+        }
+        stList_append(msa_windows, windows[k]);
+    }
+
+    free(row_overlaps);
+    free(windows);
+    free(starts);
+    free(ends);
+}
+
+/*
+ * The windows of align_windows_in_parallel are seeded at the same fraction of each sequence's length, which puts a
+ * sequence's window within the difference between the longest and shortest sequence of where it should be. The
+ * windows are therefore only aligned in parallel when that is no more than the overlap between consecutive windows,
+ * so that an indel much larger than that, as left by a large insertion in some of the sequences, does not misplace
+ * the windows.
+ */
+static bool can_align_windows_in_parallel(int *seq_lens, int64_t seq_no, int64_t window_overlap_size) {
+    int64_t min_length = seq_lens[0], max_length = seq_lens[0];
+    for (int64_t i = 1; i < seq_no; ++i) {
+        min_length = seq_lens[i] < min_length ? seq_lens[i] : min_length;
+        max_length = seq_lens[i] > max_length ? seq_lens[i] : max_length;
+    }
+    return max_length - min_length <= window_overlap_size;
+}
+
+Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no, int64_t window_size,
+                                      int64_t min_window_size, int64_t max_window_memory, bool parallel_windows,
+                                      abpoa_para_t *poa_parameters) {
+
+    assert(seq_no > 0);
+
+    // only one input sequence: no point sending into abpoa; just return it instead
+    // (note: current version of abpoa will crash in progressive mode on one sequence)
+    // todo: can we filter this out at higher level?
+    if (seq_no == 1) {
+        Msa *msa = st_malloc(sizeof(Msa));
+        msa->seq_no = seq_no;
+        msa->seqs = seqs;
+        msa->seq_lens = seq_lens;
+        msa->column_scores = NULL;
+        msa->column_no = seq_lens[0];
+        msa->msa_seq = st_malloc(sizeof(uint8_t*));
+        msa->msa_seq[0] = st_malloc(msa->column_no * sizeof(uint8_t));
+        for (int64_t i = 0; i < msa->column_no; ++i) {
+            msa->msa_seq[0][i] = msa_to_byte(msa->seqs[0][i]);
+        }
+        return msa;
+    }
+    
+    // choose the window size for these sequences
+    window_size = msa_get_window_size(seqs, seq_lens, seq_no, window_size, min_window_size, max_window_memory,
+                                      poa_parameters);
+
+    // we overlap the sliding window, and use the trimming logic to find the best cut point between consecutive windows
+    // todo: cli-facing parameter
+    float window_overlap_frac = 0.5;
+    int64_t window_overlap_size = window_overlap_frac * window_size;
+    if (window_overlap_size > 0) {
+        --window_overlap_size; // don't want empty window when fully trimmed on each end
+    }
+
+    // collect our windowed outputs here, to be stiched at the end. 
+    stList* msa_windows = stList_construct3(0, (void(*)(void *)) msa_destruct);
+    if (parallel_windows && can_align_windows_in_parallel(seq_lens, seq_no, window_overlap_size)) {
+        align_windows_in_parallel(seqs, seq_lens, seq_no, window_size, window_overlap_size, poa_parameters, msa_windows);
+    } else {
+        align_sliding_windows(seqs, seq_lens, seq_no, window_size, window_overlap_size, poa_parameters, msa_windows);
     }
 
     int64_t num_windows = stList_length(msa_windows);
@@ -704,7 +1140,7 @@ Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no
         free(output_msa->seq_lens); // cleanup old memory
         output_msa->seq_lens = seq_lens;
     } else {
-        // otherwise, we stitch all the window msas into a new output msa
+        // otherwise, we stitch all the window msas into a new output msa, allocated up front
         output_msa = st_malloc(sizeof(Msa));
         assert(seq_no > 0);
         output_msa->seq_no = seq_no;
@@ -718,26 +1154,22 @@ Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no
         output_msa->msa_seq = st_malloc(sizeof(uint8_t *) * output_msa->seq_no);
         for (int64_t i = 0; i < output_msa->seq_no; ++i) {
             output_msa->msa_seq[i] = st_malloc(sizeof(uint8_t) * output_msa->column_no);
-            int64_t offset = 0;
-            for (int64_t j = 0; j < num_windows; ++j) {
-                Msa* msa_j = stList_get(msa_windows, j);
-                uint8_t* window_row = msa_j->msa_seq[i];
-                for (int64_t k = 0; k < msa_j->column_no; ++k) {
-                    output_msa->msa_seq[i][offset++] = window_row[k];
-                }
+        }
+        // the window column scores are already up to date with the trimming, so are stitched too
+        output_msa->column_scores = st_malloc(sizeof(float) * output_msa->column_no);
+        int64_t offset = 0;
+        for (int64_t j = 0; j < num_windows; ++j) {
+            Msa* msa_j = stList_get(msa_windows, j);
+            for (int64_t i = 0; i < output_msa->seq_no; ++i) {
+                memcpy(output_msa->msa_seq[i] + offset, msa_j->msa_seq[i], sizeof(uint8_t) * msa_j->column_no);
             }
-            assert(offset == output_msa->column_no);
+            memcpy(output_msa->column_scores + offset, msa_j->column_scores, sizeof(float) * msa_j->column_no);
+            offset += msa_j->column_no;
         }
-    } 
+        assert(offset == output_msa->column_no);
+    }
 
     // Clean up
-    for (int64_t i = 0; i < seq_no; ++i) {
-        free(bseqs[i]);
-    }
-    free(bseqs);
-    free(seq_offsets);
-    free(empty_seqs);
-    free(row_overlaps);
     stList_destruct(msa_windows);
 
     return output_msa;
@@ -745,17 +1177,27 @@ Msa *msa_make_partial_order_alignment(char **seqs, int *seq_lens, int64_t seq_no
 
 Msa **make_consistent_partial_order_alignments(int64_t end_no, int64_t *end_lengths, char ***end_strings,
         int **end_string_lengths, int64_t **right_end_indexes, int64_t **right_end_row_indexes, int64_t **overlaps,
-        int64_t window_size, abpoa_para_t *poa_parameters) {
+        int64_t window_size, int64_t min_window_size, int64_t max_window_memory, bool parallel_windows,
+        abpoa_para_t *poa_parameters) {
     // Calculate the initial, potentially inconsistent msas and column scores for each msa
-    float *column_scores[end_no];
+    // Each msa is independent of the others, so they are made as tasks when there are idle threads, giving the same
+    // result as making them in order
     Msa **msas = st_malloc(sizeof(Msa *) * end_no);
-//#if defined(_OPENMP)
-//#pragma omp parallel for schedule(dynamic)
-//#endif
-    for(int64_t i=0; i<end_no; i++) {
-        msas[i] = msa_make_partial_order_alignment(end_strings[i], end_string_lengths[i], end_lengths[i], window_size,
-                                                   poa_parameters);
-        column_scores[i] = make_column_scores(msas[i]);
+    for(int64_t start=0; start<end_no; start+=POA_END_BATCH_SIZE) {
+        int64_t batch_end = start + POA_END_BATCH_SIZE < end_no ? start + POA_END_BATCH_SIZE : end_no;
+        bool in_parallel = align_ends_in_parallel();
+#if defined(_OPENMP)
+#pragma omp taskloop grainsize(1) if(in_parallel)
+#endif
+        for(int64_t i=start; i<batch_end; i++) {
+            msas[i] = msa_make_partial_order_alignment(end_strings[i], end_string_lengths[i], end_lengths[i], window_size,
+                                                       min_window_size, max_window_memory, parallel_windows,
+                                                       poa_parameters);
+            // msas made from windows come with their column scores
+            if (msas[i]->column_scores == NULL) {
+                msas[i]->column_scores = make_column_scores(msas[i]);
+            }
+        }
     }
 
     // Make the msas consistent with one another
@@ -767,17 +1209,12 @@ Msa **make_consistent_partial_order_alignments(int64_t end_no, int64_t *end_leng
 
             // If it hasn't already been trimmed
             if(right_end_index > i || (right_end_index == i /* self loop */ && right_end_row_index > j)) {
-                trim(j, msa, column_scores[i],
-                        right_end_row_index, msas[right_end_index], column_scores[right_end_index], overlaps[i][j]);
+                trim(j, msa, msa->column_scores,
+                        right_end_row_index, msas[right_end_index], msas[right_end_index]->column_scores, overlaps[i][j]);
             }
         }
     }
 
-    // Cleanup
-    for(int64_t i=0; i<end_no; i++) {
-        free(column_scores[i]);
-    }
-
     return msas;
 }
 
@@ -1093,7 +1530,8 @@ int64_t getMaxSequenceLength(End *end) {
     return max_length;
 }
 
-stList *make_flower_alignment_poa(Flower *flower, int64_t max_seq_length, int64_t window_size, int64_t mask_filter,
+stList *make_flower_alignment_poa(Flower *flower, int64_t max_seq_length, int64_t window_size, int64_t min_window_size,
+                                  int64_t max_window_memory, bool parallel_windows, int64_t mask_filter,
                                   abpoa_para_t * poa_parameters) {
     End *dominantEnd = getDominantEnd(flower);
     int64_t seq_no = dominantEnd != NULL ? end_getInstanceNumber(dominantEnd) : -1;
@@ -1110,7 +1548,8 @@ stList *make_flower_alignment_poa(Flower *flower, int64_t max_seq_length, int64_
         Cap *indices_to_caps[seq_no];
 
         get_end_sequences(dominantEnd, end_strings, end_string_lengths, overlaps, indices_to_caps, max_seq_length, mask_filter);
-        Msa *msa = msa_make_partial_order_alignment(end_strings, end_string_lengths, seq_no, window_size, poa_parameters);
+        Msa *msa = msa_make_partial_order_alignment(end_strings, end_string_lengths, seq_no, window_size, min_window_size,
+                                                    max_window_memory, parallel_windows, poa_parameters);
 
         //Now convert to set of alignment blocks
         stList *alignment_blocks = stList_construct3(0, (void (*)(void *))alignmentBlock_destruct);
@@ -1137,25 +1576,43 @@ stList *make_flower_alignment_poa(Flower *flower, int64_t max_seq_length, int64_
 
     // Fill out the end information for building the POA alignments arrays
     End *end;
+    End **ends = st_malloc(sizeof(End *) * (end_no + 1));
     Flower_EndIterator *endIterator = flower_getEndIterator(flower);
     int64_t i=0; // Index of the end
     while ((end = flower_getNextEnd(endIterator)) != NULL) {
-        // Initialize the various arrays for the end
-        end_lengths[i] = end_getInstanceNumber(end); // The number of strings incident with the end
-        end_strings[i] = st_malloc(sizeof(char *)*end_lengths[i]);
-        end_string_lengths[i] = st_malloc(sizeof(int)*end_lengths[i]);
-        right_end_indexes[i] = st_malloc(sizeof(int64_t)*end_lengths[i]);
-        right_end_row_indexes[i] = st_malloc(sizeof(int64_t)*end_lengths[i]);
-        indices_to_caps[i] = st_malloc(sizeof(Cap *)*end_lengths[i]);
-        overlaps[i] = st_malloc(sizeof(int64_t)*end_lengths[i]);
-        get_end_sequences(end, end_strings[i], end_string_lengths[i], overlaps[i], indices_to_caps[i],
-                          max_seq_length, mask_filter);
+        ends[i++] = end;
+    }
+    flower_destructEndIterator(endIterator);
+    assert(i == end_no);
+
+    // Getting the strings only reads the flower and sequences, so, as with the msas, is done as tasks if there are
+    // idle threads
+    for(int64_t start=0; start<end_no; start+=POA_END_BATCH_SIZE) {
+        int64_t batch_end = start + POA_END_BATCH_SIZE < end_no ? start + POA_END_BATCH_SIZE : end_no;
+        bool in_parallel = align_ends_in_parallel();
+#if defined(_OPENMP)
+#pragma omp taskloop grainsize(1) if(in_parallel) \
+        shared(end_lengths, end_strings, end_string_lengths, right_end_indexes, right_end_row_indexes, indices_to_caps, overlaps)
+#endif
+        for(int64_t k=start; k<batch_end; k++) {
+            // Initialize the various arrays for the end
+            end_lengths[k] = end_getInstanceNumber(ends[k]); // The number of strings incident with the end
+            end_strings[k] = st_malloc(sizeof(char *)*end_lengths[k]);
+            end_string_lengths[k] = st_malloc(sizeof(int)*end_lengths[k]);
+            right_end_indexes[k] = st_malloc(sizeof(int64_t)*end_lengths[k]);
+            right_end_row_indexes[k] = st_malloc(sizeof(int64_t)*end_lengths[k]);
+            indices_to_caps[k] = st_malloc(sizeof(Cap *)*end_lengths[k]);
+            overlaps[k] = st_malloc(sizeof(int64_t)*end_lengths[k]);
+            get_end_sequences(ends[k], end_strings[k], end_string_lengths[k], overlaps[k], indices_to_caps[k],
+                              max_seq_length, mask_filter);
+        }
+    }
+    free(ends);
+    for(i=0; i<end_no; i++) {
         for(int64_t j=0; j<end_lengths[i]; j++) {
             stHash_insert(caps_to_indices, indices_to_caps[i][j], stIntTuple_construct2(i, j));
         }
-        i++;
     }
-    flower_destructEndIterator(endIterator);
 
     // Fill out the end / row indices for each cap
     endIterator = flower_getEndIterator(flower);
@@ -1184,6 +1641,7 @@ stList *make_flower_alignment_poa(Flower *flower, int64_t max_seq_length, int64_
     // Now make the consistent MSAs
     Msa **msas = make_consistent_partial_order_alignments(end_no, end_lengths, end_strings, end_string_lengths,
                                                           right_end_indexes, right_end_row_indexes, overlaps, window_size,
+                                                          min_window_size, max_window_memory, parallel_windows,
                                                           poa_parameters);
 
     // Temp debug output
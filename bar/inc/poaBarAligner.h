@@ -20,6 +20,29 @@
  */
 void bar(stList *flowers, CactusParams *p, CactusDisk *cactusDisk, stList *listOfEndAlignmentFiles);
 
+/*
+ * The parameters of the bar algorithm, parsed from the cactus params.
+ */
+typedef struct _barParameters BarParameters;
+
+/*
+ * Parses the bar parameters. listOfEndAlignmentFiles, if not NULL, gives precomputed alignments and is not copied.
+ */
+BarParameters *barParameters_construct(CactusParams *params, stList *listOfEndAlignmentFiles);
+
+void barParameters_destruct(BarParameters *barParameters);
+
+/*
+ * Runs the bar algorithm on a single flower. Can be called on different flowers in parallel.
+ */
+void bar_alignFlower(Flower *flower, BarParameters *barParameters);
+
+/*
+ * Returns the number of flowers currently being aligned by bar_alignFlower. When it is less than the number of threads
+ * the ends of a flower are aligned in parallel.
+ */
+int64_t bar_getActiveFlowerNumber(void);
+
 /*
  * Construct a pairwise alignment parameters object parsing the cactus params specified parameters.
  */
@@ -40,6 +63,7 @@ typedef struct _Msa {
     char **seqs; // sequences as ASCII characters
     int column_no; // number of columns in the msa
     uint8_t **msa_seq; // the msa matrix of the aligned sequences
+    float *column_scores; // the score of each column, kept up to date as the msa is trimmed, or NULL if not yet made
 } Msa;
 
 /**
@@ -68,6 +92,12 @@ void msa_print(Msa *msa, FILE *f);
  * @param seq_lens An array giving the string lengths
  * @param seq_no The number of strings
  * @param window_size Sliding window size which limits length of poa sub-alignments.  Memory usage is quardatic in this. 
+ * @param min_window_size If positive and less than window_size, the sliding window size is chosen for the strings
+ *        between this and window_size (see msa_get_window_size)
+ * @param max_window_memory The memory the alignment of a window may use when the window size is chosen
+ * @param parallel_windows If non-zero, align the windows of a sequence concurrently from seeded positions, rather than
+ *        each from where the alignment of the previous one left off. Ignored when the lengths of the strings differ
+ *        by more than the overlap between windows, as the seeded positions would then be misplaced
  * @param poa_parameters abpoa parameters
  * @return An msa of the strings.
  */
@@ -75,8 +105,28 @@ Msa *msa_make_partial_order_alignment(char **seqs,
                                       int *seq_lens,
                                       int64_t seq_no,
                                       int64_t window_size,
+                                      int64_t min_window_size,
+                                      int64_t max_window_memory,
+                                      bool parallel_windows,
                                       abpoa_para_t *poa_parameters);
 
+/**
+ * Frees the abpoa contexts kept by the threads between alignments, which hold on to the memory needed by the largest
+ * window each thread has aligned. Must be called outside of any parallel region that is aligning. A thread that aligns
+ * again afterwards makes a new context.
+ */
+void msa_release_poa_contexts(void);
+
+/**
+ * Chooses the sliding window size to align a set of strings with. This is the largest size between min_window_size
+ * and window_size for which the alignment of a window is estimated to need no more than max_window_memory, estimated
+ * from the number of strings, the spread of their lengths and the divergence of their k-mers. No window is made
+ * longer than the longest string, and window_size is returned unchanged if min_window_size is not positive and less
+ * than window_size, or max_window_memory is not positive.
+ */
+int64_t msa_get_window_size(char **seqs, int *seq_lens, int64_t seq_no, int64_t window_size, int64_t min_window_size,
+                            int64_t max_window_memory, abpoa_para_t *poa_parameters);
+
 /**
  * Takes a set of ends and returns a set of consistent multiple alignments,
  * one for each of them.
@@ -96,12 +146,19 @@ Msa *msa_make_partial_order_alignment(char **seqs,
  * @param right_end_row_indexes For each string, the index of the row of its reverse complement
  * @param overlaps For each prefix string, the length of the overlap with its reverse complement adjacency
  * @param window_size Sliding window size which limits length of poa sub-alignments.  Memory usage is quardatic in this. 
+ * @param min_window_size If positive and less than window_size, the sliding window size is chosen for the strings
+ *        between this and window_size (see msa_get_window_size)
+ * @param max_window_memory The memory the alignment of a window may use when the window size is chosen
+ * @param parallel_windows If non-zero, align the windows of a sequence concurrently from seeded positions, rather than
+ *        each from where the alignment of the previous one left off. Ignored when the lengths of the strings differ
+ *        by more than the overlap between windows, as the seeded positions would then be misplaced
  * @param poa_parameters abpoa parameters
  * @return A consistent Msa for each end
  */
 Msa **make_consistent_partial_order_alignments(int64_t end_no, int64_t *end_lengths, char ***end_strings,
         int **end_string_lengths, int64_t **right_end_indexes, int64_t **right_end_row_indexes, int64_t **overlaps,
-        int64_t window_size, abpoa_para_t *poa_parameters);
+        int64_t window_size, int64_t min_window_size, int64_t max_window_memory, bool parallel_windows,
+        abpoa_para_t *poa_parameters);
 
 /**
  * Represents a gapless alignment of a set of sequences.
@@ -135,6 +192,12 @@ char *get_adjacency_string(Cap *cap, int *length, bool return_string);
  * @param max_seq_length is the maximum length of the prefix of an unaligned sequence
  * to attempt to align.
  * @param window_size Sliding window size which limits length of poa sub-alignments.  Memory usage is quardatic in this. 
+ * @param min_window_size If positive and less than window_size, the sliding window size is chosen for the strings
+ *        between this and window_size (see msa_get_window_size)
+ * @param max_window_memory The memory the alignment of a window may use when the window size is chosen
+ * @param parallel_windows If non-zero, align the windows of a sequence concurrently from seeded positions, rather than
+ *        each from where the alignment of the previous one left off. Ignored when the lengths of the strings differ
+ *        by more than the overlap between windows, as the seeded positions would then be misplaced
  * @param mask_filter Trim input sequences if encountering this many consecutive soft of hard masked bases (0 = disabled)
  * @param poa_band_constant abpoa "b" parameter, where adaptive band is b+f*<length> (b < 0 = disabled)
  * @param poa_band_fraction abpoa "f" parameter, where adaptive band is b+f*<length> (b < 0 = disabled)
@@ -143,6 +206,9 @@ char *get_adjacency_string(Cap *cap, int *length, bool return_string);
 stList *make_flower_alignment_poa(Flower *flower,
                                   int64_t max_seq_length,
                                   int64_t window_size,
+                                  int64_t min_window_size,
+                                  int64_t max_window_memory,
+                                  bool parallel_windows,
                                   int64_t mask_filter,
                                   abpoa_para_t * poa_parameters);
 
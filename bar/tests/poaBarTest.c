@@ -30,6 +30,24 @@ void validate_msa(CuTest *testCase, Msa *msa, int64_t *lengths) {
     }
 }
 
+/**
+ * Check that the column scores kept with an msa, if any, match the columns.
+ */
+static void validate_column_scores(CuTest *testCase, Msa *msa) {
+    if(msa->column_scores == NULL) {
+        return;
+    }
+    for(int64_t j=0; j<msa->column_no; j++) {
+        int64_t base_no = 0;
+        for(int64_t i=0; i<msa->seq_no; i++) {
+            if(msa_to_base(msa->msa_seq[i][j]) != '-') {
+                base_no++;
+            }
+        }
+        CuAssertDblEquals(testCase, base_no > 0 ? base_no - 1 : 0, msa->column_scores[j], 0.0);
+    }
+}
+
 /**
  * Repeatedly generate random sets of closely related strings and test that returned msa is valid
  */
@@ -65,7 +83,7 @@ void test_make_partial_order_alignment(CuTest *testCase) {
             }
 
             // generate the alignment
-            Msa *msa = msa_make_partial_order_alignment(seqs, seq_lens, seq_no, poa_window_size, abpt);
+            Msa *msa = msa_make_partial_order_alignment(seqs, seq_lens, seq_no, poa_window_size, 0, 0, 0, abpt);
 
             // print the msa
 #ifdef stderr_logging
@@ -75,6 +93,7 @@ void test_make_partial_order_alignment(CuTest *testCase) {
             // validate the msa
             int64_t lengths[seq_no];
             validate_msa(testCase, msa, lengths);
+            validate_column_scores(testCase, msa);
             for(int64_t i=0; i<seq_no; i++) {
                 CuAssertTrue(testCase, lengths[i] == seq_lens[i]);
             }
@@ -87,6 +106,155 @@ void test_make_partial_order_alignment(CuTest *testCase) {
     abpoa_free_para(abpt);
 }
 
+/**
+ * Check that the window size chosen for a set of strings keeps to its bounds, shrinks as the memory cap does, and is
+ * smaller for diverged strings than for identical ones, and that msas made with it are valid.
+ */
+void test_msa_get_window_size(CuTest *testCase) {
+    abpoa_para_t *abpt = abpoa_init_para();
+    abpt->wb = 10;
+    abpt->wf = 0.01;
+    abpoa_post_set_para(abpt);
+    for(int64_t test=0; test<20; test++) {
+        char *parent_string = getRandomACGTSequence(st_randomInt(500, 2000));
+        int64_t seq_no = st_randomInt(2, 20);
+        char **seqs = st_malloc(sizeof(char *) * seq_no);
+        char **same_seqs = st_malloc(sizeof(char *) * seq_no);
+        int *seq_lens = st_malloc(sizeof(int) * seq_no);
+        int *same_seq_lens = st_malloc(sizeof(int) * seq_no);
+        for(int64_t i=0; i<seq_no; i++) {
+            seqs[i] = i == 0 ? stString_copy(parent_string) : getRandomACGTSequence(strlen(parent_string));
+            seq_lens[i] = strlen(seqs[i]);
+            same_seqs[i] = stString_copy(parent_string);
+            same_seq_lens[i] = strlen(parent_string);
+        }
+
+        // disabled, the window size is unchanged
+        CuAssertIntEquals(testCase, 100, msa_get_window_size(seqs, seq_lens, seq_no, 100, 0, 1000000, abpt));
+        CuAssertIntEquals(testCase, 100, msa_get_window_size(seqs, seq_lens, seq_no, 100, 10, 0, abpt));
+
+        int64_t prev_window_size = 0;
+        for(int64_t max_memory = 1000; max_memory <= 100000000; max_memory *= 10) {
+            int64_t window_size = msa_get_window_size(seqs, seq_lens, seq_no, 1000, 10, max_memory, abpt);
+            int64_t same_window_size = msa_get_window_size(same_seqs, same_seq_lens, seq_no, 1000, 10, max_memory, abpt);
+            CuAssertTrue(testCase, window_size >= 10 && window_size <= 1000);
+            CuAssertTrue(testCase, window_size >= prev_window_size);
+            CuAssertTrue(testCase, same_window_size >= window_size);
+            // a dp row is the whole window, however narrow the band
+            CuAssertTrue(testCase, same_window_size == 10 || same_window_size * same_window_size * 4 <= max_memory);
+            prev_window_size = window_size;
+        }
+
+        // the msa is valid with a chosen window
+        Msa *msa = msa_make_partial_order_alignment(seqs, seq_lens, seq_no, 1000, 10, 100000, 0, abpt);
+        int64_t lengths[seq_no];
+        validate_msa(testCase, msa, lengths);
+        for(int64_t i=0; i<seq_no; i++) {
+            CuAssertTrue(testCase, lengths[i] == seq_lens[i]);
+        }
+        msa_destruct(msa);
+
+        for(int64_t i=0; i<seq_no; i++) {
+            free(same_seqs[i]);
+        }
+        free(same_seqs);
+        free(same_seq_lens);
+        free(parent_string);
+    }
+    abpoa_free_para(abpt);
+}
+
+/**
+ * Sums, over the columns of an msa, the number of bases in the column matching its most common base, less one.
+ */
+static int64_t get_aligned_base_number(Msa *msa) {
+    int64_t aligned_base_number = 0;
+    for(int64_t j=0; j<msa->column_no; j++) {
+        int64_t counts[256] = { 0 };
+        int64_t max_count = 0;
+        for(int64_t i=0; i<msa->seq_no; i++) {
+            char b = msa_to_base(msa->msa_seq[i][j]);
+            if(b != '-' && ++counts[(unsigned char)b] > max_count) {
+                max_count = counts[(unsigned char)b];
+            }
+        }
+        aligned_base_number += max_count > 0 ? max_count - 1 : 0;
+    }
+    return aligned_base_number;
+}
+
+/**
+ * Generate sets of related strings that are long relative to the poa window, and check that aligning their
+ * windows in parallel gives a valid msa of about the quality of the sliding window. If large_insertion is non-zero,
+ * about half of the strings get an insertion of several windows near their start.
+ */
+static void check_parallel_windows(CuTest *testCase, bool large_insertion) {
+    abpoa_para_t *abpt = abpoa_init_para();
+    abpt->wb = 10;
+    abpt->wf = 0.01;
+    abpoa_post_set_para(abpt);
+    int64_t aligned_base_numbers[2] = { 0, 0 };
+    for(int64_t test=0; test<20; test++) {
+        for (int64_t poa_window_size = 20; poa_window_size < 200; poa_window_size += 60) {
+            char *parent_string = getRandomACGTSequence(st_randomInt(1, 1000));
+            int64_t seq_no = st_randomInt(1, 20);
+            char **seqs = st_malloc(sizeof(char *) * seq_no);
+            int *seq_lens = st_malloc(sizeof(int) * seq_no);
+            for(int64_t i=0; i<seq_no; i++) {
+                seqs[i] = evolveSequence(parent_string);
+                if (large_insertion && st_random() > 0.5) {
+                    char *insertion = getRandomACGTSequence(st_randomInt(2 * poa_window_size, 5 * poa_window_size));
+                    int64_t offset = st_randomInt(0, strlen(seqs[i]) / 10 + 1);
+                    char *seq = stString_print("%.*s%s%s", (int)offset, seqs[i], insertion, seqs[i] + offset);
+                    free(insertion);
+                    free(seqs[i]);
+                    seqs[i] = seq;
+                }
+                seq_lens[i] = strlen(seqs[i]);
+            }
+
+            for(int64_t k=0; k<2; k++) {
+                Msa *msa = msa_make_partial_order_alignment(seqs, seq_lens, seq_no, poa_window_size, 0, 0, k, abpt);
+                int64_t lengths[seq_no];
+                validate_msa(testCase, msa, lengths);
+                validate_column_scores(testCase, msa);
+                for(int64_t i=0; i<seq_no; i++) {
+                    CuAssertTrue(testCase, lengths[i] == seq_lens[i]);
+                }
+                aligned_base_numbers[k] += get_aligned_base_number(msa);
+                msa->seqs = NULL; // The strings are shared between both msas
+                msa->seq_lens = NULL;
+                msa_destruct(msa);
+            }
+
+            for(int64_t i=0; i<seq_no; i++) {
+                free(seqs[i]);
+            }
+            free(seqs);
+            free(seq_lens);
+            free(parent_string);
+        }
+    }
+#ifdef stderr_logging
+    fprintf(stderr, "Aligned bases, sliding windows: %" PRIi64 ", parallel windows: %" PRIi64 "\n",
+            aligned_base_numbers[0], aligned_base_numbers[1]);
+#endif
+    CuAssertTrue(testCase, aligned_base_numbers[1] >= 0.9 * aligned_base_numbers[0]);
+    abpoa_free_para(abpt);
+}
+
+void test_make_partial_order_alignment_parallel_windows(CuTest *testCase) {
+    check_parallel_windows(testCase, 0);
+}
+
+/**
+ * As test_make_partial_order_alignment_parallel_windows, but with a large insertion near the start of some of the
+ * strings, which would misplace windows seeded in proportion to the string lengths.
+ */
+void test_make_partial_order_alignment_parallel_windows_large_insertion(CuTest *testCase) {
+    check_parallel_windows(testCase, 1);
+}
+
 /**
  * Repeatedly generate random sets of two ends connected by set of strings, check that the resulting msa is valid
  */
@@ -145,7 +313,7 @@ void test_make_consistent_partial_order_alignments_two_ends(CuTest *testCase) {
 
         // generate the alignments
         Msa **msas = make_consistent_partial_order_alignments(end_no, end_lengths, end_strings, end_string_lengths,
-                                                              right_end_indexes, right_end_row_indexes, overlaps, 1000000, abpt);
+                                                              right_end_indexes, right_end_row_indexes, overlaps, 1000000, 0, 0, 0, abpt);
 
         // print the msas
 #ifdef stderr_logging
@@ -159,6 +327,8 @@ void test_make_consistent_partial_order_alignments_two_ends(CuTest *testCase) {
         int64_t lengths1[seq_no], lengths2[seq_no];
         validate_msa(testCase, msas[0], lengths1);
         validate_msa(testCase, msas[1], lengths2);
+        validate_column_scores(testCase, msas[0]);
+        validate_column_scores(testCase, msas[1]);
         for(int64_t i=0; i<seq_no; i++) {
             //int64_t k = (i + j)%seq_no; // The row index of the corresponding sequence for the second end
             CuAssertTrue(testCase, lengths1[i] + lengths2[(i + j)%seq_no] == end_string_lengths[0][i]);
@@ -177,6 +347,115 @@ void test_make_consistent_partial_order_alignments_two_ends(CuTest *testCase) {
     abpoa_free_para(abpt);
 }
 
+/**
+ * Makes the inputs for make_consistent_partial_order_alignments for pairs of ends, each pair connected by a set of
+ * strings, copying them from the given strings.
+ */
+static void make_end_pairs(int64_t pair_no, int64_t *seq_nos, char ***seqs, int64_t end_no, int64_t *end_lengths,
+                           char ***end_strings, int **end_string_lengths, int64_t **right_end_indexes,
+                           int64_t **right_end_row_indexes, int64_t **overlaps) {
+    for(int64_t p=0; p<pair_no; p++) {
+        for(int64_t e=2*p; e<2*p+2; e++) {
+            end_lengths[e] = seq_nos[p];
+            end_strings[e] = st_malloc(sizeof(char *) * seq_nos[p]);
+            end_string_lengths[e] = st_malloc(sizeof(int) * seq_nos[p]);
+            right_end_indexes[e] = st_malloc(sizeof(int64_t) * seq_nos[p]);
+            right_end_row_indexes[e] = st_malloc(sizeof(int64_t) * seq_nos[p]);
+            overlaps[e] = st_malloc(sizeof(int64_t) * seq_nos[p]);
+        }
+        for(int64_t i=0; i<seq_nos[p]; i++) {
+            int64_t length = strlen(seqs[p][i]);
+            end_strings[2*p][i] = stString_copy(seqs[p][i]);
+            end_strings[2*p+1][i] = stString_reverseComplementString(seqs[p][i]);
+            for(int64_t e=2*p; e<2*p+2; e++) {
+                end_string_lengths[e][i] = length;
+                right_end_indexes[e][i] = e == 2*p ? 2*p+1 : 2*p;
+                right_end_row_indexes[e][i] = i;
+                overlaps[e][i] = length;
+            }
+        }
+    }
+}
+
+/**
+ * Checks aligning the ends as tasks, as done when there are idle threads, gives the same msas as aligning them in turn
+ */
+void test_make_consistent_partial_order_alignments_in_parallel(CuTest *testCase) {
+    abpoa_para_t *abpt = abpoa_init_para();
+    abpt->wb = 10;
+    abpt->wf = 0.01;
+    abpoa_post_set_para(abpt);
+
+    for(int64_t test=0; test<10; test++) {
+        // Random pairs of ends, each connected by strings evolved from a parent string
+        int64_t pair_no = st_randomInt(1, 50);
+        int64_t end_no = 2 * pair_no;
+        int64_t seq_nos[pair_no];
+        char **seqs[pair_no];
+        for(int64_t p=0; p<pair_no; p++) {
+            char *parent_string = getRandomACGTSequence(st_randomInt(1, 50));
+            seq_nos[p] = st_randomInt(1, 10);
+            seqs[p] = st_malloc(sizeof(char *) * seq_nos[p]);
+            for(int64_t i=0; i<seq_nos[p]; i++) {
+                seqs[p][i] = evolveSequence(parent_string);
+            }
+            free(parent_string);
+        }
+
+        Msa **msas[2];
+        for(int64_t k=0; k<2; k++) {
+            int64_t end_lengths[end_no];
+            char **end_strings[end_no];
+            int *end_string_lengths[end_no];
+            int64_t *right_end_indexes[end_no];
+            int64_t *right_end_row_indexes[end_no];
+            int64_t *overlaps[end_no];
+            make_end_pairs(pair_no, seq_nos, seqs, end_no, end_lengths, end_strings, end_string_lengths,
+                           right_end_indexes, right_end_row_indexes, overlaps);
+            if(k == 0) {
+                msas[k] = make_consistent_partial_order_alignments(end_no, end_lengths, end_strings, end_string_lengths,
+                                                                   right_end_indexes, right_end_row_indexes, overlaps,
+                                                                   1000000, 0, 0, 0, abpt);
+            } else {
+#if defined(_OPENMP)
+#pragma omp parallel
+#pragma omp single
+#endif
+                msas[k] = make_consistent_partial_order_alignments(end_no, end_lengths, end_strings, end_string_lengths,
+                                                                   right_end_indexes, right_end_row_indexes, overlaps,
+                                                                   1000000, 0, 0, 0, abpt);
+            }
+            for(int64_t i=0; i<end_no; i++) {
+                free(right_end_indexes[i]);
+                free(right_end_row_indexes[i]);
+                free(overlaps[i]);
+            }
+        }
+
+        // The msas should be identical
+        for(int64_t i=0; i<end_no; i++) {
+            CuAssertIntEquals(testCase, msas[0][i]->seq_no, msas[1][i]->seq_no);
+            CuAssertIntEquals(testCase, msas[0][i]->column_no, msas[1][i]->column_no);
+            for(int64_t j=0; j<msas[0][i]->seq_no; j++) {
+                CuAssertIntEquals(testCase, msas[0][i]->seq_lens[j], msas[1][i]->seq_lens[j]);
+                CuAssertTrue(testCase, memcmp(msas[0][i]->msa_seq[j], msas[1][i]->msa_seq[j], msas[0][i]->column_no) == 0);
+            }
+            msa_destruct(msas[0][i]);
+            msa_destruct(msas[1][i]);
+        }
+        free(msas[0]);
+        free(msas[1]);
+
+        for(int64_t p=0; p<pair_no; p++) {
+            for(int64_t i=0; i<seq_nos[p]; i++) {
+                free(seqs[p][i]);
+            }
+            free(seqs[p]);
+        }
+    }
+    abpoa_free_para(abpt);
+}
+
 void test_make_flower_alignment_poa(CuTest *testCase) {
     setup(testCase);
 
@@ -212,7 +491,7 @@ void test_make_flower_alignment_poa(CuTest *testCase) {
     }
     flower_destructEndIterator(endIterator);
 
-    stList *alignment_blocks = make_flower_alignment_poa(flower, 2, 1000000, 5, abpt);
+    stList *alignment_blocks = make_flower_alignment_poa(flower, 2, 1000000, 0, 0, 0, 5, abpt);
 
     for(int64_t i=0; i<stList_length(alignment_blocks); i++) {
         AlignmentBlock *b = stList_get(alignment_blocks, i);
@@ -233,7 +512,7 @@ void test_alignment_block_iterator(CuTest *testCase) {
     abpt->wf = 0.01;
     abpoa_post_set_para(abpt);
 
-    stList *alignment_blocks = make_flower_alignment_poa(flower, 10000, 1000000, 5, abpt);
+    stList *alignment_blocks = make_flower_alignment_poa(flower, 10000, 1000000, 0, 0, 0, 5, abpt);
 
     abpoa_free_para(abpt);
 #ifdef stderr_logging
@@ -266,7 +545,11 @@ void test_alignment_block_iterator(CuTest *testCase) {
 CuSuite* poaBarAlignerTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, test_make_partial_order_alignment);
+    SUITE_ADD_TEST(suite, test_make_partial_order_alignment_parallel_windows);
+    SUITE_ADD_TEST(suite, test_make_partial_order_alignment_parallel_windows_large_insertion);
+    SUITE_ADD_TEST(suite, test_msa_get_window_size);
     SUITE_ADD_TEST(suite, test_make_consistent_partial_order_alignments_two_ends);
+    SUITE_ADD_TEST(suite, test_make_consistent_partial_order_alignments_in_parallel);
     SUITE_ADD_TEST(suite, test_make_flower_alignment_poa);
     SUITE_ADD_TEST(suite, test_alignment_block_iterator);
     return suite;
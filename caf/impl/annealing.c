@@ -86,33 +86,135 @@ static int64_t getIntersectionLengthReverse(int64_t start1, int64_t end2, stPinc
     return length1 > length2 ? length2 : length1;
 }
 
-static stPinchInterval *updatePinchInterval(int64_t start, stPinchInterval *pinchInterval,
-        stSortedSet *adjacencyComponentIntervals) {
-    return start < pinchInterval->start + pinchInterval->length ? pinchInterval : stPinchIntervals_getInterval(
-            adjacencyComponentIntervals, pinchInterval->name, start);
+/*
+ * The adjacency component intervals of each thread, stored contiguously and in order along the thread, so that a
+ * pinch marching along a thread moves a cursor through the thread's intervals rather than searching for each one.
+ */
+typedef struct _adjacencyComponentIntervals {
+    int64_t threadNumber;
+    Name *names; // The threads, sorted
+    int64_t *offsets; // The intervals of names[i] are intervals[offsets[i]] to intervals[offsets[i + 1] - 1]
+    stPinchInterval *intervals;
+} AdjacencyComponentIntervals;
+
+static int compareIntervals(const void *a, const void *b) {
+    const stPinchInterval *i = a, *j = b;
+    if (i->name != j->name) {
+        return i->name < j->name ? -1 : 1;
+    }
+    return i->start < j->start ? -1 : (i->start > j->start ? 1 : 0);
+}
+
+static AdjacencyComponentIntervals *adjacencyComponentIntervals_construct(stSortedSet *pinchIntervals) {
+    AdjacencyComponentIntervals *intervals = st_malloc(sizeof(AdjacencyComponentIntervals));
+    int64_t intervalNumber = stSortedSet_size(pinchIntervals);
+    intervals->intervals = st_malloc(sizeof(stPinchInterval) * (intervalNumber + 1));
+    stSortedSetIterator *it = stSortedSet_getIterator(pinchIntervals);
+    stPinchInterval *pinchInterval;
+    int64_t i = 0;
+    while ((pinchInterval = stSortedSet_getNext(it)) != NULL) {
+        intervals->intervals[i++] = *pinchInterval;
+    }
+    stSortedSet_destructIterator(it);
+    qsort(intervals->intervals, intervalNumber, sizeof(stPinchInterval), compareIntervals);
+
+    intervals->threadNumber = 0;
+    intervals->names = st_malloc(sizeof(Name) * (intervalNumber + 1));
+    intervals->offsets = st_malloc(sizeof(int64_t) * (intervalNumber + 1));
+    for (i = 0; i < intervalNumber; i++) {
+        if (i == 0 || intervals->intervals[i].name != intervals->intervals[i - 1].name) {
+            intervals->names[intervals->threadNumber] = intervals->intervals[i].name;
+            intervals->offsets[intervals->threadNumber++] = i;
+        }
+    }
+    intervals->offsets[intervals->threadNumber] = intervalNumber;
+    return intervals;
+}
+
+static void adjacencyComponentIntervals_destruct(AdjacencyComponentIntervals *intervals) {
+    free(intervals->names);
+    free(intervals->offsets);
+    free(intervals->intervals);
+    free(intervals);
+}
+
+/*
+ * Gets the interval of the thread containing the position.
+ */
+static stPinchInterval *adjacencyComponentIntervals_getInterval(AdjacencyComponentIntervals *intervals, Name name,
+                                                                int64_t position) {
+    int64_t low = 0, high = intervals->threadNumber;
+    while (low < high) {
+        int64_t mid = low + (high - low) / 2;
+        if (intervals->names[mid] < name) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    assert(low < intervals->threadNumber && intervals->names[low] == name);
+    int64_t end = intervals->offsets[low + 1];
+    low = intervals->offsets[low];
+    high = end;
+    while (low < high) { // Find the first interval ending after the position
+        int64_t mid = low + (high - low) / 2;
+        if (intervals->intervals[mid].start + intervals->intervals[mid].length <= position) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    assert(low < end && intervals->intervals[low].start <= position);
+    return &intervals->intervals[low];
+}
+
+/*
+ * Moves the cursor forward along its thread to the interval containing start.
+ */
+static stPinchInterval *updatePinchInterval(int64_t start, stPinchInterval *pinchInterval) {
+    while (start >= pinchInterval->start + pinchInterval->length) {
+        pinchInterval++;
+    }
+    return pinchInterval;
 }
 
-static stPinchInterval *updatePinchIntervalReverse(int64_t end, stPinchInterval *pinchInterval,
-        stSortedSet *adjacencyComponentIntervals) {
-    return end >= pinchInterval->start ? pinchInterval : stPinchIntervals_getInterval(adjacencyComponentIntervals,
-            pinchInterval->name, end);
+/*
+ * Moves the cursor backward along its thread to the interval containing end.
+ */
+static stPinchInterval *updatePinchIntervalReverse(int64_t end, stPinchInterval *pinchInterval) {
+    while (end < pinchInterval->start) {
+        pinchInterval--;
+    }
+    return pinchInterval;
 }
 
 static int64_t min(int64_t i, int64_t j) {
     return i < j ? i : j;
 }
 
-static void alignSameComponents(stPinch *pinch, stPinchThreadSet *threadSet, stSortedSet *adjacencyComponentIntervals,
+/*
+ * Gets the intervals containing the first base of each side of the pinch, which for a reverse strand pinch is the
+ * last base of the second side.
+ */
+static void getPinchIntervals(stPinch *pinch, AdjacencyComponentIntervals *adjacencyComponentIntervals,
+                              stPinchInterval **pinchInterval1, stPinchInterval **pinchInterval2) {
+    *pinchInterval1 = adjacencyComponentIntervals_getInterval(adjacencyComponentIntervals, pinch->name1, pinch->start1);
+    *pinchInterval2 = adjacencyComponentIntervals_getInterval(adjacencyComponentIntervals, pinch->name2,
+                                                              pinch->strand ? pinch->start2 : pinch->start2 + pinch->length - 1);
+}
+
+/*
+ * Applies the parts of the pinch whose bases are in the same adjacency component, starting from the intervals given
+ * by getPinchIntervals.
+ */
+static void alignSameComponents(stPinch *pinch, stPinchThreadSet *threadSet, stPinchInterval *pinchInterval1,
+                                stPinchInterval *pinchInterval2,
                                 bool (*filterFn)(stPinchSegment *, stPinchSegment *, Flower *), Flower *flower) {
     stPinchThread *thread1 = stPinchThreadSet_getThread(threadSet, pinch->name1);
     stPinchThread *thread2 = stPinchThreadSet_getThread(threadSet, pinch->name2);
     assert(thread1 != NULL && thread2 != NULL);
-    stPinchInterval *pinchInterval1 = stPinchIntervals_getInterval(adjacencyComponentIntervals, pinch->name1,
-            pinch->start1);
     int64_t offset = 0;
     if (pinch->strand) { //A bit redundant code wise, but fast.
-        stPinchInterval *pinchInterval2 = stPinchIntervals_getInterval(adjacencyComponentIntervals, pinch->name2,
-                pinch->start2);
         while (offset < pinch->length) {
             assert(pinchInterval1 != NULL && pinchInterval2 != NULL);
             int64_t length = min(getIntersectionLength(pinch->start1 + offset, pinch->start2 + offset, pinchInterval1,
@@ -127,12 +229,13 @@ static void alignSameComponents(stPinch *pinch, stPinchThreadSet *threadSet, stS
                 }
             }
             offset += length;
-            pinchInterval1 = updatePinchInterval(pinch->start1 + offset, pinchInterval1, adjacencyComponentIntervals);
-            pinchInterval2 = updatePinchInterval(pinch->start2 + offset, pinchInterval2, adjacencyComponentIntervals);
+            if (offset < pinch->length) { // Don't move the cursors past the end of the pinch, which may end its thread
+                pinchInterval1 = updatePinchInterval(pinch->start1 + offset, pinchInterval1);
+                pinchInterval2 = updatePinchInterval(pinch->start2 + offset, pinchInterval2);
+            }
         }
     } else {
         int64_t end2 = pinch->start2 + pinch->length - 1;
-        stPinchInterval *pinchInterval2 = stPinchIntervals_getInterval(adjacencyComponentIntervals, pinch->name2, end2);
         while (offset < pinch->length) {
             assert(pinchInterval1 != NULL && pinchInterval2 != NULL);
             int64_t length = min(getIntersectionLengthReverse(pinch->start1 + offset, end2 - offset, pinchInterval1,
@@ -147,18 +250,21 @@ static void alignSameComponents(stPinch *pinch, stPinchThreadSet *threadSet, stS
                 }
             }
             offset += length;
-            pinchInterval1 = updatePinchInterval(pinch->start1 + offset, pinchInterval1, adjacencyComponentIntervals);
-            pinchInterval2 = updatePinchIntervalReverse(end2 - offset, pinchInterval2, adjacencyComponentIntervals);
+            if (offset < pinch->length) {
+                pinchInterval1 = updatePinchInterval(pinch->start1 + offset, pinchInterval1);
+                pinchInterval2 = updatePinchIntervalReverse(end2 - offset, pinchInterval2);
+            }
         }
     }
 }
 
-static stSortedSet *getAdjacencyComponentIntervals(stPinchThreadSet *threadSet, stList **adjacencyComponents) {
+static AdjacencyComponentIntervals *getAdjacencyComponentIntervals(stPinchThreadSet *threadSet, stList **adjacencyComponents) {
     stHash *pinchEndsToAdjacencyComponents;
     *adjacencyComponents = stPinchThreadSet_getAdjacencyComponents2(threadSet, &pinchEndsToAdjacencyComponents);
-    stSortedSet *adjacencyComponentIntervals = stPinchThreadSet_getLabelIntervals(threadSet,
-            pinchEndsToAdjacencyComponents);
+    stSortedSet *pinchIntervals = stPinchThreadSet_getLabelIntervals(threadSet, pinchEndsToAdjacencyComponents);
     stHash_destruct(pinchEndsToAdjacencyComponents);
+    AdjacencyComponentIntervals *adjacencyComponentIntervals = adjacencyComponentIntervals_construct(pinchIntervals);
+    stSortedSet_destruct(pinchIntervals);
     return adjacencyComponentIntervals;
 }
 
@@ -166,13 +272,15 @@ void stCaf_annealBetweenAdjacencyComponents2(stPinchThreadSet *threadSet, stPinc
         void *extraArg, bool (*filterFn)(stPinchSegment *, stPinchSegment *, Flower *), Flower *flower) {
     //Get the adjacency component intervals
     stList *adjacencyComponents;
-    stSortedSet *adjacencyComponentIntervals = getAdjacencyComponentIntervals(threadSet, &adjacencyComponents);
+    AdjacencyComponentIntervals *adjacencyComponentIntervals = getAdjacencyComponentIntervals(threadSet, &adjacencyComponents);
     //Now do the actual alignments.
     stPinch *pinch, pinchToFillOut;
     while ((pinch = pinchIterator(extraArg, &pinchToFillOut)) != NULL) {
-        alignSameComponents(pinch, threadSet, adjacencyComponentIntervals, filterFn, flower);
+        stPinchInterval *pinchInterval1, *pinchInterval2;
+        getPinchIntervals(pinch, adjacencyComponentIntervals, &pinchInterval1, &pinchInterval2);
+        alignSameComponents(pinch, threadSet, pinchInterval1, pinchInterval2, filterFn, flower);
     }
-    stSortedSet_destruct(adjacencyComponentIntervals);
+    adjacencyComponentIntervals_destruct(adjacencyComponentIntervals);
     stList_destruct(adjacencyComponents);
 }
 
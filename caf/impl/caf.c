@@ -19,123 +19,6 @@ static bool blockFilterFn(stPinchBlock *pinchBlock, void *extraArg) {
     return 0;
 }
 
-static uint64_t choose2(uint64_t n) {
-#define CHOOSE_TWO_CACHE_LEN 256
-    int64_t chooseTwoCache[256] = {0}; // removing static variable, even if fast
-    if (n <= 1) {
-        return 0;
-    } else if (n >= CHOOSE_TWO_CACHE_LEN) {
-        return n * (n - 1) / 2;
-    } else {
-        if (chooseTwoCache[n] != 0) {
-            return chooseTwoCache[n];
-        } else {
-            chooseTwoCache[n] = n * (n - 1) / 2;
-            return chooseTwoCache[n];
-        }
-    }
-}
-
-// Get the number of possible pairwise alignments that could support
-// this block. Ordinarily this is (degree choose 2), but since we
-// don't do outgroup self-alignment, it's a bit smaller.
-static uint64_t numPossibleSupportingHomologies(stPinchBlock *block, Flower *flower) {
-    uint64_t outgroupDegree = 0, ingroupDegree = 0;
-    stPinchBlockIt segIt = stPinchBlock_getSegmentIterator(block);
-    stPinchSegment *segment;
-    while ((segment = stPinchBlockIt_getNext(&segIt)) != NULL) {
-        Name capName = stPinchSegment_getName(segment);
-        Cap *cap = flower_getCap(flower, capName);
-        Event *event = cap_getEvent(cap);
-        if (event_isOutgroup(event)) {
-            outgroupDegree++;
-        } else {
-            ingroupDegree++;
-        }
-    }
-    assert(outgroupDegree + ingroupDegree == stPinchBlock_getDegree(block));
-    // We do the ingroup-ingroup alignments as an all-against-all
-    // alignment, so we can see each ingroup-ingroup homology up to
-    // twice.
-    return choose2(ingroupDegree) * 2 + ingroupDegree * outgroupDegree;
-}
-
-// for printThreadSetStatistics
-static int uint64_cmp(const uint64_t *x, const uint64_t *y) {
-    if (*x < *y) {
-        return -1;
-    } else if (*x == *y) {
-        return 0;
-    } else {
-        return 1;
-    }
-}
-
-// for printThreadSetStatistics
-static int double_cmp(const double *x, const double *y) {
-    if (*x < *y) {
-        return -1;
-    } else if (*x == *y) {
-        return 0;
-    } else {
-        return 1;
-    }
-}
-
-// Print a set of statistics (avg, median, max, min) for degree and
-// support percentage in the pinch graph.
-static void printThreadSetStatistics(stPinchThreadSet *threadSet, Flower *flower, FILE *f)
-{
-    // Naively finds the max, median, and min by sorting: the lists
-    // will have "only" millions of elements, so they should fit
-    // comfortably into tens of MB of memory.
-
-    uint64_t numBlocks = stPinchThreadSet_getTotalBlockNumber(threadSet);
-
-    uint64_t *blockDegrees = malloc(numBlocks * sizeof(uint64_t));
-    double totalDegree = 0.0;
-    double *blockSupports = malloc(numBlocks * sizeof(double));
-    double totalSupport = 0.0;
-
-    uint64_t totalAlignedBases = 0;
-
-    stPinchThreadSetBlockIt it = stPinchThreadSet_getBlockIt(threadSet);
-    uint64_t i = 0;
-    stPinchBlock *block;
-    while ((block = stPinchThreadSetBlockIt_getNext(&it)) != NULL) {
-        blockDegrees[i] = stPinchBlock_getDegree(block);
-        totalDegree += stPinchBlock_getDegree(block);
-        uint64_t supportingHomologies = stPinchBlock_getNumSupportingHomologies(block);
-        uint64_t possibleSupportingHomologies = numPossibleSupportingHomologies(block, flower);
-        double support = 0.0;
-        if (possibleSupportingHomologies != 0) {
-            support = ((double) supportingHomologies) / possibleSupportingHomologies;
-        }
-        blockSupports[i] = support;
-        totalSupport += support;
-
-        totalAlignedBases += stPinchBlock_getLength(block) * stPinchBlock_getDegree(block);
-
-        i++;
-    }
-
-    fprintf(f, "There were %" PRIu64 " blocks in the sequence graph, representing %" PRIi64
-    " total aligned bases\n", numBlocks, totalAlignedBases);
-
-    qsort(blockDegrees, numBlocks, sizeof(uint64_t),
-          (int (*)(const void *, const void *)) uint64_cmp);
-    qsort(blockSupports, numBlocks, sizeof(double),
-          (int (*)(const void *, const void *)) double_cmp);
-    fprintf(f, "Block degree stats: min %" PRIu64 ", avg %lf, median %" PRIu64 ", max %" PRIu64 "\n",
-            blockDegrees[0], totalDegree/numBlocks, blockDegrees[(numBlocks - 1) / 2],
-            blockDegrees[numBlocks - 1]);
-    fprintf(f, "Block support stats: min %lf, avg %lf, median %lf, max %lf\n",
-           blockSupports[0], totalSupport/numBlocks, blockSupports[(numBlocks - 1) / 2],
-           blockSupports[numBlocks - 1]);
-    free(blockDegrees);
-    free(blockSupports);
-}
-
 void caf(Flower *flower, CactusParams *params, char *alignmentsFile, char *secondaryAlignmentsFile, char *constraintsFile,
          Event *referenceEvent) {
     //////////////////////////////////////////////
@@ -224,6 +107,9 @@ void caf(Flower *flower, CactusParams *params, char *alignmentsFile, char *secon
     int64_t minimumBlockDegreeToCheckSupport = cactusParams_get_int(params, 2, "caf", "minimumBlockDegreeToCheckSupport");
     double minimumBlockHomologySupport = cactusParams_get_float(params, 2, "caf", "minimumBlockHomologySupport");
 
+    // The memory, in bytes, used to sort the alignments by score for the order dependent filters
+    int64_t alignmentSortMemory = cactusParams_get_int(params, 2, "caf", "alignmentSortMemory");
+
     // Setting the alignment filters
     char *alignmentFilter = (char *)cactusParams_get_string(params, 2, "caf", "alignmentFilter");
     bool sortAlignments = false;
@@ -316,7 +202,7 @@ void caf(Flower *flower, CactusParams *params, char *alignmentsFile, char *secon
 
     stPinchIterator *pinchIteratorForConstraints = NULL;
     if (constraintsFile != NULL) {
-        pinchIteratorForConstraints = stPinchIterator_constructFromFile(constraintsFile);
+        pinchIteratorForConstraints = stPinchIterator_constructFromBinaryFile(constraintsFile);
         st_logDebug("Created an iterator for the alignment constaints from file: %s\n", constraintsFile);
     }
 
@@ -336,6 +222,9 @@ void caf(Flower *flower, CactusParams *params, char *alignmentsFile, char *secon
         //Build the set of outgroup threads
         stSet *outgroupThreads = stCaf_getOutgroupThreads(flower, threadSet);
 
+        //Index the events of the threads for the filters
+        stCaf_constructThreadEventIndex(flower, threadSet);
+
         // Set the single copy event
         if (singleCopyEventName != NULL) {
             stCaf_setSingleCopyEvent(flower, singleCopyEventName);
@@ -351,34 +240,44 @@ void caf(Flower *flower, CactusParams *params, char *alignmentsFile, char *secon
         stList *alignmentsList = NULL;
         assert(alignmentsFile != NULL);
 
+        // The sorted files are made once and replayed by each annealing round
         if (sortAlignments) {
             tempFile1 = getTempFile();
-            //stCaf_sortCigarsFileByScoreInDescendingOrder(alignmentsFile, tempFile1);
-            pinchIterator = stPinchIterator_constructFromFile(tempFile1);
+            cactusProfiler_startStage("sortAlignments");
+            stPinchIterator_sortBinaryFileByScore(alignmentsFile, tempFile1, alignmentSortMemory);
+            cactusProfiler_endStage();
+            pinchIterator = stPinchIterator_constructFromBinaryFile(tempFile1);
         } else {
-            pinchIterator = stPinchIterator_constructFromFile(alignmentsFile);
+            pinchIterator = stPinchIterator_constructFromBinaryFile(alignmentsFile);
         }
 
         if(secondaryAlignmentsFile != NULL) {
             if (sortSecondaryAlignments) {
                 tempFile2 = getTempFile();
-                //stCaf_sortCigarsFileByScoreInDescendingOrder(secondaryAlignmentsFile, tempFile2);
-                secondaryPinchIterator = stPinchIterator_constructFromFile(tempFile2);
+                cactusProfiler_startStage("sortSecondaryAlignments");
+                stPinchIterator_sortBinaryFileByScore(secondaryAlignmentsFile, tempFile2, alignmentSortMemory);
+                cactusProfiler_endStage();
+                secondaryPinchIterator = stPinchIterator_constructFromBinaryFile(tempFile2);
             } else {
-                secondaryPinchIterator = stPinchIterator_constructFromFile(secondaryAlignmentsFile);
+                secondaryPinchIterator = stPinchIterator_constructFromBinaryFile(secondaryAlignmentsFile);
             }
         }
 
+        int64_t alignedBases = -1;
         for (int64_t annealingRound = 0; annealingRound < annealingRoundsLength; annealingRound++) {
             int64_t minimumChainLength = annealingRounds[annealingRound];
             int64_t alignmentTrim = annealingRound < alignmentTrimLength ? alignmentTrims[annealingRound] : 0;
             st_logInfo("Starting annealing round with a minimum chain length of %" PRIi64 " and an alignment trim of %" PRIi64 "\n", minimumChainLength, alignmentTrim);
 
+            cactusProfiler_startStage("annealingRound %" PRIi64 "", annealingRound);
+            stCaf_startRound();
             stPinchIterator_setTrim(pinchIterator, alignmentTrim);
             if(secondaryPinchIterator != NULL) {
                 stPinchIterator_setTrim(secondaryPinchIterator, alignmentTrim);
             }
 
+            stCaf_clearBlockSpeciesCache();
+
             //Add back in the constraints
             if (pinchIteratorForConstraints != NULL) {
                 stCaf_anneal(threadSet, pinchIteratorForConstraints, NULL, flower);
@@ -401,8 +300,13 @@ void caf(Flower *flower, CactusParams *params, char *alignmentsFile, char *secon
             }
 
             st_logInfo("Sequence graph statistics after annealing:\n");
-            printThreadSetStatistics(threadSet, flower, stderr);
+            alignedBases = stCaf_reportRound(threadSet, flower, "annealing", annealingRound, minimumChainLength, -1, 0);
+            cactusProfiler_endStage();
 
+            //Do the melting rounds, starting with the removal of poorly supported megablocks
+            cactusProfiler_startStage("meltingRound %" PRIi64 "", annealingRound);
+            stCaf_startRound();
+            int64_t num_megablocks_destroyed = 0;
             if (minimumBlockHomologySupport > 0) {
                 // Check for poorly-supported blocks--those that have
                 // been transitively aligned together but with very
@@ -410,57 +314,79 @@ void caf(Flower *flower, CactusParams *params, char *alignmentsFile, char *secon
                 // alignment. These "megablocks" can snarl up the
                 // graph so that a lot of extra gets thrown away in
                 // the first melting step.
-                stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
-                stPinchBlock *block;
-                int64_t num_megablocks_destroyed = 0;
+                // Compute the support of the blocks in parallel, then destroy the megablocks serially
+                int64_t blockNumber;
+                stPinchBlock **blocks = stCaf_getBlockArray(threadSet, &blockNumber);
+                uint64_t *possibleSupportingHomologies = st_calloc(blockNumber + 1, sizeof(uint64_t));
+                if (minimumBlockDegreeToCheckSupport > 0) {
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic, 64)
+#endif
+                    for (int64_t i = 0; i < blockNumber; i++) {
+                        if (stPinchBlock_getDegree(blocks[i]) > minimumBlockDegreeToCheckSupport) {
+                            possibleSupportingHomologies[i] = stCaf_numPossibleSupportingHomologies(blocks[i], flower);
+                        }
+                    }
+                }
                 int64_t num_homologies_destroyed = 0;
-                while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
+                for (int64_t i = 0; i < blockNumber; i++) {
+                    stPinchBlock *block = blocks[i];
                     if (minimumBlockDegreeToCheckSupport > 0 && stPinchBlock_getDegree(block) > minimumBlockDegreeToCheckSupport) {
                         uint64_t supportingHomologies = stPinchBlock_getNumSupportingHomologies(block);
-                        uint64_t possibleSupportingHomologies = numPossibleSupportingHomologies(block, flower);
-                        double support = ((double) supportingHomologies) / possibleSupportingHomologies;
+                        double support = ((double) supportingHomologies) / possibleSupportingHomologies[i];
                         if (support < minimumBlockHomologySupport) {
                             st_logDebug("Destroyed a megablock with degree %" PRIi64
                             " and %" PRIi64 " supporting homologies out of a maximum "
                                             "of %" PRIi64 " (%lf%%).\n", stPinchBlock_getDegree(block),
-                                    supportingHomologies, possibleSupportingHomologies, support);
+                                    supportingHomologies, possibleSupportingHomologies[i], support);
                             stPinchBlock_destruct(block);
                             ++num_megablocks_destroyed;
                             num_homologies_destroyed += supportingHomologies;
                         }
                     }
                 }
+                free(blocks);
+                free(possibleSupportingHomologies);
                 if (num_megablocks_destroyed > 0) {
                   st_logInfo("Destroyed %" PRIi64 " megablocks with a total of %" PRIi64 " supporting homologies\n",
                              num_megablocks_destroyed, num_homologies_destroyed);
                 }
             }
 
-            //Do the melting rounds
-            for (int64_t meltingRound = 0; meltingRound < meltingRoundsLength; meltingRound++) {
-                int64_t minimumChainLengthForMeltingRound = meltingRounds[meltingRound];
-                st_logInfo("Starting melting round with a minimum chain length of %" PRIi64 " \n", minimumChainLengthForMeltingRound);
-                if (minimumChainLengthForMeltingRound >= minimumChainLength) {
-                    break;
-                }
-                stCaf_melt(flower, threadSet, NULL, NULL, 0, minimumChainLengthForMeltingRound, 0, INT64_MAX);
-            } st_logDebug("Last melting round of cycle with a minimum chain length of %" PRIi64 " \n", minimumChainLength);
+            int64_t meltingRoundNumber = 0;
+            while (meltingRoundNumber < meltingRoundsLength && meltingRounds[meltingRoundNumber] < minimumChainLength) {
+                st_logInfo("Starting melting round with a minimum chain length of %" PRIi64 " \n", meltingRounds[meltingRoundNumber]);
+                meltingRoundNumber++;
+            }
+            stCaf_meltRounds(flower, threadSet, meltingRounds, meltingRoundNumber);
+            st_logDebug("Last melting round of cycle with a minimum chain length of %" PRIi64 " \n", minimumChainLength);
             stCaf_melt(flower, threadSet, NULL, NULL, 0, minimumChainLength, breakChainsAtReverseTandems, maximumMedianSequenceLengthBetweenLinkedEnds);
             //This does the filtering of blocks that do not have the required species/tree-coverage/degree.
+            stCaf_clearBlockSpeciesCache();
             stCaf_melt(flower, threadSet, blockFilterFn, fa, blockTrim, 0, 0, INT64_MAX);
+            // The statistics are a pass over every block, so are only gathered each round when asked for
+            if (stCaf_isTelemetryEnabled() || st_getLogLevel() == debug) {
+                st_logInfo("Sequence graph statistics after melting:\n");
+                alignedBases = stCaf_reportRound(threadSet, flower, "melting", annealingRound, minimumChainLength,
+                                                 alignedBases, num_megablocks_destroyed);
+            }
+            cactusProfiler_endStage();
         }
 
+        stCaf_startRound();
         if (removeRecoverableChains) {
+            stCaf_clearBlockSpeciesCache();
             stCaf_meltRecoverableChains(flower, threadSet, breakChainsAtReverseTandems, maximumMedianSequenceLengthBetweenLinkedEnds, recoverableChainsFilter, maxRecoverableChainsIterations, maxRecoverableChainLength);
         }
 
         st_logInfo("Sequence graph statistics after melting:\n");
-        printThreadSetStatistics(threadSet, flower, stderr);
+        stCaf_reportRound(threadSet, flower, "final", annealingRoundsLength, 0, alignedBases, 0);
 
         //Sort out case when we allow blocks of degree 1
         if (fa->minimumDegree < 2) {
             st_logDebug("Creating degree 1 blocks\n");
             stCaf_makeDegreeOneBlocks(threadSet);
+            stCaf_clearBlockSpeciesCache();
             stCaf_melt(flower, threadSet, blockFilterFn, fa, blockTrim, 0, 0, INT64_MAX);
         } else if (maximumAdjacencyComponentSizeRatio < INT64_MAX) { //Deal with giant components
             st_logDebug("Breaking up components greedily\n");
@@ -468,10 +394,13 @@ void caf(Flower *flower, CactusParams *params, char *alignmentsFile, char *secon
         }
 
         //Finish up
+        cactusProfiler_startStage("finish");
         stCaf_finish(flower, threadSet, minLengthForChromosome, proportionOfUnalignedBasesForNewChromosome);
+        cactusProfiler_endStage();
         st_logDebug("Ran the cactus core script\n");
 
         //Cleanup
+        stCaf_destructThreadEventIndex();
         stPinchThreadSet_destruct(threadSet);
         stPinchIterator_destruct(pinchIterator);
         if(secondaryPinchIterator != NULL) {
@@ -7,12 +7,251 @@
  * Functions used for prefiltering the alignments.
  */
 
+/*
+ * A per-run index from pinch thread name to the event of the thread, so the filters, which are called for every
+ * pinch during annealing, don't binary search the caps of the flower for every segment they look at.
+ */
+
+typedef struct _threadEvent {
+    Name name; // NULL_NAME for an empty slot
+    Event *event;
+    bool isOutgroup;
+    int64_t speciesIndex; // Dense index of the event, in [0, speciesNumber)
+} ThreadEvent;
+
+typedef struct _threadEventIndex {
+    Flower *flower;
+    int64_t mask; // Table size - 1, the table size being a power of two, at least two
+    int64_t shift; // 64 - log2(table size)
+    ThreadEvent *table; // Open addressing, linear probing
+    int64_t speciesNumber;
+    int64_t speciesWords; // The number of 64 bit words in a species bit set
+    uint64_t *ingroupSpecies; // Bit set of the ingroup species
+    stHash *blockSpecies; // Cache from each block to the bit set of its species, see getBlockSpecies
+} ThreadEventIndex;
+
+static ThreadEventIndex *threadEventIndex = NULL;
+
+// Number of 64 bit words of a species set held on the stack, sets for more species are allocated
+#define SPECIES_SET_STACK_WORDS 16
+
+static int64_t threadEventIndex_getSlot(ThreadEventIndex *index, Name name) {
+    // The top bits of the product depend on all the bits of the name, the low ones only on its low bits
+    return (int64_t)(((uint64_t)name * 0x9E3779B97F4A7C15ULL) >> index->shift);
+}
+
+void stCaf_constructThreadEventIndex(Flower *flower, stPinchThreadSet *threadSet) {
+    stCaf_destructThreadEventIndex();
+    ThreadEventIndex *index = st_malloc(sizeof(ThreadEventIndex));
+    index->flower = flower;
+
+    // Give each event a dense index
+    EventTree *eventTree = flower_getEventTree(flower);
+    stHash *eventsToIndices = stHash_construct2(NULL, free);
+    EventTree_Iterator *eventIt = eventTree_getIterator(eventTree);
+    Event *event;
+    index->speciesNumber = 0;
+    while ((event = eventTree_getNext(eventIt)) != NULL) {
+        int64_t *i = st_malloc(sizeof(int64_t));
+        *i = index->speciesNumber++;
+        stHash_insert(eventsToIndices, event, i);
+    }
+    eventTree_destructIterator(eventIt);
+    index->speciesWords = (index->speciesNumber + 63) / 64;
+    index->ingroupSpecies = st_calloc(index->speciesWords, sizeof(uint64_t));
+    index->blockSpecies = stHash_construct2(NULL, free);
+
+    // Size the table to be at most half full
+    int64_t tableSize = 2;
+    index->shift = 63;
+    while (tableSize < 2 * stPinchThreadSet_getSize(threadSet)) {
+        tableSize *= 2;
+        index->shift--;
+    }
+    index->mask = tableSize - 1;
+    index->table = st_malloc(tableSize * sizeof(ThreadEvent));
+    for (int64_t i = 0; i < tableSize; i++) {
+        index->table[i].name = NULL_NAME;
+    }
+    stPinchThreadSetIt threadIt = stPinchThreadSet_getIt(threadSet);
+    stPinchThread *thread;
+    while ((thread = stPinchThreadSetIt_getNext(&threadIt)) != NULL) {
+        Name name = stPinchThread_getName(thread);
+        Cap *cap = flower_getCap(flower, name);
+        assert(cap != NULL);
+        int64_t i = threadEventIndex_getSlot(index, name);
+        while (index->table[i].name != NULL_NAME) {
+            i = (i + 1) & index->mask;
+        }
+        ThreadEvent *threadEvent = &index->table[i];
+        threadEvent->name = name;
+        threadEvent->event = cap_getEvent(cap);
+        threadEvent->isOutgroup = event_isOutgroup(threadEvent->event);
+        threadEvent->speciesIndex = *(int64_t *)stHash_search(eventsToIndices, threadEvent->event);
+        if (!threadEvent->isOutgroup) {
+            index->ingroupSpecies[threadEvent->speciesIndex / 64] |= ((uint64_t)1) << (threadEvent->speciesIndex % 64);
+        }
+    }
+    stHash_destruct(eventsToIndices);
+    threadEventIndex = index;
+}
+
+void stCaf_destructThreadEventIndex(void) {
+    if (threadEventIndex != NULL) {
+        free(threadEventIndex->table);
+        free(threadEventIndex->ingroupSpecies);
+        stHash_destruct(threadEventIndex->blockSpecies);
+        free(threadEventIndex);
+        threadEventIndex = NULL;
+    }
+}
+
+void stCaf_clearBlockSpeciesCache(void) {
+    if (threadEventIndex != NULL) {
+        stHash_destruct(threadEventIndex->blockSpecies);
+        threadEventIndex->blockSpecies = stHash_construct2(NULL, free);
+    }
+}
+
+/*
+ * Gets the entry of the segment's thread in the index, or NULL if there is no index for the flower or the thread
+ * is not in it.
+ */
+static ThreadEvent *getThreadEvent(stPinchSegment *segment, Flower *flower) {
+    if (threadEventIndex == NULL || threadEventIndex->flower != flower) {
+        return NULL;
+    }
+    Name name = stPinchSegment_getName(segment);
+    int64_t i = threadEventIndex_getSlot(threadEventIndex, name);
+    while (threadEventIndex->table[i].name != name) {
+        if (threadEventIndex->table[i].name == NULL_NAME) {
+            return NULL;
+        }
+        i = (i + 1) & threadEventIndex->mask;
+    }
+    return &threadEventIndex->table[i];
+}
+
 Event *stCaf_getEvent(stPinchSegment *segment, Flower *flower) {
+    ThreadEvent *threadEvent = getThreadEvent(segment, flower);
+    if (threadEvent != NULL) {
+        return threadEvent->event;
+    }
     Event *event = cap_getEvent(flower_getCap(flower, stPinchSegment_getName(segment)));
     assert(event != NULL);
     return event;
 }
 
+bool stCaf_isOutgroupSegment(stPinchSegment *segment, Flower *flower) {
+    ThreadEvent *threadEvent = getThreadEvent(segment, flower);
+    return threadEvent != NULL ? threadEvent->isOutgroup : event_isOutgroup(stCaf_getEvent(segment, flower));
+}
+
+static uint64_t choose2(uint64_t n) {
+    return n <= 1 ? 0 : n * (n - 1) / 2;
+}
+
+uint64_t stCaf_numPossibleSupportingHomologies(stPinchBlock *block, Flower *flower) {
+    uint64_t outgroupDegree = 0, ingroupDegree = 0;
+    stPinchBlockIt segIt = stPinchBlock_getSegmentIterator(block);
+    stPinchSegment *segment;
+    while ((segment = stPinchBlockIt_getNext(&segIt)) != NULL) {
+        if (stCaf_isOutgroupSegment(segment, flower)) {
+            outgroupDegree++;
+        } else {
+            ingroupDegree++;
+        }
+    }
+    assert(outgroupDegree + ingroupDegree == stPinchBlock_getDegree(block));
+    // We do the ingroup-ingroup alignments as an all-against-all
+    // alignment, so we can see each ingroup-ingroup homology up to
+    // twice.
+    return choose2(ingroupDegree) * 2 + ingroupDegree * outgroupDegree;
+}
+
+/*
+ * A set of species, as a bit set over the species indices of the thread event index.
+ */
+typedef struct _speciesSet {
+    uint64_t *bits;
+    uint64_t stackBits[SPECIES_SET_STACK_WORDS];
+} SpeciesSet;
+
+static void speciesSet_init(SpeciesSet *speciesSet) {
+    int64_t words = threadEventIndex->speciesWords;
+    speciesSet->bits = words <= SPECIES_SET_STACK_WORDS ? speciesSet->stackBits : st_malloc(words * sizeof(uint64_t));
+    memset(speciesSet->bits, 0, words * sizeof(uint64_t));
+}
+
+static void speciesSet_clear(SpeciesSet *speciesSet) {
+    if (speciesSet->bits != speciesSet->stackBits) {
+        free(speciesSet->bits);
+    }
+}
+
+/*
+ * Gets the bit set of the species of the segments in the block. The sets are cached per block and recomputed only
+ * when the block's modified flag is set, which the pinch graph does when it adds segments to a block, including
+ * when it merges two blocks. Splitting a block leaves the species of both halves unchanged, and new blocks start
+ * out modified, so the cache stays correct across the splits, merges and block reuse done while annealing. The
+ * cache owns the modified flag while the index exists. Entries are not dropped when their blocks are destroyed, so
+ * the cache is cleared by stCaf_clearBlockSpeciesCache before each pass of the filters.
+ */
+static uint64_t *getBlockSpecies(stPinchBlock *block, Flower *flower) {
+    uint64_t *species = stHash_search(threadEventIndex->blockSpecies, block);
+    if (species != NULL && !stPinchBlock_getModifiedFlag(block)) {
+        return species;
+    }
+    if (species == NULL) {
+        species = st_malloc(threadEventIndex->speciesWords * sizeof(uint64_t));
+        stHash_insert(threadEventIndex->blockSpecies, block, species);
+    }
+    memset(species, 0, threadEventIndex->speciesWords * sizeof(uint64_t));
+    stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
+    stPinchSegment *segment;
+    while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
+        ThreadEvent *threadEvent = getThreadEvent(segment, flower);
+        assert(threadEvent != NULL);
+        species[threadEvent->speciesIndex / 64] |= ((uint64_t)1) << (threadEvent->speciesIndex % 64);
+    }
+    stPinchBlock_setModifiedFlag(block, false);
+    return species;
+}
+
+/*
+ * Gets the bit set of the species of the segment's block, or, if it has no block, of the segment, written into
+ * the given set.
+ */
+static uint64_t *getSpecies(stPinchSegment *segment, Flower *flower, SpeciesSet *speciesSet) {
+    stPinchBlock *block = stPinchSegment_getBlock(segment);
+    if (block != NULL) {
+        return getBlockSpecies(block, flower);
+    }
+    ThreadEvent *threadEvent = getThreadEvent(segment, flower);
+    assert(threadEvent != NULL);
+    speciesSet->bits[threadEvent->speciesIndex / 64] |= ((uint64_t)1) << (threadEvent->speciesIndex % 64);
+    return speciesSet->bits;
+}
+
+/*
+ * Returns true if the two segments, or their blocks, share a species (an ingroup species if ingroupOnly is true),
+ * using the thread event index.
+ */
+static bool shareSpecies(stPinchSegment *segment1, stPinchSegment *segment2, Flower *flower, bool ingroupOnly) {
+    SpeciesSet speciesSet1, speciesSet2;
+    speciesSet_init(&speciesSet1);
+    speciesSet_init(&speciesSet2);
+    uint64_t *species1 = getSpecies(segment1, flower, &speciesSet1);
+    uint64_t *species2 = getSpecies(segment2, flower, &speciesSet2);
+    bool b = 0;
+    for (int64_t i = 0; i < threadEventIndex->speciesWords && !b; i++) {
+        b = (species1[i] & species2[i] & (ingroupOnly ? threadEventIndex->ingroupSpecies[i] : ~((uint64_t)0))) != 0;
+    }
+    speciesSet_clear(&speciesSet1);
+    speciesSet_clear(&speciesSet2);
+    return b;
+}
+
 /*
  * Filtering by presence of outgroup. This code is efficient and scales linearly with depth.
  */
@@ -21,7 +260,7 @@ static bool containsOutgroupSegment(stPinchBlock *block, Flower *flower) {
     stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
     stPinchSegment *segment;
     while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
-        if (event_isOutgroup(stCaf_getEvent(segment, flower))) {
+        if (stCaf_isOutgroupSegment(segment, flower)) {
             stPinchSegment_putSegmentFirstInBlock(segment);
             assert(stPinchBlock_getFirst(block) == segment);
             return 1;
@@ -30,14 +269,6 @@ static bool containsOutgroupSegment(stPinchBlock *block, Flower *flower) {
     return 0;
 }
 
-static bool isOutgroupSegment(stPinchSegment *segment, Flower *flower) {
-    if (event_isOutgroup(stCaf_getEvent(segment, flower))) {
-        return 1;
-    } else {
-        return 0;
-    }
-}
-
 bool stCaf_filterByOutgroup(stPinchSegment *segment1,
                             stPinchSegment *segment2, Flower *flower) {
     stPinchBlock *block1, *block2;
@@ -51,12 +282,12 @@ bool stCaf_filterByOutgroup(stPinchSegment *segment1,
             }
             return containsOutgroupSegment(block2, flower) && containsOutgroupSegment(block1, flower);
         }
-        return isOutgroupSegment(segment2, flower) && containsOutgroupSegment(block1, flower);
+        return stCaf_isOutgroupSegment(segment2, flower) && containsOutgroupSegment(block1, flower);
     }
     if ((block2 = stPinchSegment_getBlock(segment2)) != NULL) {
-        return isOutgroupSegment(segment1, flower) && containsOutgroupSegment(block2, flower);
+        return stCaf_isOutgroupSegment(segment1, flower) && containsOutgroupSegment(block2, flower);
     }
-    return isOutgroupSegment(segment1, flower) && isOutgroupSegment(segment2, flower);
+    return stCaf_isOutgroupSegment(segment1, flower) && stCaf_isOutgroupSegment(segment2, flower);
 }
 
 bool stCaf_relaxedFilterByOutgroup(stPinchSegment *segment1,
@@ -79,7 +310,9 @@ bool stCaf_relaxedFilterByOutgroup(stPinchSegment *segment1,
 }
 
 /*
- * Filtering by presence of repeat species in block. This code is inefficient and does not scale.
+ * Filtering by presence of repeat species in block. With the thread event index this intersects the cached species
+ * bit sets of the blocks. Without it a sorted set of events is built for each block on every call, which is
+ * inefficient and does not scale.
  */
 
 static bool checkIntersection(stSortedSet *names1, stSortedSet *names2) {
@@ -110,6 +343,14 @@ static bool containsMoreThanOneEvent(stPinchSegment *segment, Flower *flower) {
         return false;
     }
     stPinchBlock *block = stPinchSegment_getBlock(segment);
+    if (getThreadEvent(segment, flower) != NULL) {
+        uint64_t *species = getBlockSpecies(block, flower);
+        int64_t speciesNumber = 0;
+        for (int64_t i = 0; i < threadEventIndex->speciesWords && speciesNumber < 2; i++) {
+            speciesNumber += __builtin_popcountll(species[i]);
+        }
+        return speciesNumber > 1;
+    }
     if(!stPinchBlock_getModifiedFlag(block)) {
         return stPinchBlock_getFilterFlag(block);
     }
@@ -157,6 +398,9 @@ bool stCaf_filterByMultipleSpecies(stPinchSegment *segment1,
 
 bool stCaf_filterByRepeatSpecies(stPinchSegment *segment1,
                                  stPinchSegment *segment2, Flower *flower) {
+    if (getThreadEvent(segment1, flower) != NULL) {
+        return shareSpecies(segment1, segment2, flower, 0);
+    }
     return checkIntersection(getEvents(segment1, flower), getEvents(segment2, flower));
 }
 
@@ -164,7 +408,7 @@ bool stCaf_relaxedFilterByRepeatSpecies(stPinchSegment *segment1,
                                         stPinchSegment *segment2, Flower *flower) {
     return stPinchSegment_getBlock(segment1) != NULL
         && stPinchSegment_getBlock(segment2) != NULL
-        && checkIntersection(getEvents(segment1, flower), getEvents(segment2, flower));
+        && stCaf_filterByRepeatSpecies(segment1, segment2, flower);
 }
 
 static Event* singleCopyEvent = NULL;
@@ -178,19 +422,27 @@ void stCaf_setSingleCopyEvent(Flower* flower, char *singleCopyEventName) {
     }
 }
 
-bool stCaf_filterBySingleCopyEvent(stPinchSegment *segment1,
-                                   stPinchSegment *segment2, Flower *flower) {
-    bool b = false;
-    if (singleCopyEvent != NULL) {
-        stSortedSet *names1 = getEvents(segment1, flower);
-        if (stSortedSet_search(names1, singleCopyEvent) != NULL) {
-            stSortedSet *names2 = getEvents(segment2, flower);
-            b = stSortedSet_search(names2, singleCopyEvent) != NULL;
-            stSortedSet_destruct(names2);
+/*
+ * Returns true if the segment, or a segment in its block, is from the given event.
+ */
+static bool containsEvent(stPinchSegment *segment, Flower *flower, Event *event) {
+    stPinchBlock *block = stPinchSegment_getBlock(segment);
+    if (block == NULL) {
+        return stCaf_getEvent(segment, flower) == event;
+    }
+    stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
+    while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
+        if (stCaf_getEvent(segment, flower) == event) {
+            return 1;
         }
-        stSortedSet_destruct(names1);
     }
-    return b;
+    return 0;
+}
+
+bool stCaf_filterBySingleCopyEvent(stPinchSegment *segment1,
+                                   stPinchSegment *segment2, Flower *flower) {
+    return singleCopyEvent != NULL && containsEvent(segment1, flower, singleCopyEvent)
+           && containsEvent(segment2, flower, singleCopyEvent);
 }
 
 static stSortedSet *getChrNames(stPinchSegment *segment, Flower *flower) {
@@ -222,15 +474,13 @@ static stSortedSet *getIngroupEvents(stPinchSegment *segment, Flower *flower) {
         stPinchBlock *block = stPinchSegment_getBlock(segment);
         stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
         while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
-            Event *event = stCaf_getEvent(segment, flower);
-            if (!event_isOutgroup(event)) {
-                stSortedSet_insert(events, event);
+            if (!stCaf_isOutgroupSegment(segment, flower)) {
+                stSortedSet_insert(events, stCaf_getEvent(segment, flower));
             }
         }
     } else {
-        Event *event = stCaf_getEvent(segment, flower);
-        if (!event_isOutgroup(event)) {
-            stSortedSet_insert(events, event);
+        if (!stCaf_isOutgroupSegment(segment, flower)) {
+            stSortedSet_insert(events, stCaf_getEvent(segment, flower));
         }
     }
     return events;
@@ -238,6 +488,9 @@ static stSortedSet *getIngroupEvents(stPinchSegment *segment, Flower *flower) {
 
 bool stCaf_singleCopyIngroup(stPinchSegment *segment1,
                              stPinchSegment *segment2, Flower *flower) {
+    if (getThreadEvent(segment1, flower) != NULL) {
+        return shareSpecies(segment1, segment2, flower, 1);
+    }
     return checkIntersection(getIngroupEvents(segment1, flower), getIngroupEvents(segment2, flower));
 }
 
@@ -245,7 +498,7 @@ bool stCaf_relaxedSingleCopyIngroup(stPinchSegment *segment1,
                                     stPinchSegment *segment2, Flower *flower) {
     return stPinchSegment_getBlock(segment1) != NULL
         && stPinchSegment_getBlock(segment2) != NULL
-        && checkIntersection(getIngroupEvents(segment1, flower), getIngroupEvents(segment2, flower));
+        && stCaf_singleCopyIngroup(segment1, segment2, flower);
 }
 
 /*
@@ -439,25 +692,45 @@ bool stCaf_containsRequiredSpecies(stPinchBlock *pinchBlock,
                                    int64_t minimumOutgroupDegree,
                                    int64_t minimumDegree,
                                    int64_t minimumNumberOfSpecies) {
-    stSet *seenEvents = stSet_construct();
     int64_t numberOfSpecies = 0;
     int64_t outgroupSequences = 0;
     int64_t ingroupSequences = 0;
     stPinchBlockIt segmentIt = stPinchBlock_getSegmentIterator(pinchBlock);
     stPinchSegment *segment;
-    while ((segment = stPinchBlockIt_getNext(&segmentIt)) != NULL) {
-        Event *event = stCaf_getEvent(segment, flower);
-        if (!stSet_search(seenEvents, event)) {
-            stSet_insert(seenEvents, event);
-            numberOfSpecies++;
+    if (getThreadEvent(stPinchBlock_getFirst(pinchBlock), flower) != NULL) {
+        // Count the species with a bit set over the species indices
+        SpeciesSet seenSpecies;
+        speciesSet_init(&seenSpecies);
+        while ((segment = stPinchBlockIt_getNext(&segmentIt)) != NULL) {
+            ThreadEvent *threadEvent = getThreadEvent(segment, flower);
+            uint64_t bit = ((uint64_t)1) << (threadEvent->speciesIndex % 64);
+            if (!(seenSpecies.bits[threadEvent->speciesIndex / 64] & bit)) {
+                seenSpecies.bits[threadEvent->speciesIndex / 64] |= bit;
+                numberOfSpecies++;
+            }
+            if (threadEvent->isOutgroup) {
+                outgroupSequences++;
+            } else {
+                ingroupSequences++;
+            }
         }
-        if (event_isOutgroup(event)) {
-            outgroupSequences++;
-        } else {
-            ingroupSequences++;
+        speciesSet_clear(&seenSpecies);
+    } else {
+        stSet *seenEvents = stSet_construct();
+        while ((segment = stPinchBlockIt_getNext(&segmentIt)) != NULL) {
+            Event *event = stCaf_getEvent(segment, flower);
+            if (!stSet_search(seenEvents, event)) {
+                stSet_insert(seenEvents, event);
+                numberOfSpecies++;
+            }
+            if (event_isOutgroup(event)) {
+                outgroupSequences++;
+            } else {
+                ingroupSequences++;
+            }
         }
+        stSet_destruct(seenEvents);
     }
-    stSet_destruct(seenEvents);
     return ingroupSequences >= minimumIngroupDegree &&
         outgroupSequences >= minimumOutgroupDegree &&
         outgroupSequences + ingroupSequences >= minimumDegree &&
@@ -4,6 +4,10 @@
 #include "stCactusGraphs.h"
 #include "stCaf.h"
 
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
 ///////////////////////////////////////////////////////////////////////////
 // Convert the complete cactus graph/pinch graph into filled out set of flowers
 ///////////////////////////////////////////////////////////////////////////
@@ -181,8 +185,28 @@ static stList *makeEmptyFlowers(stCactusNode *cactusNode, Flower *flower, stPinc
 
 //Functions for going from cactus/pinch ends to flower ends and updating flower structure as necessary
 
-static End *convertPinchBlockEndToEnd(stPinchEnd *pinchEnd, stHash *pinchEndsToEnds, Flower *flower) {
-    End *end = stHash_search(pinchEndsToEnds, pinchEnd);
+/*
+ * The map from pinch ends to ends used while filling out the flowers. The nested flowers of the root flower are
+ * filled out in parallel, each with its own map for the blocks it creates, falling back to the map of the root, which
+ * is only read once the root flower is complete.
+ */
+typedef struct _endMap {
+    stHash *pinchEndsToEnds;
+    struct _endMap *parent; // Searched for pinch ends not in this map, or NULL
+} EndMap;
+
+static End *endMap_search(EndMap *endMap, stPinchEnd *pinchEnd) {
+    for (; endMap != NULL; endMap = endMap->parent) {
+        End *end = stHash_search(endMap->pinchEndsToEnds, pinchEnd);
+        if (end != NULL) {
+            return end;
+        }
+    }
+    return NULL;
+}
+
+static End *convertPinchBlockEndToEnd(stPinchEnd *pinchEnd, EndMap *endMap, Flower *flower) {
+    End *end = endMap_search(endMap, pinchEnd);
     if (end == NULL) { //Happens if pinch end represents end of a block in flower that has not yet been defined.
         return NULL;
     }
@@ -192,18 +216,18 @@ static End *convertPinchBlockEndToEnd(stPinchEnd *pinchEnd, stHash *pinchEndsToE
     return end_getOrientation(end) ? end2 : end_getReverse(end2);
 }
 
-static End *convertCactusEdgeEndToEnd(stCactusEdgeEnd *cactusEdgeEnd, stHash *pinchEndsToEnds, Flower *flower) {
-    return convertPinchBlockEndToEnd(stCactusEdgeEnd_getObject(cactusEdgeEnd), pinchEndsToEnds, flower);
+static End *convertCactusEdgeEndToEnd(stCactusEdgeEnd *cactusEdgeEnd, EndMap *endMap, Flower *flower) {
+    return convertPinchBlockEndToEnd(stCactusEdgeEnd_getObject(cactusEdgeEnd), endMap, flower);
 }
 
 //Functions to create blocks
 
-static void makeBlockP(stPinchEnd *pinchEnd, End *end, stHash *pinchEndsToEnds) {
-    assert(stHash_search(pinchEndsToEnds, pinchEnd) == NULL);
-    stHash_insert(pinchEndsToEnds, stPinchEnd_construct(stPinchEnd_getBlock(pinchEnd), stPinchEnd_getOrientation(pinchEnd)), end);
+static void makeBlockP(stPinchEnd *pinchEnd, End *end, EndMap *endMap) {
+    assert(endMap_search(endMap, pinchEnd) == NULL);
+    stHash_insert(endMap->pinchEndsToEnds, stPinchEnd_construct(stPinchEnd_getBlock(pinchEnd), stPinchEnd_getOrientation(pinchEnd)), end);
 }
 
-static void makeBlock(stCactusEdgeEnd *cactusEdgeEnd, Flower *parentFlower, Flower *flower, stHash *pinchEndsToEnds) {
+static void makeBlock(stCactusEdgeEnd *cactusEdgeEnd, Flower *parentFlower, Flower *flower, EndMap *endMap) {
     stPinchEnd *pinchEnd = stCactusEdgeEnd_getObject(cactusEdgeEnd);
     assert(pinchEnd != NULL);
     stPinchBlock *pinchBlock = stPinchEnd_getBlock(pinchEnd);
@@ -225,27 +249,43 @@ static void makeBlock(stCactusEdgeEnd *cactusEdgeEnd, Flower *parentFlower, Flow
                 stPinchEnd_getOrientation(pinchEnd) ^ stPinchSegment_getBlockOrientation(pinchSegment) ? block_getReverse(block) : block,
                 stPinchSegment_getStart(pinchSegment), 1, sequence);
     }
-    makeBlockP(pinchEnd, block_get5End(block), pinchEndsToEnds);
+    makeBlockP(pinchEnd, block_get5End(block), endMap);
     stPinchEnd *otherPinchBlockEnd = stCactusEdgeEnd_getObject(stCactusEdgeEnd_getOtherEdgeEnd(cactusEdgeEnd));
-    makeBlockP(otherPinchBlockEnd, block_get3End(block), pinchEndsToEnds);
+    makeBlockP(otherPinchBlockEnd, block_get3End(block), endMap);
 }
 
 //Functions to generate the chains of a flower
 
+/*
+ * A nested flower whose ends have been added but that is yet to be filled out.
+ */
+typedef struct _nestedFlower {
+    stCactusNode *cactusNode;
+    Flower *flower;
+    bool orientation;
+    int64_t firstName; // The interval of names reserved for filling out the flower
+    int64_t nameNumber;
+} NestedFlower;
+
 static void fillOutFlowers(stCactusNode *cactusNode, Flower *flower, bool orientation, stPinchThreadSet *threadSet,
                            Flower *parentFlower, stList *deadEndComponent,
-                           stHash *pinchEndsToEnds, stHash *cactusNodesToFlowers);
+                           EndMap *endMap, stHash *cactusNodesToFlowers, stList *nestedFlowers);
 
+/*
+ * If nestedFlowers is not NULL the nested flowers are added to it to be filled out later, else they are
+ * filled out recursively.
+ */
 static void fillOutChain(stCactusEdgeEnd *cactusEdgeEnd, Flower *flower, bool orientation,
                          stPinchThreadSet *threadSet,  Flower *parentFlower, stList *deadEndComponent,
-                         stHash *pinchEndsToEnds, stHash *cactusNodesToFlowers, bool fillOutNestedFlowers) {
+                         EndMap *endMap, stHash *cactusNodesToFlowers, bool fillOutNestedFlowers,
+                         stList *nestedFlowers) {
     cactusEdgeEnd = stCactusEdgeEnd_getOtherEdgeEnd(cactusEdgeEnd);
     if (!stCactusEdgeEnd_isChainEnd(cactusEdgeEnd)) { //We have a non-trivial chain
         Chain *chain = fillOutNestedFlowers ? chain_construct(flower) : NULL;
         do {
             stCactusEdgeEnd *linkedCactusEdgeEnd = stCactusEdgeEnd_getLink(cactusEdgeEnd);
-            if (convertCactusEdgeEndToEnd(linkedCactusEdgeEnd, pinchEndsToEnds, flower) == NULL) { //Make subsequent block
-                makeBlock(linkedCactusEdgeEnd, parentFlower, flower, pinchEndsToEnds);
+            if (convertCactusEdgeEndToEnd(linkedCactusEdgeEnd, endMap, flower) == NULL) { //Make subsequent block
+                makeBlock(linkedCactusEdgeEnd, parentFlower, flower, endMap);
             }
 
             if(fillOutNestedFlowers) {
@@ -256,8 +296,8 @@ static void fillOutChain(stCactusEdgeEnd *cactusEdgeEnd, Flower *flower, bool or
                 assert(cactusNode == stCactusEdgeEnd_getNode(linkedCactusEdgeEnd));
                 Group *group = flower_getParentGroup(nestedFlower);
                 assert(group != NULL);
-                End *end1 = convertCactusEdgeEndToEnd(cactusEdgeEnd, pinchEndsToEnds, flower);
-                End *end2 = convertCactusEdgeEndToEnd(linkedCactusEdgeEnd, pinchEndsToEnds, flower);
+                End *end1 = convertCactusEdgeEndToEnd(cactusEdgeEnd, endMap, flower);
+                End *end2 = convertCactusEdgeEndToEnd(linkedCactusEdgeEnd, endMap, flower);
                 assert(end1 != NULL);
                 assert(end2 != NULL);
                 assert(end_getOrientation(end1));
@@ -290,8 +330,16 @@ static void fillOutChain(stCactusEdgeEnd *cactusEdgeEnd, Flower *flower, bool or
                 }
 
                 //Fill out stack
-                fillOutFlowers(cactusNode, nestedFlower, orientation, threadSet,
-                               parentFlower, deadEndComponent, pinchEndsToEnds, cactusNodesToFlowers);
+                if (nestedFlowers != NULL) {
+                    NestedFlower *n = st_malloc(sizeof(NestedFlower));
+                    n->cactusNode = cactusNode;
+                    n->flower = nestedFlower;
+                    n->orientation = orientation;
+                    stList_append(nestedFlowers, n);
+                } else {
+                    fillOutFlowers(cactusNode, nestedFlower, orientation, threadSet,
+                                   parentFlower, deadEndComponent, endMap, cactusNodesToFlowers, NULL);
+                }
             }
 
             cactusEdgeEnd = stCactusEdgeEnd_getOtherEdgeEnd(linkedCactusEdgeEnd);
@@ -301,41 +349,42 @@ static void fillOutChain(stCactusEdgeEnd *cactusEdgeEnd, Flower *flower, bool or
 
 static void fillOutChains(stCactusNode *cactusNode, Flower *flower, bool orientation,
                           stPinchThreadSet *threadSet,  Flower *parentFlower,
-                          stList *deadEndComponent, stHash *pinchEndsToEnds, stHash *cactusNodesToFlowers, bool fillOutNestedFlowers) {
+                          stList *deadEndComponent, EndMap *endMap, stHash *cactusNodesToFlowers, bool fillOutNestedFlowers,
+                          stList *nestedFlowers) {
     stCactusNodeEdgeEndIt cactusEdgeEndIt = stCactusNode_getEdgeEndIt(cactusNode);
     stCactusEdgeEnd *cactusEdgeEnd;
     while ((cactusEdgeEnd = stCactusNodeEdgeEndIt_getNext(&cactusEdgeEndIt))) {
         if (stCactusEdgeEnd_isChainEnd(cactusEdgeEnd) && stCactusEdgeEnd_getLinkOrientation(cactusEdgeEnd)) { //We have some sort of chain
-            End *end = convertCactusEdgeEndToEnd(cactusEdgeEnd, pinchEndsToEnds, flower);
+            End *end = convertCactusEdgeEndToEnd(cactusEdgeEnd, endMap, flower);
             stCactusEdgeEnd *linkedCactusEdgeEnd = stCactusEdgeEnd_getLink(cactusEdgeEnd), *startCactusEdgeEnd = NULL;
             assert(linkedCactusEdgeEnd != NULL);
             bool orientation2;
             if (end != NULL) {
 #ifndef NDEBUG
                 End *end2;
-                if ((end2 = convertCactusEdgeEndToEnd(linkedCactusEdgeEnd, pinchEndsToEnds, flower)) != NULL) {
+                if ((end2 = convertCactusEdgeEndToEnd(linkedCactusEdgeEnd, endMap, flower)) != NULL) {
                     assert(end_getSide(end) != end_getSide(end2));
                 }
 #endif
                 startCactusEdgeEnd = end_getSide(end) ? cactusEdgeEnd : linkedCactusEdgeEnd;
                 orientation2 = end_getSide(end);
             } else {
-                end = convertCactusEdgeEndToEnd(linkedCactusEdgeEnd, pinchEndsToEnds, flower);
+                end = convertCactusEdgeEndToEnd(linkedCactusEdgeEnd, endMap, flower);
                 if (end != NULL) {
                     if (end_getSide(end)) {
                         startCactusEdgeEnd = linkedCactusEdgeEnd;
                     } else {
-                        makeBlock(cactusEdgeEnd, parentFlower, flower, pinchEndsToEnds);
+                        makeBlock(cactusEdgeEnd, parentFlower, flower, endMap);
                         startCactusEdgeEnd = cactusEdgeEnd;
                     }
                     orientation2 = !end_getSide(end);
                 } else {
                     if(orientation) {
-                        makeBlock(cactusEdgeEnd, parentFlower, flower, pinchEndsToEnds);
+                        makeBlock(cactusEdgeEnd, parentFlower, flower, endMap);
                         startCactusEdgeEnd = cactusEdgeEnd;
                     }
                     else {
-                        makeBlock(linkedCactusEdgeEnd, parentFlower, flower, pinchEndsToEnds);
+                        makeBlock(linkedCactusEdgeEnd, parentFlower, flower, endMap);
                         startCactusEdgeEnd = linkedCactusEdgeEnd;
                     }
                     orientation2 = orientation;
@@ -343,9 +392,9 @@ static void fillOutChains(stCactusNode *cactusNode, Flower *flower, bool orienta
             }
             assert(startCactusEdgeEnd != NULL);
             fillOutChain(startCactusEdgeEnd, flower, orientation2, threadSet, parentFlower,
-                         deadEndComponent, pinchEndsToEnds, cactusNodesToFlowers, fillOutNestedFlowers);
+                         deadEndComponent, endMap, cactusNodesToFlowers, fillOutNestedFlowers, nestedFlowers);
             //fillOutChain(startCactusEdgeEnd, flower, orientation2, threadSet, parentFlower,
-            //             deadEndComponent, pinchEndsToEnds, cactusNodesToFlowers, 1);
+            //             deadEndComponent, endMap, cactusNodesToFlowers, 1);
         }
     }
 }
@@ -353,13 +402,13 @@ static void fillOutChains(stCactusNode *cactusNode, Flower *flower, bool orienta
 /*
  * Adds in groups for the tangles (groups not contained as a link in a chain) in the flower.
  */
-static void makeTangles(stCactusNode *cactusNode, Flower *flower, stHash *pinchEndsToEnds, stList *deadEndComponent) {
+static void makeTangles(stCactusNode *cactusNode, Flower *flower, EndMap *endMap, stList *deadEndComponent) {
     stList *adjacencyComponents = stCactusNode_getObject(cactusNode);
     for (int64_t i = 0; i < stList_length(adjacencyComponents); i++) {
         stList *adjacencyComponent = stList_get(adjacencyComponents, i);
         if (adjacencyComponent != deadEndComponent) {
             if (stList_length(adjacencyComponent) == 1) { //Deal with components for dead ends of free stubs
-                End *end = convertPinchBlockEndToEnd(stList_get(adjacencyComponent, 0), pinchEndsToEnds, flower);
+                End *end = convertPinchBlockEndToEnd(stList_get(adjacencyComponent, 0), endMap, flower);
                 assert(end != NULL);
                 if (!end_getOrientation(end)) {
                     continue;
@@ -367,7 +416,7 @@ static void makeTangles(stCactusNode *cactusNode, Flower *flower, stHash *pinchE
             }
             Group *group = group_construct2(flower);
             for (int64_t j = 0; j < stList_length(adjacencyComponent); j++) {
-                End *end = convertPinchBlockEndToEnd(stList_get(adjacencyComponent, j), pinchEndsToEnds, flower);
+                End *end = convertPinchBlockEndToEnd(stList_get(adjacencyComponent, j), endMap, flower);
                 assert(end != NULL);
                 assert(end_getOrientation(end));
                 assert(end_getGroup(end) == NULL);
@@ -384,16 +433,18 @@ static void makeTangles(stCactusNode *cactusNode, Flower *flower, stHash *pinchE
 }
 
 /*
- * Adds in the chains and completes the groups for the flower and its nested flowers, recursively.
+ * Adds in the chains and completes the groups for the flower and its nested flowers, recursively. If nestedFlowers
+ * is not NULL the immediately nested flowers are instead added to it, with their ends, to be filled out later.
  */
 static void fillOutFlowers(stCactusNode *cactusNode, Flower *flower, bool orientation, stPinchThreadSet *threadSet,
-                           Flower *parentFlower, stList *deadEndComponent, stHash *pinchEndsToEnds, stHash *cactusNodesToFlowers) {
+                           Flower *parentFlower, stList *deadEndComponent, EndMap *endMap, stHash *cactusNodesToFlowers,
+                           stList *nestedFlowers) {
     assert(flower_getAttachedStubEndNumber(flower) > 0);
     fillOutChains(cactusNode, flower, orientation, threadSet, parentFlower, deadEndComponent,
-                  pinchEndsToEnds, cactusNodesToFlowers, 0);
+                  endMap, cactusNodesToFlowers, 0, NULL);
     fillOutChains(cactusNode, flower, orientation, threadSet, parentFlower, deadEndComponent,
-                  pinchEndsToEnds, cactusNodesToFlowers, 1); //This call is recursive
-    makeTangles(cactusNode, flower, pinchEndsToEnds, deadEndComponent);
+                  endMap, cactusNodesToFlowers, 1, nestedFlowers); //This call is recursive
+    makeTangles(cactusNode, flower, endMap, deadEndComponent);
     stCaf_addAdjacencies(flower);
     if(flower_isLeaf(flower) && flower_getBlockNumber(flower) == 0 && flower != parentFlower) { //We have a leaf with no blocks - it's effectively empty and can be removed.
         flower_destruct(flower, 1, 1); //This removes the flower completely from the database.
@@ -403,6 +454,33 @@ static void fillOutFlowers(stCactusNode *cactusNode, Flower *flower, bool orient
     }
 }
 
+/*
+ * Returns an upper bound on the number of names used to fill out the flower of the cactus node and its nested flowers:
+ * three for each block and each of its segments, one for each chain and one for each group and the chain it may start.
+ */
+static int64_t getNameNumberBound(stCactusNode *cactusNode) {
+    int64_t nameNumber = 2 * stList_length(stCactusNode_getObject(cactusNode)); //The tangles
+    stCactusNodeEdgeEndIt cactusEdgeEndIt = stCactusNode_getEdgeEndIt(cactusNode);
+    stCactusEdgeEnd *cactusEdgeEnd;
+    while ((cactusEdgeEnd = stCactusNodeEdgeEndIt_getNext(&cactusEdgeEndIt))) {
+        if (stCactusEdgeEnd_isChainEnd(cactusEdgeEnd) && stCactusEdgeEnd_getLinkOrientation(cactusEdgeEnd)) {
+            nameNumber += 1; //The chain
+            //Walk the chain as fillOutChain does, counting its blocks and the links' nested flowers
+            stCactusEdgeEnd *edgeEnd = cactusEdgeEnd;
+            while (1) {
+                nameNumber += 3 + 3 * stPinchBlock_getDegree(stPinchEnd_getBlock(stCactusEdgeEnd_getObject(edgeEnd)));
+                edgeEnd = stCactusEdgeEnd_getOtherEdgeEnd(edgeEnd);
+                if (stCactusEdgeEnd_isChainEnd(edgeEnd)) {
+                    break;
+                }
+                nameNumber += 1 + getNameNumberBound(stCactusEdgeEnd_getNode(edgeEnd)); //The link's group and chain
+                edgeEnd = stCactusEdgeEnd_getLink(edgeEnd);
+            }
+        }
+    }
+    return nameNumber;
+}
+
 //Main function
 
 static void stCaf_convertCactusGraphToFlowers(stPinchThreadSet *threadSet, stCactusNode *startCactusNode,
@@ -410,8 +488,42 @@ static void stCaf_convertCactusGraphToFlowers(stPinchThreadSet *threadSet, stCac
     stHash *pinchEndsToEnds = getPinchEndsToEndsHash(threadSet, parentFlower);
     stHash *cactusNodesToFlowers = stHash_construct();
     makeEmptyFlowers(startCactusNode, parentFlower, threadSet, pinchEndsToEnds, cactusNodesToFlowers, 1);
+
+    //Fill out the parent flower, leaving its nested flowers to be filled out afterwards
+    EndMap endMap = { pinchEndsToEnds, NULL };
+    stList *nestedFlowers = stList_construct3(0, free);
     fillOutFlowers(startCactusNode, parentFlower, 1, threadSet, parentFlower, deadEndComponent,
-                   pinchEndsToEnds, cactusNodesToFlowers);
+                   &endMap, cactusNodesToFlowers, nestedFlowers);
+
+    //Reserve the names for each nested flower in order, so that the names do not depend on the number of threads
+    CactusDisk *cactusDisk = flower_getCactusDisk(parentFlower);
+    for (int64_t i = 0; i < stList_length(nestedFlowers); i++) {
+        NestedFlower *n = stList_get(nestedFlowers, i);
+        n->nameNumber = getNameNumberBound(n->cactusNode);
+        n->firstName = cactusDisk_getUniqueIDInterval(cactusDisk, n->nameNumber);
+    }
+
+    //Now fill out the nested flowers in parallel. Each only modifies its own subtree of flowers (and the leaf status of
+    //its parent group), so each gets its own map for the blocks it creates, reading those of the parent flower from the
+    //shared map, which is no longer modified. Each takes its names from its reserved interval and is filled out in the
+    //same order as when run serially, so the result is the same for any number of threads.
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int64_t i = 0; i < stList_length(nestedFlowers); i++) {
+        NestedFlower *n = stList_get(nestedFlowers, i);
+        EndMap nestedEndMap = { stHash_construct3(stPinchEnd_hashFn, stPinchEnd_equalsFn,
+                                                  (void (*)(void *))stPinchEnd_destruct, NULL), &endMap };
+        cactusDisk_setUniqueIDInterval(cactusDisk, n->firstName, n->nameNumber);
+        fillOutFlowers(n->cactusNode, n->flower, n->orientation, threadSet, parentFlower, deadEndComponent,
+                       &nestedEndMap, cactusNodesToFlowers, NULL);
+        if (!cactusDisk_restoreUniqueIDInterval(cactusDisk, n->firstName, n->nameNumber)) {
+            st_errAbort("Ran out of the %" PRIi64 " names reserved for a nested flower", n->nameNumber);
+        }
+        stHash_destruct(nestedEndMap.pinchEndsToEnds);
+    }
+
+    stList_destruct(nestedFlowers);
     stHash_destruct(pinchEndsToEnds);
     stHash_destruct(cactusNodesToFlowers);
 }
@@ -10,67 +10,124 @@
 #include <math.h>
 #include <stdlib.h>
 
-static void *getValue(stHash *hash, int64_t node) {
-    stIntTuple *nodeTuple = stIntTuple_construct1(node);
-    void *object = stHash_search(hash, nodeTuple);
-    stIntTuple_destruct(nodeTuple);
-    return object;
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+/*
+ * The number of pinch ends in the oversized adjacency components whose graphs are built and broken up at the same
+ * time. Each end takes roughly 40 bytes plus 32 bytes per segment of its block while its graph exists.
+ */
+#define GIANT_COMPONENT_BATCH_ENDS 10000000
+
+/*
+ * A weighted edge between two nodes of a component graph, with node1 < node2.
+ */
+typedef struct _componentEdge {
+    int64_t weight;
+    int64_t node1;
+    int64_t node2;
+    int64_t index; // The position of the edge in the caller's list of edges
+} ComponentEdge;
+
+/*
+ * Orders edges by descending weight, then descending nodes, the order in which the greedy breakup considers them.
+ */
+static int componentEdge_cmp(const void *a, const void *b) {
+    const ComponentEdge *edge1 = a, *edge2 = b;
+    if (edge1->weight != edge2->weight) {
+        return edge1->weight > edge2->weight ? -1 : 1;
+    }
+    if (edge1->node1 != edge2->node1) {
+        return edge1->node1 > edge2->node1 ? -1 : 1;
+    }
+    return edge1->node2 > edge2->node2 ? -1 : (edge1->node2 < edge2->node2 ? 1 : 0);
 }
 
-stList *stCaf_breakupComponentGreedily(stList *nodes, stList *edges, int64_t maxComponentSize) {
-    /*
-     * Make a component for each node in the graph
-     */
-    stHash *nodeToComponents = stHash_construct3((uint64_t(*)(const void *)) stIntTuple_hashKey,
-            (int(*)(const void *, const void *)) stIntTuple_equalsFn, NULL, NULL);
-    stListIterator *listIt = stList_getIterator(nodes);
-    stIntTuple *node;
-    while ((node = stList_getNext(listIt)) != NULL) {
-        stSortedSet *component = stSortedSet_construct();
-        stSortedSet_insert(component, node);
-        assert(stHash_search(nodeToComponents, node) == NULL);
-        stHash_insert(nodeToComponents, node, component);
-    }
-    stList_destructIterator(listIt);
-
-    stList *sortedEdges = stList_copy(edges, NULL); //copy, to avoid messing input
-    stList_sort(sortedEdges, (int(*)(const void *, const void *)) stIntTuple_cmpFn); //Sort in ascending order, so best edge first
-    int64_t edgeScore = INT64_MAX;
-    //While edges exist, try and put them into the graph.
-    stList *edgesToDelete = stList_construct();
-    int64_t totalComponents = stList_length(nodes);
-    while (stList_length(sortedEdges) > 0) {
-        stIntTuple *edge = stList_pop(sortedEdges);
-        if (edgeScore < stIntTuple_get(edge, 0)) {
-            st_errAbort("bad edgeScore");
-        }
-        edgeScore = stIntTuple_get(edge, 0);
-        stSortedSet *component1 = getValue(nodeToComponents, stIntTuple_get(edge, 1));
-        stSortedSet *component2 = getValue(nodeToComponents, stIntTuple_get(edge, 2));
-        assert(component1 != NULL && component2 != NULL);
+static int64_t findComponent(int64_t *parents, int64_t node) {
+    while (parents[node] != node) {
+        parents[node] = parents[parents[node]]; // Path halving
+        node = parents[node];
+    }
+    return node;
+}
+
+/*
+ * Greedily adds the edges, which must be sorted with componentEdge_cmp, to a graph of nodeNumber nodes with no
+ * edges, rejecting each edge that would join two components into one with more than maxComponentSize nodes. Sets
+ * rejected[i] for each rejected edge and returns the number of components left.
+ */
+static int64_t breakupGraphGreedily(int64_t nodeNumber, ComponentEdge *edges, int64_t edgeNumber,
+                                    int64_t maxComponentSize, bool *rejected) {
+    int64_t *parents = st_malloc(sizeof(int64_t) * (nodeNumber + 1));
+    int64_t *sizes = st_malloc(sizeof(int64_t) * (nodeNumber + 1));
+    for (int64_t i = 0; i < nodeNumber; i++) {
+        parents[i] = i;
+        sizes[i] = 1;
+    }
+    int64_t totalComponents = nodeNumber;
+    for (int64_t i = 0; i < edgeNumber; i++) {
+        int64_t component1 = findComponent(parents, edges[i].node1);
+        int64_t component2 = findComponent(parents, edges[i].node2);
+        rejected[i] = 0;
         if (component1 == component2) { //We're golden, as the edge is already contained within one component.
             continue;
         }
-        if (stSortedSet_size(component1) + stSortedSet_size(component2) > maxComponentSize) { //This edge would make a too large component, so reject
-            stList_append(edgesToDelete, edge);
+        if (sizes[component1] + sizes[component2] > maxComponentSize) { //This edge would make a too large component, so reject
+            rejected[i] = 1;
             continue;
         }
-        //Merge the components and replace references in the hash.
-        if (stSortedSet_size(component1) < stSortedSet_size(component2)) {
-            stSortedSet *component3 = component1;
+        if (sizes[component1] < sizes[component2]) {
+            int64_t component3 = component1;
             component1 = component2;
             component2 = component3;
         }
-        assert(stSortedSet_size(component1) >= stSortedSet_size(component2));
-        while (stSortedSet_size(component2) > 0) {
-            node = stSortedSet_getLast(component2);
-            stSortedSet_remove(component2, node);
-            assert(stSortedSet_search(component1, node) == NULL);
-            stSortedSet_insert(component1, node);
-            stHash_insert(nodeToComponents, node, component1);
+        parents[component2] = component1;
+        sizes[component1] += sizes[component2];
+        totalComponents--;
+    }
+    free(parents);
+    free(sizes);
+    return totalComponents;
+}
+
+stList *stCaf_breakupComponentGreedily(stList *nodes, stList *edges, int64_t maxComponentSize) {
+    // Give the nodes dense indices
+    stHash *nodesToIndices = stHash_construct3((uint64_t(*)(const void *)) stIntTuple_hashKey,
+            (int(*)(const void *, const void *)) stIntTuple_equalsFn, NULL, (void (*)(void *)) stIntTuple_destruct);
+    for (int64_t i = 0; i < stList_length(nodes); i++) {
+        assert(stHash_search(nodesToIndices, stList_get(nodes, i)) == NULL);
+        stHash_insert(nodesToIndices, stList_get(nodes, i), stIntTuple_construct1(i));
+    }
+    // Sort the edges by their original node values, but union their dense indices
+    int64_t edgeNumber = stList_length(edges);
+    ComponentEdge *sortedEdges = st_malloc(sizeof(ComponentEdge) * (edgeNumber + 1));
+    for (int64_t i = 0; i < edgeNumber; i++) {
+        stIntTuple *edge = stList_get(edges, i);
+        sortedEdges[i].weight = stIntTuple_get(edge, 0);
+        sortedEdges[i].node1 = stIntTuple_get(edge, 1);
+        sortedEdges[i].node2 = stIntTuple_get(edge, 2);
+        sortedEdges[i].index = i;
+    }
+    qsort(sortedEdges, edgeNumber, sizeof(ComponentEdge), componentEdge_cmp);
+    for (int64_t i = 0; i < edgeNumber; i++) {
+        stIntTuple *node1 = stIntTuple_construct1(sortedEdges[i].node1);
+        stIntTuple *node2 = stIntTuple_construct1(sortedEdges[i].node2);
+        stIntTuple *index1 = stHash_search(nodesToIndices, node1);
+        stIntTuple *index2 = stHash_search(nodesToIndices, node2);
+        assert(index1 != NULL && index2 != NULL);
+        sortedEdges[i].node1 = stIntTuple_get(index1, 0);
+        sortedEdges[i].node2 = stIntTuple_get(index2, 0);
+        stIntTuple_destruct(node1);
+        stIntTuple_destruct(node2);
+    }
+    bool *rejected = st_malloc(sizeof(bool) * (edgeNumber + 1));
+    int64_t totalComponents = breakupGraphGreedily(stList_length(nodes), sortedEdges, edgeNumber, maxComponentSize, rejected);
+    stList *edgesToDelete = stList_construct();
+    for (int64_t i = 0; i < edgeNumber; i++) {
+        if (rejected[i]) {
+            stList_append(edgesToDelete, stList_get(edges, sortedEdges[i].index));
         }
-        stSortedSet_destruct(component2);
-        totalComponents -= 1;
     }
 
     st_logDebug(
@@ -79,76 +136,193 @@ stList *stCaf_breakupComponentGreedily(stList *nodes, stList *edges, int64_t max
             stList_length(edges) - stList_length(edgesToDelete), stList_length(edgesToDelete));
 
     //Cleanup
-    stList_destruct(sortedEdges);
-    stList *components = stHash_getValues(nodeToComponents);
-    stSortedSet *componentsSet = stList_getSortedSet(components, NULL);
-    stList_destruct(components);
-    stSortedSet_setDestructor(componentsSet, (void(*)(void *)) stSortedSet_destruct);
-    stSortedSet_destruct(componentsSet);
-    stHash_destruct(nodeToComponents);
-
+    free(sortedEdges);
+    free(rejected);
+    stHash_destruct(nodesToIndices);
     return edgesToDelete;
 }
 
-static void convertToNodesAndEdges(stList *adjacencyComponent, stList **nodes, stList **edges) {
-    //Make nodes
-    *nodes = stList_construct3(0, (void(*)(void *)) stIntTuple_destruct);
-    stHash *pinchEndsToNodesHash = stHash_construct3(stPinchEnd_hashFn, stPinchEnd_equalsFn, NULL, NULL);
-    for (int64_t i = 0; i < stList_length(adjacencyComponent); i++) {
-        stIntTuple *node = stIntTuple_construct1(i);
-        stList_append(*nodes, node);
-        assert(stHash_search(pinchEndsToNodesHash, stList_get(adjacencyComponent, i)) == NULL);
-        stHash_insert(pinchEndsToNodesHash, stList_get(adjacencyComponent, i), node);
+/*
+ * Open addressing table from the blocks of an adjacency component to the indices of their ends in the component.
+ */
+typedef struct _endIndex {
+    int64_t size; // A power of two, at least two
+    int64_t shift; // 64 - log2(size)
+    stPinchBlock **blocks;
+    int64_t (*ends)[2]; // The index of each orientation of the end of the block, or -1
+} EndIndex;
+
+static int64_t endIndex_getSlot(EndIndex *endIndex, stPinchBlock *block) {
+    // The top bits of the product depend on all the bits of the pointer, the low ones only on its (aligned) low bits
+    int64_t slot = ((uint64_t)(uintptr_t)block * 0x9E3779B97F4A7C15ULL) >> endIndex->shift;
+    while (endIndex->blocks[slot] != NULL && endIndex->blocks[slot] != block) {
+        slot = (slot + 1) & (endIndex->size - 1);
     }
-    //Make edges
+    return slot;
+}
 
-    //First build a hash of edges to their multiplicity
-    stHash *edgesToMultiplicityHash = stHash_construct3((uint64_t(*)(const void *)) stIntTuple_hashKey,
-            (int(*)(const void *, const void *)) stIntTuple_equalsFn, (void(*)(void *)) stIntTuple_destruct,
-            (void(*)(void *)) stIntTuple_destruct);
+static EndIndex *endIndex_construct(stList *adjacencyComponent) {
+    EndIndex *endIndex = st_malloc(sizeof(EndIndex));
+    endIndex->size = 2;
+    endIndex->shift = 63;
+    while (endIndex->size < 2 * stList_length(adjacencyComponent)) { // At most half full
+        endIndex->size *= 2;
+        endIndex->shift--;
+    }
+    endIndex->blocks = st_calloc(endIndex->size, sizeof(stPinchBlock *));
+    endIndex->ends = st_malloc(endIndex->size * sizeof(int64_t[2]));
     for (int64_t i = 0; i < stList_length(adjacencyComponent); i++) {
+        stPinchEnd *pinchEnd = stList_get(adjacencyComponent, i);
+        int64_t slot = endIndex_getSlot(endIndex, stPinchEnd_getBlock(pinchEnd));
+        if (endIndex->blocks[slot] == NULL) {
+            endIndex->blocks[slot] = stPinchEnd_getBlock(pinchEnd);
+            endIndex->ends[slot][0] = -1;
+            endIndex->ends[slot][1] = -1;
+        }
+        assert(endIndex->ends[slot][stPinchEnd_getOrientation(pinchEnd)] == -1);
+        endIndex->ends[slot][stPinchEnd_getOrientation(pinchEnd)] = i;
+    }
+    return endIndex;
+}
+
+static void endIndex_destruct(EndIndex *endIndex) {
+    free(endIndex->blocks);
+    free(endIndex->ends);
+    free(endIndex);
+}
+
+static int64_t endIndex_get(EndIndex *endIndex, stPinchBlock *block, bool orientation) {
+    int64_t slot = endIndex_getSlot(endIndex, block);
+    assert(endIndex->blocks[slot] == block);
+    return endIndex->ends[slot][orientation];
+}
+
+/*
+ * The graph of an adjacency component: a node per pinch end, and an edge between two ends for each adjacency
+ * between them, weighted by the number of times it is seen from either end.
+ */
+typedef struct _componentGraph {
+    int64_t nodeNumber;
+    int64_t edgeNumber;
+    ComponentEdge *edges; // In the order they are considered by the greedy breakup
+} ComponentGraph;
+
+static int compareNodes(const void *a, const void *b) {
+    int64_t i = *(const int64_t *)a, j = *(const int64_t *)b;
+    return i < j ? -1 : (i > j ? 1 : 0);
+}
+
+/*
+ * Builds the graph of the component in compressed sparse row form: the adjacencies seen from each end are recorded
+ * in the row of the smaller of the two ends, then each row is sorted and its runs counted to give the edge weights.
+ * If parallel is non-zero the ends are processed in parallel.
+ */
+static ComponentGraph *componentGraph_construct(stList *adjacencyComponent, bool parallel) {
+    int64_t nodeNumber = stList_length(adjacencyComponent);
+    EndIndex *endIndex = endIndex_construct(adjacencyComponent);
+
+    // The end reached through each segment of the block of each end, or -1
+    int64_t *traversalOffsets = st_malloc(sizeof(int64_t) * (nodeNumber + 1));
+    traversalOffsets[0] = 0;
+    for (int64_t i = 0; i < nodeNumber; i++) {
+        traversalOffsets[i + 1] = traversalOffsets[i] + stPinchBlock_getDegree(stPinchEnd_getBlock(stList_get(adjacencyComponent, i)));
+    }
+    int64_t *traversals = st_malloc(sizeof(int64_t) * (traversalOffsets[nodeNumber] + 1));
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic, 256) if(parallel)
+#endif
+    for (int64_t i = 0; i < nodeNumber; i++) {
         stPinchEnd *pinchEnd1 = stList_get(adjacencyComponent, i);
-        int64_t node1 = stIntTuple_get(stHash_search(pinchEndsToNodesHash, pinchEnd1), 0);
+        int64_t k = traversalOffsets[i];
         stPinchBlockIt segmentIt = stPinchBlock_getSegmentIterator(stPinchEnd_getBlock(pinchEnd1));
         stPinchSegment *segment;
         while ((segment = stPinchBlockIt_getNext(&segmentIt)) != NULL) {
             bool traverse5Prime = stPinchEnd_traverse5Prime(stPinchEnd_getOrientation(pinchEnd1), segment);
             stPinchSegment *segment2 = traverse5Prime ? stPinchSegment_get5Prime(segment) : stPinchSegment_get3Prime(segment);
+            traversals[k] = -1;
             while (segment2 != NULL) {
                 if (stPinchSegment_getBlock(segment2) != NULL) {
-                    stPinchEnd pinchEnd2 = stPinchEnd_constructStatic(stPinchSegment_getBlock(segment2),
-                            stPinchEnd_endOrientation(traverse5Prime, segment2));
-                    assert(stHash_search(pinchEndsToNodesHash, &pinchEnd2) != NULL);
-                    int64_t node2 = stIntTuple_get(stHash_search(pinchEndsToNodesHash, &pinchEnd2), 0);
-                    if (node1 != node2) { //Ignore self edges
-                        stIntTuple *edge = node1 < node2 ? stIntTuple_construct2(node1, node2) : stIntTuple_construct2(node2, node1);
-                        int64_t multiplicity = 1;
-                        if (stHash_search(edgesToMultiplicityHash, edge) != NULL) {
-                            stIntTuple *count = stHash_removeAndFreeKey(edgesToMultiplicityHash, edge);
-                            multiplicity += stIntTuple_get(count, 0);
-                            stIntTuple_destruct(count);
-                            assert(multiplicity > 1);
-                        }
-                        stHash_insert(edgesToMultiplicityHash, edge, stIntTuple_construct1(multiplicity));
-                    }
+                    int64_t node2 = endIndex_get(endIndex, stPinchSegment_getBlock(segment2),
+                                                 stPinchEnd_endOrientation(traverse5Prime, segment2));
+                    assert(node2 != -1);
+                    traversals[k] = node2 != i ? node2 : -1; //Ignore self edges
                     break;
                 }
                 segment2 = traverse5Prime ? stPinchSegment_get5Prime(segment2) : stPinchSegment_get3Prime(segment2);
             }
+            k++;
+        }
+        assert(k == traversalOffsets[i + 1]);
+    }
+    endIndex_destruct(endIndex);
+
+    // Bucket the adjacencies into rows by their smaller end
+    int64_t *rowOffsets = st_calloc(nodeNumber + 2, sizeof(int64_t));
+    for (int64_t i = 0; i < nodeNumber; i++) {
+        for (int64_t k = traversalOffsets[i]; k < traversalOffsets[i + 1]; k++) {
+            if (traversals[k] != -1) {
+                rowOffsets[(i < traversals[k] ? i : traversals[k]) + 2]++;
+            }
+        }
+    }
+    for (int64_t i = 2; i < nodeNumber + 2; i++) {
+        rowOffsets[i] += rowOffsets[i - 1];
+    }
+    int64_t *neighbours = st_malloc(sizeof(int64_t) * (rowOffsets[nodeNumber + 1] + 1));
+    for (int64_t i = 0; i < nodeNumber; i++) {
+        for (int64_t k = traversalOffsets[i]; k < traversalOffsets[i + 1]; k++) {
+            if (traversals[k] != -1) {
+                int64_t row = i < traversals[k] ? i : traversals[k];
+                neighbours[rowOffsets[row + 1]++] = i < traversals[k] ? traversals[k] : i;
+            }
+        }
+    }
+    free(traversals);
+    free(traversalOffsets);
+
+    // Count the runs of each sorted row to get the weighted edges
+    int64_t *edgeOffsets = st_calloc(nodeNumber + 1, sizeof(int64_t));
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic, 256) if(parallel)
+#endif
+    for (int64_t i = 0; i < nodeNumber; i++) {
+        qsort(neighbours + rowOffsets[i], rowOffsets[i + 1] - rowOffsets[i], sizeof(int64_t), compareNodes);
+        for (int64_t k = rowOffsets[i]; k < rowOffsets[i + 1]; k++) {
+            if (k == rowOffsets[i] || neighbours[k] != neighbours[k - 1]) {
+                edgeOffsets[i + 1]++;
+            }
         }
     }
-    //Now build edges, scoring them according to their multiplicity
-    *edges = stList_construct3(0, (void(*)(void *)) stIntTuple_destruct);
-    stHashIterator *hashIt = stHash_getIterator(edgesToMultiplicityHash);
-    stIntTuple *edge;
-    while ((edge = stHash_getNext(hashIt)) != NULL) {
-        stIntTuple *count = stHash_search(edgesToMultiplicityHash, edge);
-        stList_append(*edges, stIntTuple_construct3(stIntTuple_get(count, 0), stIntTuple_get(edge, 0), stIntTuple_get(edge, 1)));
+    for (int64_t i = 0; i < nodeNumber; i++) {
+        edgeOffsets[i + 1] += edgeOffsets[i];
+    }
+    ComponentGraph *graph = st_malloc(sizeof(ComponentGraph));
+    graph->nodeNumber = nodeNumber;
+    graph->edgeNumber = edgeOffsets[nodeNumber];
+    graph->edges = st_malloc(sizeof(ComponentEdge) * (graph->edgeNumber + 1));
+    for (int64_t i = 0; i < nodeNumber; i++) {
+        int64_t j = edgeOffsets[i] - 1;
+        for (int64_t k = rowOffsets[i]; k < rowOffsets[i + 1]; k++) {
+            if (k == rowOffsets[i] || neighbours[k] != neighbours[k - 1]) {
+                j++;
+                graph->edges[j].weight = 0;
+                graph->edges[j].node1 = i;
+                graph->edges[j].node2 = neighbours[k];
+                graph->edges[j].index = j;
+            }
+            graph->edges[j].weight++;
+        }
     }
+    free(rowOffsets);
+    free(neighbours);
+    free(edgeOffsets);
+    qsort(graph->edges, graph->edgeNumber, sizeof(ComponentEdge), componentEdge_cmp);
+    return graph;
+}
 
-    //Cleanup
-    stHash_destruct(pinchEndsToNodesHash);
-    stHash_destruct(edgesToMultiplicityHash);
+static void componentGraph_destruct(ComponentGraph *graph) {
+    free(graph->edges);
+    free(graph);
 }
 
 static void breakEdges(stPinchThreadSet *threadSet, stPinchEnd *pinchEnd1, stPinchEnd *pinchEnd2) {
@@ -187,6 +361,72 @@ static void breakEdges(stPinchThreadSet *threadSet, stPinchEnd *pinchEnd1, stPin
     }
 }
 
+/*
+ * The breakup of one oversized adjacency component.
+ */
+typedef struct _componentBreakup {
+    stList *adjacencyComponent;
+    int64_t edgeNumber;
+    int64_t edgesToDeleteNumber;
+    int64_t (*edgesToDelete)[2]; // The pairs of ends to separate, in the order the breakup rejected them
+} ComponentBreakup;
+
+static void componentBreakup_fill(ComponentBreakup *breakup, int64_t maximumAdjacencyComponentSize, bool parallel) {
+    ComponentGraph *graph = componentGraph_construct(breakup->adjacencyComponent, parallel);
+    bool *rejected = st_malloc(sizeof(bool) * (graph->edgeNumber + 1));
+    breakupGraphGreedily(graph->nodeNumber, graph->edges, graph->edgeNumber, maximumAdjacencyComponentSize, rejected);
+    breakup->edgeNumber = graph->edgeNumber;
+    breakup->edgesToDeleteNumber = 0;
+    breakup->edgesToDelete = st_malloc(sizeof(int64_t[2]) * (graph->edgeNumber + 1));
+    for (int64_t i = 0; i < graph->edgeNumber; i++) {
+        if (rejected[i]) {
+            breakup->edgesToDelete[breakup->edgesToDeleteNumber][0] = graph->edges[i].node1;
+            breakup->edgesToDelete[breakup->edgesToDeleteNumber++][1] = graph->edges[i].node2;
+        }
+    }
+    free(rejected);
+    componentGraph_destruct(graph);
+}
+
+/*
+ * Returns the pairs of ends of the adjacency component, as int tuples of their indices in the component, whose
+ * adjacencies are broken to reduce it to components of at most maximumAdjacencyComponentSize ends, in the order the
+ * breakup rejects them. Used by the tests.
+ */
+stList *stCaf_breakupComponentGreedily2(stList *adjacencyComponent, int64_t maximumAdjacencyComponentSize) {
+    ComponentBreakup breakup;
+    breakup.adjacencyComponent = adjacencyComponent;
+    componentBreakup_fill(&breakup, maximumAdjacencyComponentSize, 1);
+    stList *edgesToDelete = stList_construct3(0, (void (*)(void *)) stIntTuple_destruct);
+    for (int64_t i = 0; i < breakup.edgesToDeleteNumber; i++) {
+        stList_append(edgesToDelete, stIntTuple_construct2(breakup.edgesToDelete[i][0], breakup.edgesToDelete[i][1]));
+    }
+    free(breakup.edgesToDelete);
+    return edgesToDelete;
+}
+
+static void componentBreakup_apply(ComponentBreakup *breakup, stPinchThreadSet *threadSet,
+                                   int64_t maximumAdjacencyComponentSize) {
+    int64_t unbrokenEdges = 0;
+    for (int64_t j = 0; j < breakup->edgesToDeleteNumber; j++) {
+        assert(breakup->edgesToDelete[j][0] < breakup->edgesToDelete[j][1]);
+        stPinchEnd *pinchEnd1 = stList_get(breakup->adjacencyComponent, breakup->edgesToDelete[j][0]);
+        stPinchEnd *pinchEnd2 = stList_get(breakup->adjacencyComponent, breakup->edgesToDelete[j][1]);
+        if (stPinchBlock_getDegree(stPinchEnd_getBlock(pinchEnd1)) > 1 && stPinchBlock_getDegree(stPinchEnd_getBlock(pinchEnd2))
+                > 1) {
+            breakEdges(threadSet, pinchEnd1, pinchEnd2);
+        } else {
+            unbrokenEdges++;
+        }
+    }
+    if (breakup->edgesToDeleteNumber > 0) {
+        st_logInfo("Pinch graph component with %" PRIi64 " nodes and %" PRIi64 " edges is being split up by breaking %" PRIi64 " edges to reduce size to less than %" PRIi64 " max, but found %" PRIi64 " pointless edges \n",
+                   stList_length(breakup->adjacencyComponent), breakup->edgeNumber, breakup->edgesToDeleteNumber,
+                   maximumAdjacencyComponentSize, unbrokenEdges);
+    }
+    free(breakup->edgesToDelete);
+}
+
 void stCaf_breakupComponentsGreedily(stPinchThreadSet *threadSet, float maximumAdjacencyComponentSizeRatio) {
     int64_t maximumAdjacencyComponentSize = maximumAdjacencyComponentSizeRatio * log(stPinchThreadSet_getTotalBlockNumber(threadSet) * 2);
     if (maximumAdjacencyComponentSize < 10) {
@@ -194,37 +434,40 @@ void stCaf_breakupComponentsGreedily(stPinchThreadSet *threadSet, float maximumA
     }
     //Get adjacency components
     stList *adjacencyComponents = stPinchThreadSet_getAdjacencyComponents(threadSet);
+    stList *oversizedComponents = stList_construct();
     for (int64_t i = 0; i < stList_length(adjacencyComponents); i++) {
         stList *adjacencyComponent = stList_get(adjacencyComponents, i);
         if (maximumAdjacencyComponentSize < stList_length(adjacencyComponent)) {
-            //Get graph description
-            stList *nodes, *edges;
-            convertToNodesAndEdges(adjacencyComponent, &nodes, &edges);
-            //Get the edges to remove
-            stList *edgesToDelete = stCaf_breakupComponentGreedily(nodes, edges, maximumAdjacencyComponentSize);
-            //Break edges;
-            int64_t unbrokenEdges = 0;
-            for (int64_t j = 0; j < stList_length(edgesToDelete); j++) {
-                stIntTuple *edge = stList_get(edgesToDelete, j);
-                assert(stIntTuple_get(edge, 1) < stIntTuple_get(edge, 2));
-                stPinchEnd *pinchEnd1 = stList_get(adjacencyComponent, stIntTuple_get(edge, 1));
-                stPinchEnd *pinchEnd2 = stList_get(adjacencyComponent, stIntTuple_get(edge, 2));
-                if (stPinchBlock_getDegree(stPinchEnd_getBlock(pinchEnd1)) > 1 && stPinchBlock_getDegree(stPinchEnd_getBlock(pinchEnd2))
-                        > 1) {
-                    breakEdges(threadSet, pinchEnd1, pinchEnd2);
-                } else {
-                    unbrokenEdges++;
-                }
-            }
-            if (stList_length(edgesToDelete) > 0) {
-                st_logInfo("Pinch graph component with %" PRIi64 " nodes and %" PRIi64 " edges is being split up by breaking %" PRIi64 " edges to reduce size to less than %" PRIi64 " max, but found %" PRIi64 " pointless edges \n",
-                           stList_length(nodes), stList_length(edges), stList_length(edgesToDelete), maximumAdjacencyComponentSize, unbrokenEdges);
-            }
-            //Cleanup
-            stList_destruct(edges);
-            stList_destruct(nodes);
-            stList_destruct(edgesToDelete);
+            stList_append(oversizedComponents, adjacencyComponent);
+        }
+    }
+    /*
+     * Breaking the edges of a component only splits the adjacencies between its own ends, so the graphs of the
+     * components are built and broken up in parallel, a batch at a time to bound the memory used, then the edges
+     * are broken serially in the original order. Nested parallel regions run on one thread, so a batch of a single
+     * (giant) component is instead built with the ends of the component processed in parallel.
+     */
+    ComponentBreakup *breakups = st_calloc(stList_length(oversizedComponents) + 1, sizeof(ComponentBreakup));
+    int64_t batchStart = 0;
+    while (batchStart < stList_length(oversizedComponents)) {
+        int64_t batchEnd = batchStart, batchEnds = 0;
+        do {
+            breakups[batchEnd].adjacencyComponent = stList_get(oversizedComponents, batchEnd);
+            batchEnds += stList_length(breakups[batchEnd++].adjacencyComponent);
+        } while (batchEnd < stList_length(oversizedComponents) && batchEnds < GIANT_COMPONENT_BATCH_ENDS);
+        bool singleComponent = batchEnd - batchStart == 1;
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic) if(!singleComponent)
+#endif
+        for (int64_t i = batchStart; i < batchEnd; i++) {
+            componentBreakup_fill(&breakups[i], maximumAdjacencyComponentSize, singleComponent);
+        }
+        for (int64_t i = batchStart; i < batchEnd; i++) {
+            componentBreakup_apply(&breakups[i], threadSet, maximumAdjacencyComponentSize);
         }
+        batchStart = batchEnd;
     }
+    free(breakups);
+    stList_destruct(oversizedComponents);
     stList_destruct(adjacencyComponents);
 }
@@ -4,6 +4,10 @@
 #include "stCactusGraphs.h"
 #include "stCaf.h"
 
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
 ///////////////////////////////////////////////////////////////////////////
 // Core functions for melting
 ///////////////////////////////////////////////////////////////////////////
@@ -18,69 +22,95 @@ static bool isThreadEnd(stPinchBlock *pinchBlock) {
     return threadEnd;
 } //Adding dummy comment
 
-static void processChain(stCactusEdgeEnd *cactusEdgeEnd, void(*edgeEndFn)(stPinchBlock *, void *), void *extraArg, bool recursive) {
-    while (1) {
-        stPinchEnd *pinchEnd = stCactusEdgeEnd_getObject(cactusEdgeEnd);
-        assert(pinchEnd != NULL);
-        stPinchBlock *pinchBlock = stPinchEnd_getBlock(pinchEnd);
-        assert(pinchBlock != NULL);
-        edgeEndFn(pinchBlock, extraArg);
-        assert(stCactusEdgeEnd_getOtherEdgeEnd(stCactusEdgeEnd_getOtherEdgeEnd(cactusEdgeEnd)) == cactusEdgeEnd);
-        cactusEdgeEnd = stCactusEdgeEnd_getOtherEdgeEnd(cactusEdgeEnd);
-        if (stCactusEdgeEnd_isChainEnd(cactusEdgeEnd)) {
-            break;
-        }
-        if (recursive) {
-            stCactusNode *node = stCactusEdgeEnd_getNode(cactusEdgeEnd);
-            stCactusNodeEdgeEndIt it = stCactusNode_getEdgeEndIt(node);
-            stCactusEdgeEnd *cactusEdgeEnd2;
-            while ((cactusEdgeEnd2 = stCactusNodeEdgeEndIt_getNext(&it)) != NULL) {
-                if (stCactusEdgeEnd_isChainEnd(cactusEdgeEnd2) && stCactusEdgeEnd_getLinkOrientation(cactusEdgeEnd2)) {
-                    processChain(cactusEdgeEnd2, edgeEndFn, extraArg, 1);
+stCafChains *stCaf_getChainLengths(stCactusGraph *cactusGraph, bool getBlocks) {
+    stCafChains *chains = st_calloc(1, sizeof(stCafChains));
+    int64_t maxChains = 16, maxBlocks = 16, blockNumber = 0;
+    chains->chainEnds = st_malloc(maxChains * sizeof(stCactusEdgeEnd *));
+    chains->lengths = st_malloc(maxChains * sizeof(int64_t));
+    chains->blockOffsets = getBlocks ? st_malloc((maxChains + 1) * sizeof(int64_t)) : NULL;
+    chains->blocks = getBlocks ? st_malloc(maxBlocks * sizeof(stPinchBlock *)) : NULL;
+    stCactusGraphNodeIt *nodeIt = stCactusGraphNodeIterator_construct(cactusGraph);
+    stCactusNode *cactusNode;
+    while ((cactusNode = stCactusGraphNodeIterator_getNext(nodeIt)) != NULL) {
+        stCactusNodeEdgeEndIt cactusEdgeEndIt = stCactusNode_getEdgeEndIt(cactusNode);
+        stCactusEdgeEnd *chainEnd;
+        while ((chainEnd = stCactusNodeEdgeEndIt_getNext(&cactusEdgeEndIt)) != NULL) {
+            if (!stCactusEdgeEnd_isChainEnd(chainEnd) || !stCactusEdgeEnd_getLinkOrientation(chainEnd)) {
+                continue;
+            }
+            if (chains->chainNumber == maxChains) {
+                maxChains *= 2;
+                chains->chainEnds = st_realloc(chains->chainEnds, maxChains * sizeof(stCactusEdgeEnd *));
+                chains->lengths = st_realloc(chains->lengths, maxChains * sizeof(int64_t));
+                if (getBlocks) {
+                    chains->blockOffsets = st_realloc(chains->blockOffsets, (maxChains + 1) * sizeof(int64_t));
+                }
+            }
+            if (getBlocks) {
+                chains->blockOffsets[chains->chainNumber] = blockNumber;
+            }
+
+            //Walk the links of the chain
+            int64_t length = 0;
+            stCactusEdgeEnd *cactusEdgeEnd = chainEnd;
+            while (1) {
+                stPinchEnd *pinchEnd = stCactusEdgeEnd_getObject(cactusEdgeEnd);
+                assert(pinchEnd != NULL);
+                stPinchBlock *pinchBlock = stPinchEnd_getBlock(pinchEnd);
+                assert(pinchBlock != NULL);
+                length += stPinchBlock_getLength(pinchBlock);
+                if (getBlocks && !isThreadEnd(pinchBlock)) {
+                    if (blockNumber == maxBlocks) {
+                        maxBlocks *= 2;
+                        chains->blocks = st_realloc(chains->blocks, maxBlocks * sizeof(stPinchBlock *));
+                    }
+                    chains->blocks[blockNumber++] = pinchBlock;
+                }
+                assert(stCactusEdgeEnd_getOtherEdgeEnd(stCactusEdgeEnd_getOtherEdgeEnd(cactusEdgeEnd)) == cactusEdgeEnd);
+                cactusEdgeEnd = stCactusEdgeEnd_getOtherEdgeEnd(cactusEdgeEnd);
+                if (stCactusEdgeEnd_isChainEnd(cactusEdgeEnd)) {
+                    break;
                 }
+                assert(stCactusEdgeEnd_getLink(stCactusEdgeEnd_getLink(cactusEdgeEnd)) == cactusEdgeEnd);
+                cactusEdgeEnd = stCactusEdgeEnd_getLink(cactusEdgeEnd);
             }
+            chains->chainEnds[chains->chainNumber] = chainEnd;
+            chains->lengths[chains->chainNumber++] = length;
         }
-        assert(stCactusEdgeEnd_getLink(stCactusEdgeEnd_getLink(cactusEdgeEnd)) == cactusEdgeEnd);
-        cactusEdgeEnd = stCactusEdgeEnd_getLink(cactusEdgeEnd);
     }
-}
-
-static void addBlock(stPinchBlock *block, void *extraArg) {
-    if (!isThreadEnd(block)) {
-        stList_append(extraArg, block);
+    stCactusGraphNodeIterator_destruct(nodeIt);
+    if (getBlocks) {
+        chains->blockOffsets[chains->chainNumber] = blockNumber;
     }
+    return chains;
 }
 
-static void addChainBlocksToBlocksToDelete(stCactusEdgeEnd *cactusEdgeEnd, stList *blocksToDelete) {
-    processChain(cactusEdgeEnd, addBlock, blocksToDelete, 0);
-}
-
-static void addLength(stPinchBlock *block, void *extraArg) {
-    *((int64_t *) extraArg) += stPinchBlock_getLength(block);
+void stCaf_destructChainLengths(stCafChains *chains) {
+    free(chains->chainEnds);
+    free(chains->lengths);
+    free(chains->blockOffsets);
+    free(chains->blocks);
+    free(chains);
 }
 
-static int64_t getChainLength(stCactusEdgeEnd *cactusEdgeEnd) {
-    int64_t length = 0;
-    processChain(cactusEdgeEnd, addLength, &length, 0);
-    return length;
+/*
+ * Adds the blocks of the given chain, excluding thread ends, to the list.
+ */
+static void addChainBlocks(stCafChains *chains, int64_t chain, stList *blocks) {
+    for (int64_t i = chains->blockOffsets[chain]; i < chains->blockOffsets[chain + 1]; i++) {
+        stList_append(blocks, chains->blocks[i]);
+    }
 }
 
 static stList *stCaf_getBlocksInChainsLessThanGivenLength(stCactusGraph *cactusGraph, int64_t minimumChainLength) {
     stList *blocksToDelete = stList_construct3(0, (void(*)(void *)) stPinchBlock_destruct);
-    stCactusGraphNodeIt *nodeIt = stCactusGraphNodeIterator_construct(cactusGraph);
-    stCactusNode *cactusNode;
-    while ((cactusNode = stCactusGraphNodeIterator_getNext(nodeIt)) != NULL) {
-        stCactusNodeEdgeEndIt cactusEdgeEndIt = stCactusNode_getEdgeEndIt(cactusNode);
-        stCactusEdgeEnd *cactusEdgeEnd;
-        while ((cactusEdgeEnd = stCactusNodeEdgeEndIt_getNext(&cactusEdgeEndIt)) != NULL) {
-            if (stCactusEdgeEnd_isChainEnd(cactusEdgeEnd) && stCactusEdgeEnd_getLinkOrientation(cactusEdgeEnd)) {
-                if (getChainLength(cactusEdgeEnd) < minimumChainLength) {
-                    addChainBlocksToBlocksToDelete(cactusEdgeEnd, blocksToDelete);
-                }
-            }
+    stCafChains *chains = stCaf_getChainLengths(cactusGraph, 1);
+    for (int64_t i = 0; i < chains->chainNumber; i++) {
+        if (chains->lengths[i] < minimumChainLength) {
+            addChainBlocks(chains, i, blocksToDelete);
         }
     }
-    stCactusGraphNodeIterator_destruct(nodeIt);
+    stCaf_destructChainLengths(chains);
     return blocksToDelete;
 }
 
@@ -96,17 +126,37 @@ static void trimAlignments(stPinchThreadSet *threadSet, int64_t blockEndTrim) {
     }
 }
 
+stPinchBlock **stCaf_getBlockArray(stPinchThreadSet *threadSet, int64_t *blockNumber) {
+    *blockNumber = stPinchThreadSet_getTotalBlockNumber(threadSet);
+    stPinchBlock **blocks = st_malloc(sizeof(stPinchBlock *) * (*blockNumber + 1));
+    stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
+    int64_t i = 0;
+    while ((blocks[i] = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
+        i++;
+    }
+    assert(i == *blockNumber);
+    return blocks;
+}
+
 static void filterAlignments(stPinchThreadSet *threadSet, bool(*blockFilterFn)(stPinchBlock *, void *extraArg),
                              void *extraArg) {
-    stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
-    stPinchBlock *block = stPinchThreadSetBlockIt_getNext(&blockIt);
-    while (block != NULL) {
-        stPinchBlock *block2 = stPinchThreadSetBlockIt_getNext(&blockIt);
-        if (!isThreadEnd(block) && blockFilterFn(block, extraArg)) {
-            stPinchBlock_destruct(block);
+    // The filter only reads the graph, so the blocks are evaluated in parallel then destroyed serially
+    int64_t blockNumber;
+    stPinchBlock **blocks = stCaf_getBlockArray(threadSet, &blockNumber);
+    bool *filtered = st_malloc(sizeof(bool) * (blockNumber + 1));
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic, 64)
+#endif
+    for (int64_t i = 0; i < blockNumber; i++) {
+        filtered[i] = !isThreadEnd(blocks[i]) && blockFilterFn(blocks[i], extraArg);
+    }
+    for (int64_t i = 0; i < blockNumber; i++) {
+        if (filtered[i]) {
+            stPinchBlock_destruct(blocks[i]);
         }
-        block = block2;
     }
+    free(blocks);
+    free(filtered);
 }
 
 void stCaf_melt(Flower *flower, stPinchThreadSet *threadSet, bool blockFilterfn(stPinchBlock *, void *extraArg),
@@ -144,6 +194,115 @@ void stCaf_melt(Flower *flower, stPinchThreadSet *threadSet, bool blockFilterfn(
     stCaf_joinTrivialBoundaries(threadSet);
 }
 
+/*
+ * A chain of the cactus graph, as used by stCaf_meltRounds.
+ */
+typedef struct _meltChain {
+    int64_t length;
+    int64_t chain; // The index of the chain in the stCafChains
+} MeltChain;
+
+static int meltChain_cmp(const MeltChain *chain1, const MeltChain *chain2) {
+    return chain1->length < chain2->length ? -1 : (chain1->length > chain2->length ? 1 :
+           (chain1->chain < chain2->chain ? -1 : (chain1->chain > chain2->chain ? 1 : 0)));
+}
+
+/*
+ * Builds the cactus graph of the thread set and returns the chains, with their blocks, setting order to the chains
+ * in ascending order of length.
+ */
+static stCafChains *getChainsInLengthOrder(Flower *flower, stPinchThreadSet *threadSet, MeltChain **order) {
+    stCactusNode *startCactusNode;
+    stList *deadEndComponent;
+    stCactusGraph *cactusGraph = stCaf_getCactusGraphForThreadSet(flower, threadSet, &startCactusNode, &deadEndComponent, 0, INT64_MAX,
+            0.0, 0, INT64_MAX);
+    stCafChains *chains = stCaf_getChainLengths(cactusGraph, 1);
+    stCactusGraph_destruct(cactusGraph);
+
+    *order = st_malloc((chains->chainNumber + 1) * sizeof(MeltChain));
+    for (int64_t i = 0; i < chains->chainNumber; i++) {
+        (*order)[i].length = chains->lengths[i];
+        (*order)[i].chain = i;
+    }
+    qsort(*order, chains->chainNumber, sizeof(MeltChain), (int (*)(const void *, const void *)) meltChain_cmp);
+    return chains;
+}
+
+static int64_t getThreadComponentNumber(stPinchThreadSet *threadSet) {
+    stSortedSet *threadComponents = stPinchThreadSet_getThreadComponents(threadSet);
+    int64_t threadComponentNumber = stSortedSet_size(threadComponents);
+    stSortedSet_destruct(threadComponents);
+    return threadComponentNumber;
+}
+
+static int64_t getAlignedBases(stPinchThreadSet *threadSet) {
+    int64_t alignedBases = 0;
+    stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
+    stPinchBlock *block;
+    while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
+        alignedBases += stPinchBlock_getLength(block) * stPinchBlock_getDegree(block);
+    }
+    return alignedBases;
+}
+
+void stCaf_meltRounds(Flower *flower, stPinchThreadSet *threadSet, int64_t *minimumChainLengths, int64_t roundNumber) {
+    /*
+     * Removing a chain contracts its cycle in the cactus graph, leaving the other chains, and their lengths, as they
+     * were, so the rounds can share one cactus graph. The exception is when removing blocks splits a thread component,
+     * as the new component is then attached to the dead end component, which can change the chains; in that case the
+     * graph is rebuilt for the following round. Trivial boundaries are joined once, at the end, which keeps the blocks
+     * of the chains valid between rounds and gives the same graph as joining them after each round.
+     */
+    stCafChains *chains = NULL;
+    MeltChain *order = NULL;
+    int64_t nextChain = 0, threadComponentNumber = 0;
+    // The aligned bases are only counted for the telemetry, from the blocks each round destroys
+    int64_t alignedBases = stCaf_isTelemetryEnabled() ? getAlignedBases(threadSet) : 0;
+    for (int64_t round = 0; round < roundNumber; round++) {
+        int64_t minimumChainLength = minimumChainLengths[round];
+        if (minimumChainLength <= 1) {
+            continue;
+        }
+        if (chains == NULL) {
+            chains = getChainsInLengthOrder(flower, threadSet, &order);
+            nextChain = 0;
+            threadComponentNumber = getThreadComponentNumber(threadSet);
+        }
+        stList *blocksToDelete = stList_construct3(0, (void(*)(void *)) stPinchBlock_destruct);
+        while (nextChain < chains->chainNumber && order[nextChain].length < minimumChainLength) {
+            addChainBlocks(chains, order[nextChain++].chain, blocksToDelete);
+        }
+
+        st_logInfo("A melting round is destroying %" PRIi64 " blocks with an average degree "
+               "of %lf from chains with length less than %" PRIi64 ". Total aligned bases"
+               " lost: %" PRIu64 "\n",
+               stList_length(blocksToDelete), stCaf_averageBlockDegree(blocksToDelete),
+               minimumChainLength, stCaf_totalAlignedBases(blocksToDelete));
+        if (stCaf_isTelemetryEnabled()) {
+            int64_t alignedBasesLost = stCaf_totalAlignedBases(blocksToDelete);
+            stCaf_reportMeltingRound(flower, round, minimumChainLength, stList_length(blocksToDelete), alignedBases,
+                                     alignedBases - alignedBasesLost);
+            alignedBases -= alignedBasesLost;
+        }
+
+        bool deletedBlocks = stList_length(blocksToDelete) > 0;
+        stList_destruct(blocksToDelete); //This will destroy the blocks
+
+        if (deletedBlocks && round + 1 < roundNumber && getThreadComponentNumber(threadSet) != threadComponentNumber) {
+            st_logDebug("Melting split a thread component, rebuilding the cactus graph for the next round\n");
+            stCaf_destructChainLengths(chains);
+            free(order);
+            chains = NULL;
+        }
+    }
+    if (chains != NULL) {
+        stCaf_destructChainLengths(chains);
+        free(order);
+    }
+    //Now heal up the trivial boundaries
+    stCaf_joinTrivialBoundaries(threadSet);
+}
+
 static bool isTelomere(stPinchEnd *end, stSet *deadEndComponent) {
     stPinchSegment *segment = stPinchBlock_getFirst(end->block);
     bool atEndOfThread = stPinchThread_getFirst(stPinchSegment_getThread(segment)) == segment || stPinchThread_getLast(stPinchSegment_getThread(segment)) == segment;
@@ -488,13 +647,21 @@ void stCaf_meltRecoverableChains(Flower *flower, stPinchThreadSet *threadSet, bo
 
         stList *recoverableChains = getRecoverableChains(cactusGraph, startCactusNode, deadEndComponentSet, flower, recoverabilityFilter);
 
+        stCafChains *chains = stCaf_getChainLengths(cactusGraph, 1);
+        stHash *chainEndsToChains = stHash_construct();
+        for (int64_t i = 0; i < chains->chainNumber; i++) {
+            stHash_insert(chainEndsToChains, chains->chainEnds[i], (void *)(i + 1)); // Cheeky int to pointer conversion
+        }
         stList *blocksToDelete = stList_construct3(0, (void(*)(void *)) stPinchBlock_destruct);
         for (int64_t i = 0; i < stList_length(recoverableChains); i++) {
-            stCactusEdgeEnd *chainEnd = stList_get(recoverableChains, i);
-            if (getChainLength(chainEnd) <= maxRecoverableChainLength) {
-                addChainBlocksToBlocksToDelete(chainEnd, blocksToDelete);
+            int64_t chain = (int64_t)stHash_search(chainEndsToChains, stList_get(recoverableChains, i)) - 1;
+            assert(chain >= 0);
+            if (chains->lengths[chain] <= maxRecoverableChainLength) {
+                addChainBlocks(chains, chain, blocksToDelete);
             }
         }
+        stHash_destruct(chainEndsToChains);
+        stCaf_destructChainLengths(chains);
         int64_t numRecoverableBlocks = stList_length(blocksToDelete);
         st_logInfo("Destroying %" PRIi64 " recoverable blocks\n", numRecoverableBlocks);
         st_logInfo("The blocks covered %" PRIi64 " columns for a total of %" PRIi64 " aligned bases\n", numColumns(blocksToDelete), totalAlignedBases(blocksToDelete));
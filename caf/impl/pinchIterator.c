@@ -6,12 +6,21 @@
  */
 
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "sonLib.h"
 #include "stPinchGraphs.h"
 #include "stPinchIterator.h"
 #include "paf.h"
 #include "cactus.h"
 
+// OpenMP
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
 stPinch *stPinchIterator_getNext(stPinchIterator *pinchIterator, stPinch *pinchToFillOut) {
     stPinch *pinch;
     while (1) {
@@ -137,6 +146,361 @@ stPinchIterator *stPinchIterator_constructFromFile(const char *alignmentFile) {
     return pinchIterator;
 }
 
+/*
+ * Binary pinch files. These are a flat array of fixed width pinch records preceded by a small header.
+ * The records are written in the byte order of the machine, as the files are only ever
+ * used as temporary files passed between the stages of a single run.
+ */
+
+#define BINARY_PINCH_FILE_MAGIC 0x48434e4950545343LL // "CSTPINCH"
+#define BINARY_PINCH_FILE_VERSION 2
+
+typedef struct _binaryPinchFileHeader {
+    int64_t magic;
+    int64_t version;
+} BinaryPinchFileHeader;
+
+typedef struct _binaryPinchRecord {
+    int64_t name1, name2, start1, start2, length, strand;
+    int64_t score; // The score of the alignment the pinch came from
+} BinaryPinchRecord;
+
+void stPinchIterator_writeBinaryHeader(FILE *fileHandle) {
+    BinaryPinchFileHeader header = { BINARY_PINCH_FILE_MAGIC, BINARY_PINCH_FILE_VERSION };
+    if (fwrite(&header, sizeof(BinaryPinchFileHeader), 1, fileHandle) != 1) {
+        st_errAbort("Failed to write the header of a binary pinch file");
+    }
+}
+
+static Paf *getSinglePaf(Paf **paf) {
+    Paf *p = *paf;
+    *paf = NULL;
+    return p;
+}
+
+int64_t stPinchIterator_writeBinaryPinches(FILE *fileHandle, Paf *paf) {
+    int64_t score = paf->score;
+    PairwiseAlignmentToPinch *pA = pairwiseAlignmentToPinch_construct(&paf, (Paf *(*)(void *)) getSinglePaf, 0);
+    stPinch pinch;
+    BinaryPinchRecord record;
+    int64_t pinchNumber = 0;
+    while (pairwiseAlignmentToPinch_getNext(pA, &pinch) != NULL) {
+        record.name1 = pinch.name1;
+        record.name2 = pinch.name2;
+        record.start1 = pinch.start1;
+        record.start2 = pinch.start2;
+        record.length = pinch.length;
+        record.strand = pinch.strand;
+        record.score = score;
+        if (fwrite(&record, sizeof(BinaryPinchRecord), 1, fileHandle) != 1) {
+            st_errAbort("Failed to write a record to a binary pinch file");
+        }
+        pinchNumber++;
+    }
+    free(pA);
+    return pinchNumber;
+}
+
+typedef struct _binaryPinchFile {
+    void *map;
+    size_t mapLength;
+    BinaryPinchRecord *records;
+    int64_t recordNumber;
+    int64_t nextRecord;
+} BinaryPinchFile;
+
+static BinaryPinchFile *binaryPinchFile_construct(const char *pinchFile) {
+    int fd = open(pinchFile, O_RDONLY);
+    if (fd == -1) {
+        st_errAbort("Could not open binary pinch file: %s", pinchFile);
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0) {
+        st_errAbort("Could not stat binary pinch file: %s", pinchFile);
+    }
+    size_t fileLength = fileStat.st_size;
+    if (fileLength < sizeof(BinaryPinchFileHeader) ||
+        (fileLength - sizeof(BinaryPinchFileHeader)) % sizeof(BinaryPinchRecord) != 0) {
+        st_errAbort("Binary pinch file has an invalid length (%" PRIi64 " bytes): %s", (int64_t)fileLength, pinchFile);
+    }
+    BinaryPinchFile *bP = st_calloc(1, sizeof(BinaryPinchFile));
+    bP->mapLength = fileLength;
+    bP->map = mmap(NULL, fileLength, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (bP->map == MAP_FAILED) {
+        st_errAbort("Could not mmap binary pinch file: %s", pinchFile);
+    }
+    close(fd);
+    madvise(bP->map, fileLength, MADV_SEQUENTIAL);
+    BinaryPinchFileHeader *header = bP->map;
+    if (header->magic != BINARY_PINCH_FILE_MAGIC) {
+        st_errAbort("File is not a binary pinch file: %s", pinchFile);
+    }
+    if (header->version != BINARY_PINCH_FILE_VERSION) {
+        st_errAbort("Binary pinch file has unsupported version %" PRIi64 ": %s", header->version, pinchFile);
+    }
+    bP->records = (BinaryPinchRecord *)((char *)bP->map + sizeof(BinaryPinchFileHeader));
+    bP->recordNumber = (fileLength - sizeof(BinaryPinchFileHeader)) / sizeof(BinaryPinchRecord);
+    return bP;
+}
+
+static stPinch *binaryPinchFile_getNext(BinaryPinchFile *bP, stPinch *pinchToFillOut) {
+    if (bP->nextRecord >= bP->recordNumber) {
+        return NULL;
+    }
+    BinaryPinchRecord *record = &bP->records[bP->nextRecord++];
+    stPinch_fillOut(pinchToFillOut, record->name1, record->name2, record->start1, record->start2, record->length,
+                    record->strand);
+    return pinchToFillOut;
+}
+
+static BinaryPinchFile *binaryPinchFile_reset(BinaryPinchFile *bP) {
+    bP->nextRecord = 0;
+    return bP;
+}
+
+static void binaryPinchFile_destruct(BinaryPinchFile *bP) {
+    munmap(bP->map, bP->mapLength);
+    free(bP);
+}
+
+stPinchIterator *stPinchIterator_constructFromBinaryFile(const char *pinchFile) {
+    stPinchIterator *pinchIterator = st_calloc(1, sizeof(stPinchIterator));
+    pinchIterator->alignmentArg = binaryPinchFile_construct(pinchFile);
+    pinchIterator->getNextAlignment = (stPinch *(*)(void *, stPinch *)) binaryPinchFile_getNext;
+    pinchIterator->destructAlignmentArg = (void(*)(void *)) binaryPinchFile_destruct;
+    pinchIterator->startAlignmentStack = (void *(*)(void *)) binaryPinchFile_reset;
+    return pinchIterator;
+}
+
+/*
+ * External memory sorting of binary pinch files by score. The input is mmapped. Runs of records that fit in the
+ * memory budget are sorted by key, in parallel, and written to run files, which are then merged.
+ */
+
+// The number of records read at a time from each run while merging
+#define PINCH_SORT_MERGE_BUFFER_RECORDS 4096
+
+typedef struct _pinchSortKey {
+    int64_t score;
+    int64_t index; // The index of the record in the input file
+} PinchSortKey;
+
+static int pinchSortKey_cmp(const PinchSortKey *key1, const PinchSortKey *key2) {
+    // Descending by score, then ascending by position in the input, so the sort is stable
+    if (key1->score != key2->score) {
+        return key1->score > key2->score ? -1 : 1;
+    }
+    return key1->index < key2->index ? -1 : (key1->index > key2->index ? 1 : 0);
+}
+
+static void mergeKeys(PinchSortKey *keys1, int64_t length1, PinchSortKey *keys2, int64_t length2, PinchSortKey *output) {
+    int64_t i = 0, j = 0;
+    while (i < length1 && j < length2) {
+        *output++ = pinchSortKey_cmp(&keys1[i], &keys2[j]) <= 0 ? keys1[i++] : keys2[j++];
+    }
+    memcpy(output, keys1 + i, (length1 - i) * sizeof(PinchSortKey));
+    memcpy(output + (length1 - i), keys2 + j, (length2 - j) * sizeof(PinchSortKey));
+}
+
+/*
+ * Sorts the keys using all threads: a slice per thread is sorted with qsort, then the slices are merged pairwise.
+ * buffer must be as long as keys. Returns whichever of keys and buffer holds the sorted keys.
+ */
+static PinchSortKey *sortKeys(PinchSortKey *keys, PinchSortKey *buffer, int64_t keyNumber) {
+    int64_t sliceNumber = 1;
+#if defined(_OPENMP)
+    sliceNumber = omp_get_max_threads();
+#endif
+    int64_t sliceLength = (keyNumber + sliceNumber - 1) / sliceNumber;
+    if (sliceLength == 0) {
+        return keys;
+    }
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int64_t i = 0; i < sliceNumber; i++) {
+        int64_t start = i * sliceLength;
+        if (start < keyNumber) {
+            int64_t length = start + sliceLength < keyNumber ? sliceLength : keyNumber - start;
+            qsort(keys + start, length, sizeof(PinchSortKey), (int (*)(const void *, const void *)) pinchSortKey_cmp);
+        }
+    }
+    for (int64_t width = sliceLength; width < keyNumber; width *= 2) {
+        int64_t mergeNumber = (keyNumber + 2 * width - 1) / (2 * width);
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic)
+#endif
+        for (int64_t i = 0; i < mergeNumber; i++) {
+            int64_t start = i * 2 * width;
+            int64_t length1 = start + width < keyNumber ? width : keyNumber - start;
+            int64_t length2 = start + 2 * width < keyNumber ? width : keyNumber - start - length1;
+            mergeKeys(keys + start, length1, keys + start + length1, length2, buffer + start);
+        }
+        PinchSortKey *swap = keys;
+        keys = buffer;
+        buffer = swap;
+    }
+    return keys;
+}
+
+static void writeRecord(FILE *fileHandle, BinaryPinchRecord *record) {
+    if (fwrite(record, sizeof(BinaryPinchRecord), 1, fileHandle) != 1) {
+        st_errAbort("Failed to write a record to a binary pinch file");
+    }
+}
+
+/*
+ * A sorted run being merged, read through a buffer.
+ */
+typedef struct _pinchSortRun {
+    FILE *fileHandle;
+    BinaryPinchRecord *buffer;
+    int64_t bufferLength, bufferOffset;
+} PinchSortRun;
+
+static BinaryPinchRecord *pinchSortRun_peek(PinchSortRun *run) {
+    if (run->bufferOffset == run->bufferLength) {
+        run->bufferLength = fread(run->buffer, sizeof(BinaryPinchRecord), PINCH_SORT_MERGE_BUFFER_RECORDS, run->fileHandle);
+        run->bufferOffset = 0;
+        if (run->bufferLength == 0) {
+            return NULL;
+        }
+    }
+    return &run->buffer[run->bufferOffset];
+}
+
+/*
+ * Orders the runs by the score of their next record, descending, then by run number, so records of equal score
+ * come out in input order, as the runs are consecutive slices of the input.
+ */
+static bool pinchSortRun_before(PinchSortRun *runs, int64_t run1, int64_t run2) {
+    int64_t score1 = runs[run1].buffer[runs[run1].bufferOffset].score;
+    int64_t score2 = runs[run2].buffer[runs[run2].bufferOffset].score;
+    return score1 != score2 ? score1 > score2 : run1 < run2;
+}
+
+static void siftDown(PinchSortRun *runs, int64_t *heap, int64_t heapLength, int64_t i) {
+    while (1) {
+        int64_t child = 2 * i + 1;
+        if (child >= heapLength) {
+            return;
+        }
+        if (child + 1 < heapLength && pinchSortRun_before(runs, heap[child + 1], heap[child])) {
+            child++;
+        }
+        if (!pinchSortRun_before(runs, heap[child], heap[i])) {
+            return;
+        }
+        int64_t swap = heap[i];
+        heap[i] = heap[child];
+        heap[child] = swap;
+        i = child;
+    }
+}
+
+static void mergeRuns(stList *runFiles, FILE *outputHandle) {
+    int64_t runNumber = stList_length(runFiles);
+    PinchSortRun *runs = st_calloc(runNumber, sizeof(PinchSortRun));
+    int64_t *heap = st_malloc(runNumber * sizeof(int64_t));
+    int64_t heapLength = 0;
+    for (int64_t i = 0; i < runNumber; i++) {
+        runs[i].fileHandle = fopen(stList_get(runFiles, i), "rb");
+        if (runs[i].fileHandle == NULL) {
+            st_errAbort("Could not open sorted run: %s", (char *)stList_get(runFiles, i));
+        }
+        runs[i].buffer = st_malloc(PINCH_SORT_MERGE_BUFFER_RECORDS * sizeof(BinaryPinchRecord));
+        if (pinchSortRun_peek(&runs[i]) != NULL) {
+            heap[heapLength++] = i;
+        }
+    }
+    for (int64_t i = heapLength / 2 - 1; i >= 0; i--) {
+        siftDown(runs, heap, heapLength, i);
+    }
+    while (heapLength > 0) {
+        PinchSortRun *run = &runs[heap[0]];
+        writeRecord(outputHandle, &run->buffer[run->bufferOffset++]);
+        if (pinchSortRun_peek(run) == NULL) {
+            heap[0] = heap[--heapLength];
+        }
+        siftDown(runs, heap, heapLength, 0);
+    }
+    for (int64_t i = 0; i < runNumber; i++) {
+        fclose(runs[i].fileHandle);
+        free(runs[i].buffer);
+    }
+    free(runs);
+    free(heap);
+}
+
+void stPinchIterator_sortBinaryFileByScore(const char *inputFile, const char *outputFile, int64_t memoryBudget) {
+    BinaryPinchFile *input = binaryPinchFile_construct(inputFile);
+    int64_t recordNumber = input->recordNumber;
+    madvise(input->map, input->mapLength, MADV_NORMAL); // Records are gathered in sorted order
+    // Each record in a run needs a key and a key in the merge buffer
+    int64_t runLength = memoryBudget / (2 * sizeof(PinchSortKey));
+    if (runLength < 1) {
+        runLength = 1;
+    }
+    int64_t runNumber = (input->recordNumber + runLength - 1) / runLength;
+    if (runLength > input->recordNumber) {
+        runLength = input->recordNumber;
+    }
+    PinchSortKey *keys = st_malloc((runLength + 1) * sizeof(PinchSortKey));
+    PinchSortKey *buffer = st_malloc((runLength + 1) * sizeof(PinchSortKey));
+
+    FILE *outputHandle = fopen(outputFile, "wb");
+    if (outputHandle == NULL) {
+        st_errAbort("Could not open file to write sorted pinches: %s", outputFile);
+    }
+    stPinchIterator_writeBinaryHeader(outputHandle);
+    stList *runFiles = stList_construct3(0, free);
+    for (int64_t run = 0; run < runNumber; run++) {
+        // Sort the keys of the run
+        int64_t start = run * runLength;
+        int64_t length = start + runLength < input->recordNumber ? runLength : input->recordNumber - start;
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(static)
+#endif
+        for (int64_t i = 0; i < length; i++) {
+            keys[i].score = input->records[start + i].score;
+            keys[i].index = start + i;
+        }
+        PinchSortKey *sortedKeys = sortKeys(keys, buffer, length);
+
+        // Write the records, to the output if there is only one run, else to a run file
+        FILE *runHandle = outputHandle;
+        if (runNumber > 1) {
+            char *runFile = stString_print("%s.run%" PRIi64, outputFile, run);
+            runHandle = fopen(runFile, "wb");
+            if (runHandle == NULL) {
+                st_errAbort("Could not open file to write a sorted run: %s", runFile);
+            }
+            stList_append(runFiles, runFile);
+        }
+        for (int64_t i = 0; i < length; i++) {
+            writeRecord(runHandle, &input->records[sortedKeys[i].index]);
+        }
+        if (runHandle != outputHandle) {
+            fclose(runHandle);
+        }
+    }
+    free(keys);
+    free(buffer);
+    binaryPinchFile_destruct(input);
+
+    if (runNumber > 1) {
+        mergeRuns(runFiles, outputHandle);
+        for (int64_t i = 0; i < stList_length(runFiles); i++) {
+            stFile_rmtree(stList_get(runFiles, i));
+        }
+    }
+    stList_destruct(runFiles);
+    if (fclose(outputHandle) != 0) {
+        st_errAbort("Failed to write sorted pinches: %s", outputFile);
+    }
+    st_logInfo("Sorted %" PRIi64 " pinches by score in %" PRIi64 " runs\n", recordNumber, runNumber);
+}
+
 stSortedSetIterator *startAlignmentStackForAlignedPairs(stSortedSetIterator *it) {
     while (stSortedSet_getPrevious(it) != NULL) {
         ;
@@ -0,0 +1,239 @@
+#include "sonLib.h"
+#include "cactus.h"
+#include "stPinchGraphs.h"
+#include "stCaf.h"
+#include <time.h>
+
+///////////////////////////////////////////////////////////////////////////
+// Per round statistics of the pinch graph, logged and optionally written
+// as JSON lines.
+///////////////////////////////////////////////////////////////////////////
+
+#define TELEMETRY_LOG2_BUCKETS 64 // Bucket i counts the values in [2^i, 2^(i+1)), with zero in bucket 0
+#define TELEMETRY_SUPPORT_BUCKETS 20 // Buckets of width 0.05 over [0, 1], with support of 1 or more in the last
+
+static FILE *telemetryFileHandle = NULL;
+static double roundStartTime = 0.0;
+
+typedef struct _distribution {
+    double min;
+    double mean;
+    double median;
+    double p90;
+    double max;
+} Distribution;
+
+typedef struct _graphStatistics {
+    int64_t blockNumber;
+    int64_t alignedBases;
+    Distribution degree;
+    Distribution support;
+    int64_t degreeHistogram[TELEMETRY_LOG2_BUCKETS];
+    int64_t supportHistogram[TELEMETRY_SUPPORT_BUCKETS];
+} GraphStatistics;
+
+static double getTime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1.0e9;
+}
+
+void stCaf_enableTelemetry(const char *telemetryFile) {
+    stCaf_disableTelemetry();
+    telemetryFileHandle = fopen(telemetryFile, "w");
+    if (telemetryFileHandle == NULL) {
+        st_errAbort("Could not open telemetry file for writing: %s", telemetryFile);
+    }
+    roundStartTime = getTime();
+}
+
+bool stCaf_isTelemetryEnabled(void) {
+    return telemetryFileHandle != NULL;
+}
+
+void stCaf_disableTelemetry(void) {
+    if (telemetryFileHandle != NULL) {
+        fclose(telemetryFileHandle);
+        telemetryFileHandle = NULL;
+    }
+}
+
+void stCaf_startRound(void) {
+    roundStartTime = getTime();
+}
+
+static int64_t getLog2Bucket(uint64_t value) {
+    int64_t bucket = 0;
+    while (value > 1) {
+        value >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+/*
+ * Returns the kth smallest of the values, partially reordering them (Hoare's selection, linear expected time).
+ */
+static double selectKth(double *values, int64_t length, int64_t k) {
+    int64_t low = 0, high = length - 1;
+    while (low < high) {
+        double pivot = values[low + (high - low) / 2];
+        int64_t i = low, j = high;
+        while (i <= j) {
+            while (values[i] < pivot) {
+                i++;
+            }
+            while (values[j] > pivot) {
+                j--;
+            }
+            if (i <= j) {
+                double t = values[i];
+                values[i++] = values[j];
+                values[j--] = t;
+            }
+        }
+        if (k <= j) {
+            high = j;
+        } else if (k >= i) {
+            low = i;
+        } else {
+            break;
+        }
+    }
+    return values[k];
+}
+
+/*
+ * Fills out the summary of the values, which are reordered.
+ */
+static void getDistribution(double *values, int64_t length, Distribution *distribution) {
+    memset(distribution, 0, sizeof(Distribution));
+    if (length == 0) {
+        return;
+    }
+    distribution->min = values[0];
+    distribution->max = values[0];
+    for (int64_t i = 0; i < length; i++) {
+        distribution->mean += values[i];
+        distribution->min = values[i] < distribution->min ? values[i] : distribution->min;
+        distribution->max = values[i] > distribution->max ? values[i] : distribution->max;
+    }
+    distribution->mean /= length;
+    distribution->median = selectKth(values, length, (length - 1) / 2);
+    distribution->p90 = selectKth(values, length, (int64_t)((length - 1) * 0.9));
+}
+
+static void getGraphStatistics(stPinchThreadSet *threadSet, Flower *flower, GraphStatistics *statistics) {
+    memset(statistics, 0, sizeof(GraphStatistics));
+    stPinchBlock **blocks = stCaf_getBlockArray(threadSet, &statistics->blockNumber);
+    double *degrees = st_malloc(sizeof(double) * (statistics->blockNumber + 1));
+    double *supports = st_malloc(sizeof(double) * (statistics->blockNumber + 1));
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic, 64)
+#endif
+    for (int64_t i = 0; i < statistics->blockNumber; i++) {
+        uint64_t possibleSupportingHomologies = stCaf_numPossibleSupportingHomologies(blocks[i], flower);
+        degrees[i] = stPinchBlock_getDegree(blocks[i]);
+        supports[i] = possibleSupportingHomologies == 0 ? 0.0 :
+                      ((double) stPinchBlock_getNumSupportingHomologies(blocks[i])) / possibleSupportingHomologies;
+    }
+    for (int64_t i = 0; i < statistics->blockNumber; i++) {
+        statistics->alignedBases += stPinchBlock_getLength(blocks[i]) * stPinchBlock_getDegree(blocks[i]);
+        statistics->degreeHistogram[getLog2Bucket(degrees[i])]++;
+        int64_t bucket = supports[i] * TELEMETRY_SUPPORT_BUCKETS;
+        statistics->supportHistogram[bucket < TELEMETRY_SUPPORT_BUCKETS ? bucket : TELEMETRY_SUPPORT_BUCKETS - 1]++;
+    }
+    getDistribution(degrees, statistics->blockNumber, &statistics->degree);
+    getDistribution(supports, statistics->blockNumber, &statistics->support);
+    free(blocks);
+    free(degrees);
+    free(supports);
+}
+
+static void writeHistogram(FILE *fileHandle, int64_t *counts, int64_t length) {
+    while (length > 1 && counts[length - 1] == 0) { // Trim the empty buckets off the end
+        length--;
+    }
+    fprintf(fileHandle, "[");
+    for (int64_t i = 0; i < length; i++) {
+        fprintf(fileHandle, i == 0 ? "%" PRIi64 : ", %" PRIi64, counts[i]);
+    }
+    fprintf(fileHandle, "]");
+}
+
+static void writeDistribution(FILE *fileHandle, Distribution *distribution) {
+    fprintf(fileHandle, "\"min\": %.6g, \"mean\": %.6g, \"median\": %.6g, \"p90\": %.6g, \"max\": %.6g",
+            distribution->min, distribution->mean, distribution->median, distribution->p90, distribution->max);
+}
+
+/*
+ * Writes the number of adjacency components and the distribution of their sizes, in pinch ends.
+ */
+static void writeAdjacencyComponents(FILE *fileHandle, stPinchThreadSet *threadSet) {
+    stList *adjacencyComponents = stPinchThreadSet_getAdjacencyComponents(threadSet);
+    int64_t componentNumber = stList_length(adjacencyComponents);
+    double *sizes = st_malloc(sizeof(double) * (componentNumber + 1));
+    int64_t histogram[TELEMETRY_LOG2_BUCKETS] = { 0 };
+    for (int64_t i = 0; i < componentNumber; i++) {
+        sizes[i] = stList_length(stList_get(adjacencyComponents, i));
+        histogram[getLog2Bucket(sizes[i])]++;
+    }
+    Distribution distribution;
+    getDistribution(sizes, componentNumber, &distribution);
+    fprintf(fileHandle, "\"adjacencyComponents\": {\"count\": %" PRIi64 ", ", componentNumber);
+    writeDistribution(fileHandle, &distribution);
+    fprintf(fileHandle, ", \"log2Histogram\": ");
+    writeHistogram(fileHandle, histogram, TELEMETRY_LOG2_BUCKETS);
+    fprintf(fileHandle, "}");
+    free(sizes);
+    stList_destruct(adjacencyComponents);
+}
+
+int64_t stCaf_reportRound(stPinchThreadSet *threadSet, Flower *flower, const char *roundType, int64_t round,
+                          int64_t minimumChainLength, int64_t previousAlignedBases, int64_t megablocksDestroyed) {
+    double seconds = getTime() - roundStartTime;
+    GraphStatistics statistics;
+    getGraphStatistics(threadSet, flower, &statistics);
+    int64_t alignedBasesLost = previousAlignedBases >= 0 ? previousAlignedBases - statistics.alignedBases : 0;
+
+    st_logInfo("There were %" PRIi64 " blocks in the sequence graph, representing %" PRIi64
+               " total aligned bases\n", statistics.blockNumber, statistics.alignedBases);
+    st_logInfo("Block degree stats: min %.0f, avg %lf, median %.0f, max %.0f\n", statistics.degree.min,
+               statistics.degree.mean, statistics.degree.median, statistics.degree.max);
+    st_logInfo("Block support stats: min %lf, avg %lf, median %lf, max %lf\n", statistics.support.min,
+               statistics.support.mean, statistics.support.median, statistics.support.max);
+
+    if (telemetryFileHandle != NULL) {
+        FILE *f = telemetryFileHandle;
+        fprintf(f, "{\"flower\": %" PRIi64 ", \"roundType\": \"%s\", \"round\": %" PRIi64 ", "
+                "\"minimumChainLength\": %" PRIi64 ", \"seconds\": %.6f, \"blocks\": %" PRIi64 ", "
+                "\"alignedBases\": %" PRIi64 ", \"alignedBasesLost\": %" PRIi64 ", \"megablocksDestroyed\": %" PRIi64 ", ",
+                flower_getName(flower), roundType, round, minimumChainLength, seconds, statistics.blockNumber,
+                statistics.alignedBases, alignedBasesLost, megablocksDestroyed);
+        fprintf(f, "\"degree\": {");
+        writeDistribution(f, &statistics.degree);
+        fprintf(f, ", \"log2Histogram\": ");
+        writeHistogram(f, statistics.degreeHistogram, TELEMETRY_LOG2_BUCKETS);
+        fprintf(f, "}, \"support\": {");
+        writeDistribution(f, &statistics.support);
+        fprintf(f, ", \"histogram\": ");
+        writeHistogram(f, statistics.supportHistogram, TELEMETRY_SUPPORT_BUCKETS);
+        fprintf(f, "}, ");
+        writeAdjacencyComponents(f, threadSet);
+        fprintf(f, "}\n");
+        fflush(f);
+    }
+    return statistics.alignedBases;
+}
+
+void stCaf_reportMeltingRound(Flower *flower, int64_t round, int64_t minimumChainLength, int64_t blocksDestroyed,
+                              int64_t alignedBasesBefore, int64_t alignedBasesAfter) {
+    if (telemetryFileHandle != NULL) {
+        fprintf(telemetryFileHandle, "{\"flower\": %" PRIi64 ", \"roundType\": \"meltingRound\", \"round\": %" PRIi64 ", "
+                "\"minimumChainLength\": %" PRIi64 ", \"blocksDestroyed\": %" PRIi64 ", \"alignedBasesBefore\": %" PRIi64 ", "
+                "\"alignedBasesAfter\": %" PRIi64 ", \"alignedBasesLost\": %" PRIi64 "}\n",
+                flower_getName(flower), round, minimumChainLength, blocksDestroyed, alignedBasesBefore,
+                alignedBasesAfter, alignedBasesBefore - alignedBasesAfter);
+        fflush(telemetryFileHandle);
+    }
+}
@@ -15,7 +15,8 @@
 #include "cactus.h"
 
 /*
- * The function to run the overall caf algorithm.
+ * The function to run the overall caf algorithm. The alignment files are binary pinch files
+ * (see stPinchIterator_constructFromBinaryFile).
  */
 void caf(Flower *flower, CactusParams *params, char *alignmentsFile, char *secondaryAlignmentsFile, char *constraintsFile, Event *referenceEvent);
 
@@ -69,12 +70,43 @@ typedef struct _filterArgs {
 } FilterArgs;
 
 /*
- * Removes homologies from the graph.
+ * The chains of a cactus graph, as found by stCaf_getChainLengths.
+ */
+typedef struct _stCafChains {
+    int64_t chainNumber;
+    stCactusEdgeEnd **chainEnds; // The chain end, with positive link orientation, each chain starts from
+    int64_t *lengths; // The total length of the blocks in each chain
+    int64_t *blockOffsets; // The blocks of chain i are blocks[blockOffsets[i]] to blocks[blockOffsets[i+1]-1], or NULL
+    stPinchBlock **blocks; // The blocks of the chains, excluding thread ends, in chain order, or NULL
+} stCafChains;
+
+/*
+ * Walks every chain of the cactus graph once, iteratively, getting its length and, if getBlocks is true, its
+ * blocks. The chains are in node iteration order.
+ */
+stCafChains *stCaf_getChainLengths(stCactusGraph *cactusGraph, bool getBlocks);
+
+void stCaf_destructChainLengths(stCafChains *chains);
+
+/*
+ * Returns the blocks of the thread set in an array, in block iterator order, setting blockNumber to its length.
+ */
+stPinchBlock **stCaf_getBlockArray(stPinchThreadSet *threadSet, int64_t *blockNumber);
+
+/*
+ * Removes homologies from the graph. The block filter is called on the blocks in parallel, so must only read the graph.
  */
 void stCaf_melt(Flower *flower, stPinchThreadSet *threadSet, bool blockFilterfn(stPinchBlock *, void *extraArg), void *extraArg,
                 int64_t blockEndTrim, int64_t minimumChainLength,
                 bool breakChainsAtReverseTandems, int64_t maximumMedianSpacingBetweenLinkedEnds);
 
+/*
+ * Equivalent to calling stCaf_melt with each of the given minimum chain lengths in turn, with no block filter or trim
+ * and without breaking chains, but builds the cactus graph once for all the rounds rather than once per round, unless
+ * a round splits a thread component. The minimum chain lengths need not be in order.
+ */
+void stCaf_meltRounds(Flower *flower, stPinchThreadSet *threadSet, int64_t *minimumChainLengths, int64_t roundNumber);
+
 /*
  * Removes any recoverable chains (those expected to be picked up by
  * bar phase) from the graph. Only chains that are recoverable *and*
@@ -248,8 +280,80 @@ bool stCaf_containsRequiredSpecies(stPinchBlock *pinchBlock, Flower *flower, int
 bool stCaf_treeCoverage(stPinchBlock *pinchBlock, Flower *flower);
 
 /*
- * Short way to get the event corresponding to a given segment.
+ * Short way to get the event corresponding to a given segment. Constant time for threads in the thread event
+ * index of the flower, else a search of the caps of the flower.
  */
 Event *stCaf_getEvent(stPinchSegment *segment, Flower *flower);
 
+/*
+ * Returns true if the segment is from an outgroup event.
+ */
+bool stCaf_isOutgroupSegment(stPinchSegment *segment, Flower *flower);
+
+/*
+ * Gets the number of possible pairwise alignments that could support the block. Ordinarily this is (degree choose 2),
+ * but since outgroups are not self-aligned it is a bit smaller, and ingroup-ingroup homologies can be seen twice.
+ */
+uint64_t stCaf_numPossibleSupportingHomologies(stPinchBlock *block, Flower *flower);
+
+/*
+ * Builds the index from the names of the threads in the thread set to their events, outgroup status and a dense
+ * species index, used by stCaf_getEvent and the alignment filters while the index exists. Replaces any existing
+ * index. The threads' caps must be in the flower.
+ */
+void stCaf_constructThreadEventIndex(Flower *flower, stPinchThreadSet *threadSet);
+
+/*
+ * Frees the thread event index, if there is one.
+ */
+void stCaf_destructThreadEventIndex(void);
+
+/*
+ * Empties the index's cache of the species of each block, if there is an index. The cache is keyed by block, and
+ * keeps the entries of destroyed blocks, so it is cleared before each annealing or block filtering pass to keep it
+ * to the blocks of one pass.
+ */
+void stCaf_clearBlockSpeciesCache(void);
+
+///////////////////////////////////////////////////////////////////////////
+// Telemetry -- statistics of the pinch graph after each round
+///////////////////////////////////////////////////////////////////////////
+
+/*
+ * Turns on telemetry, writing one JSON record per line to the given file for each round reported with
+ * stCaf_reportRound. Until this is called rounds are only summarised in the log.
+ */
+void stCaf_enableTelemetry(const char *telemetryFile);
+
+/*
+ * Returns non-zero if telemetry is enabled.
+ */
+bool stCaf_isTelemetryEnabled(void);
+
+/*
+ * Closes the telemetry file and disables telemetry.
+ */
+void stCaf_disableTelemetry(void);
+
+/*
+ * Marks the start of a round, whose time is reported by the next call to stCaf_reportRound.
+ */
+void stCaf_startRound(void);
+
+/*
+ * Logs a summary of the blocks of the graph and, if telemetry is enabled, writes a record of the round: the block,
+ * degree, support and adjacency component statistics, the aligned bases lost since previousAlignedBases (ignored if
+ * negative), the given number of megablocks destroyed and the time since stCaf_startRound. Returns the total number
+ * of aligned bases in the graph, to pass to the report of the next round.
+ */
+int64_t stCaf_reportRound(stPinchThreadSet *threadSet, Flower *flower, const char *roundType, int64_t round,
+                          int64_t minimumChainLength, int64_t previousAlignedBases, int64_t megablocksDestroyed);
+
+/*
+ * If telemetry is enabled, writes a record of one of the rounds of stCaf_meltRounds: its index, minimum chain length,
+ * the number of blocks it destroyed and the total aligned bases in the graph before and after it.
+ */
+void stCaf_reportMeltingRound(Flower *flower, int64_t round, int64_t minimumChainLength, int64_t blocksDestroyed,
+                              int64_t alignedBasesBefore, int64_t alignedBasesAfter);
+
 #endif /* STCAF_H_ */
@@ -10,6 +10,7 @@
 
 #include "sonLib.h"
 #include "stPinchGraphs.h"
+#include "paf.h"
 
 typedef struct _stPinchIterator {
     int64_t alignmentTrim;
@@ -42,6 +43,33 @@ void stPinchIterator_destruct(
  */
 stPinchIterator *stPinchIterator_constructFromFile(const char *alignmentFile);
 
+/*
+ * Get a pairwise alignment iterator from a binary pinch file, as written by stPinchIterator_writeBinaryHeader
+ * and stPinchIterator_writeBinaryPinches. The file is mmapped, so resetting the iterator costs nothing and
+ * the alignments are only ever parsed once, when the file is written.
+ */
+stPinchIterator *stPinchIterator_constructFromBinaryFile(const char *pinchFile);
+
+/*
+ * Writes the header of a binary pinch file. Must be called once, before any pinches are written.
+ */
+void stPinchIterator_writeBinaryHeader(FILE *fileHandle);
+
+/*
+ * Writes the gapless pinches of the given alignment to a binary pinch file as fixed width records, each carrying
+ * the score of the alignment. The query and target names of the alignment must be cactus names
+ * (see cactusMisc_nameToString). Returns the number of pinches written.
+ */
+int64_t stPinchIterator_writeBinaryPinches(FILE *fileHandle, Paf *paf);
+
+/*
+ * Writes a copy of a binary pinch file with the pinches sorted by the score of the alignment they came from, in
+ * descending order. Pinches of equal score keep their order, so the pinches of an alignment stay together. Runs of
+ * the input that fit in memoryBudget bytes are sorted using all threads and spilled to temporary files next to the
+ * output, which are then merged.
+ */
+void stPinchIterator_sortBinaryFileByScore(const char *inputFile, const char *outputFile, int64_t memoryBudget);
+
 /*
  * Constructs iterator from aligned pairs.
  */
@@ -13,6 +13,8 @@ CuSuite* pinchIteratorTestSuite(void);
 CuSuite* recoverableChainsTestSuite(void);
 CuSuite* phylogenyTestSuite(void);
 CuSuite* filteringTestSuite(void);
+CuSuite* meltingTestSuite(void);
+CuSuite* finishingTestSuite(void);
 
 int cactusCoreRunAllTests(void) {
     CuString *output = CuStringNew();
@@ -23,6 +25,8 @@ int cactusCoreRunAllTests(void) {
     CuSuiteAddSuite(suite, recoverableChainsTestSuite());
     CuSuiteAddSuite(suite, phylogenyTestSuite());
     CuSuiteAddSuite(suite, filteringTestSuite());
+    CuSuiteAddSuite(suite, meltingTestSuite());
+    CuSuiteAddSuite(suite, finishingTestSuite());
 
     CuSuiteRun(suite);
     CuSuiteSummary(suite, output);
@@ -348,11 +348,109 @@ static void testHGVMFiltering(CuTest *testCase) {
     }
 }
 
+// Checks the filters give the same answers using the thread event index as they do searching the flower's caps.
+static void testThreadEventIndex(CuTest *testCase) {
+    for (int64_t testNum = 0; testNum < 20; testNum++) {
+        setup(testCase, true);
+        Event *events[] = { ingroup1, ingroup2, outgroup1, outgroup2 };
+        for (int64_t i = 0; i < 8; i++) {
+            addThreadToFlower(flower, events[st_randomInt(0, 4)], 100);
+        }
+        stPinchThreadSet *threadSet = stCaf_setup(flower);
+        for (int64_t i = 0; i < 100; i++) {
+            stPinch pinch = stPinchThreadSet_getRandomPinch(threadSet);
+            stPinchThread_pinch(stPinchThreadSet_getThread(threadSet, pinch.name1),
+                                stPinchThreadSet_getThread(threadSet, pinch.name2),
+                                pinch.start1, pinch.start2, pinch.length, pinch.strand);
+        }
+        for (int64_t i = 0; i < 100; i++) {
+            stPinch pinch = stPinchThreadSet_getRandomPinch(threadSet);
+            stPinchSegment *segment1 = stPinchThread_getSegment(stPinchThreadSet_getThread(threadSet, pinch.name1), pinch.start1);
+            stPinchSegment *segment2 = stPinchThread_getSegment(stPinchThreadSet_getThread(threadSet, pinch.name2), pinch.start2);
+
+            bool repeatSpecies = stCaf_filterByRepeatSpecies(segment1, segment2, flower);
+            bool singleCopyIngroup = stCaf_singleCopyIngroup(segment1, segment2, flower);
+            bool outgroup = stCaf_isOutgroupSegment(segment1, flower);
+            Event *event = stCaf_getEvent(segment1, flower);
+            bool requiredSpecies = stPinchSegment_getBlock(segment1) != NULL &&
+                                   stCaf_containsRequiredSpecies(stPinchSegment_getBlock(segment1), flower, 1, 1, 2, 2);
+
+            stCaf_constructThreadEventIndex(flower, threadSet);
+            CuAssertIntEquals(testCase, repeatSpecies, stCaf_filterByRepeatSpecies(segment1, segment2, flower));
+            CuAssertIntEquals(testCase, singleCopyIngroup, stCaf_singleCopyIngroup(segment1, segment2, flower));
+            CuAssertIntEquals(testCase, outgroup, stCaf_isOutgroupSegment(segment1, flower));
+            CuAssertPtrEquals(testCase, event, stCaf_getEvent(segment1, flower));
+            CuAssertIntEquals(testCase, requiredSpecies, stPinchSegment_getBlock(segment1) != NULL &&
+                              stCaf_containsRequiredSpecies(stPinchSegment_getBlock(segment1), flower, 1, 1, 2, 2));
+            stCaf_destructThreadEventIndex();
+        }
+        stPinchThreadSet_destruct(threadSet);
+        teardown(testCase);
+    }
+}
+
+// Gets the events of the segment's block, or of the segment if it has no block.
+static stSet *getEventsOfBlock(stPinchSegment *segment) {
+    stSet *events = stSet_construct();
+    stPinchBlock *block = stPinchSegment_getBlock(segment);
+    if (block == NULL) {
+        stSet_insert(events, cap_getEvent(flower_getCap(flower, stPinchSegment_getName(segment))));
+        return events;
+    }
+    stPinchBlockIt it = stPinchBlock_getSegmentIterator(block);
+    while ((segment = stPinchBlockIt_getNext(&it)) != NULL) {
+        stSet_insert(events, cap_getEvent(flower_getCap(flower, stPinchSegment_getName(segment))));
+    }
+    return events;
+}
+
+// Checks the cached block species stay correct as blocks are merged and split by pinches made while the index exists.
+static void testBlockSpeciesCache(CuTest *testCase) {
+    for (int64_t testNum = 0; testNum < 20; testNum++) {
+        setup(testCase, true);
+        Event *events[] = { ingroup1, ingroup2, outgroup1, outgroup2 };
+        for (int64_t i = 0; i < 8; i++) {
+            addThreadToFlower(flower, events[st_randomInt(0, 4)], 100);
+        }
+        stPinchThreadSet *threadSet = stCaf_setup(flower);
+        stCaf_constructThreadEventIndex(flower, threadSet);
+        for (int64_t i = 0; i < 200; i++) {
+            stPinch pinch = stPinchThreadSet_getRandomPinch(threadSet);
+            stPinchSegment *segment1 = stPinchThread_getSegment(stPinchThreadSet_getThread(threadSet, pinch.name1), pinch.start1);
+            stPinchSegment *segment2 = stPinchThread_getSegment(stPinchThreadSet_getThread(threadSet, pinch.name2), pinch.start2);
+
+            stSet *events1 = getEventsOfBlock(segment1);
+            stSet *events2 = getEventsOfBlock(segment2);
+            stSet *sharedEvents = stSet_getIntersection(events1, events2);
+            CuAssertIntEquals(testCase, stSet_size(sharedEvents) > 0, stCaf_filterByRepeatSpecies(segment1, segment2, flower));
+            bool moreThanOneEvent = stPinchSegment_getBlock(segment1) != NULL && stSet_size(events1) > 1
+                                    && stPinchSegment_getBlock(segment2) != NULL && stSet_size(events2) > 1
+                                    && stPinchSegment_getBlock(segment1) != stPinchSegment_getBlock(segment2);
+            if (stPinchSegment_getBlock(segment1) != stPinchSegment_getBlock(segment2)) {
+                CuAssertIntEquals(testCase, moreThanOneEvent, stCaf_filterByMultipleSpecies(segment1, segment2, flower));
+            }
+            stSet_destruct(events1);
+            stSet_destruct(events2);
+            stSet_destruct(sharedEvents);
+
+            // Make the pinch, merging and splitting blocks
+            stPinchThread_pinch(stPinchThreadSet_getThread(threadSet, pinch.name1),
+                                stPinchThreadSet_getThread(threadSet, pinch.name2),
+                                pinch.start1, pinch.start2, pinch.length, pinch.strand);
+        }
+        stCaf_destructThreadEventIndex();
+        stPinchThreadSet_destruct(threadSet);
+        teardown(testCase);
+    }
+}
+
 CuSuite* filteringTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testChainHasUnequalNumberOfIngroupCopies);
     SUITE_ADD_TEST(suite, testChainHasUnequalNumberOfIngroupCopiesOrNoOutgroup);
     SUITE_ADD_TEST(suite, testChainHasUnequalNumberOfIngroupCopiesOrNoOutgroup_noOutgroups);
     SUITE_ADD_TEST(suite, testHGVMFiltering);
+    SUITE_ADD_TEST(suite, testThreadEventIndex);
+    SUITE_ADD_TEST(suite, testBlockSpeciesCache);
     return suite;
 }
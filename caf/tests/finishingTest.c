@@ -0,0 +1,109 @@
+#include "CuTest.h"
+#include "sonLib.h"
+#include "stCaf.h"
+#include "stPinchGraphs.h"
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+#define THREAD_LENGTH 100
+
+// Applies the pinch to the thread set.
+static void applyPinch(stPinchThreadSet *threadSet, stPinch *pinch) {
+    stPinchThread_pinch(stPinchThreadSet_getThread(threadSet, pinch->name1), stPinchThreadSet_getThread(threadSet, pinch->name2),
+                        pinch->start1, pinch->start2, pinch->length, pinch->strand);
+}
+
+// Describes the flower and its nested flowers, one object per line, in the order the flowers hold them.
+static void describeFlower(Flower *flower, stList *lines) {
+    stList_append(lines, stString_print("flower %" PRIi64, flower_getName(flower)));
+    End *end;
+    Flower_EndIterator *endIt = flower_getEndIterator(flower);
+    while ((end = flower_getNextEnd(endIt)) != NULL) {
+        stList_append(lines, stString_print("end %" PRIi64 " %" PRIi64, end_getName(end),
+                                            end_getGroup(end) == NULL ? -1 : group_getName(end_getGroup(end))));
+        Block *block = end_isBlockEnd(end) ? end_getBlock(end) : NULL;
+        if (block != NULL && end_getName(block_get5End(block)) == end_getName(end)) { // Each block once
+            stList_append(lines, stString_print("block %" PRIi64 " %" PRIi64, block_getName(block), block_getLength(block)));
+            Segment *segment;
+            Block_InstanceIterator *segmentIt = block_getInstanceIterator(block);
+            while ((segment = block_getNext(segmentIt)) != NULL) {
+                stList_append(lines, stString_print("segment %" PRIi64 " %" PRIi64, segment_getName(segment),
+                                                    segment_getStart(segment)));
+            }
+            block_destructInstanceIterator(segmentIt);
+        }
+    }
+    flower_destructEndIterator(endIt);
+    Chain *chain;
+    Flower_ChainIterator *chainIt = flower_getChainIterator(flower);
+    while ((chain = flower_getNextChain(chainIt)) != NULL) {
+        stList_append(lines, stString_print("chain %" PRIi64, chain_getName(chain)));
+    }
+    flower_destructChainIterator(chainIt);
+    Group *group;
+    Flower_GroupIterator *groupIt = flower_getGroupIterator(flower);
+    while ((group = flower_getNextGroup(groupIt)) != NULL) {
+        stList_append(lines, stString_print("group %" PRIi64, group_getName(group)));
+        if (group_getNestedFlower(group) != NULL) {
+            describeFlower(group_getNestedFlower(group), lines);
+        }
+    }
+    flower_destructGroupIterator(groupIt);
+}
+
+// Checks finishing the same pinch graph with one thread and with several gives the same flowers with the same names.
+static void testFinishIndependentOfThreadNumber(CuTest *testCase) {
+#if defined(_OPENMP)
+    int maxThreads = omp_get_max_threads();
+#endif
+    for (int64_t test = 0; test < 100; test++) {
+        stList *threadNames = stList_construct3(0, free);
+        int64_t threadNumber = st_randomInt(2, 8);
+        Flower *flower1 = testCommon_constructFlowerWithThreads(threadNumber, THREAD_LENGTH, threadNames);
+        Flower *flower2 = testCommon_constructFlowerWithThreads(threadNumber, THREAD_LENGTH, NULL);
+        stPinchThreadSet *threadSet1 = stCaf_setup(flower1);
+        stPinchThreadSet *threadSet2 = stCaf_setup(flower2);
+        int64_t pinchNumber = st_randomInt(0, 200);
+        for (int64_t i = 0; i < pinchNumber; i++) {
+            stPinch pinch = testCommon_getRandomPinch(threadNames, THREAD_LENGTH);
+            applyPinch(threadSet1, &pinch);
+            applyPinch(threadSet2, &pinch);
+        }
+
+#if defined(_OPENMP)
+        omp_set_num_threads(1);
+#endif
+        stCaf_finish(flower1, threadSet1, INT64_MAX, INT64_MAX);
+#if defined(_OPENMP)
+        omp_set_num_threads(4);
+#endif
+        stCaf_finish(flower2, threadSet2, INT64_MAX, INT64_MAX);
+#if defined(_OPENMP)
+        omp_set_num_threads(maxThreads);
+#endif
+
+        stList *lines1 = stList_construct3(0, free), *lines2 = stList_construct3(0, free);
+        describeFlower(flower1, lines1);
+        describeFlower(flower2, lines2);
+        CuAssertIntEquals(testCase, stList_length(lines1), stList_length(lines2));
+        for (int64_t i = 0; i < stList_length(lines1); i++) {
+            CuAssertStrEquals(testCase, stList_get(lines1, i), stList_get(lines2, i));
+        }
+
+        stList_destruct(lines1);
+        stList_destruct(lines2);
+        stPinchThreadSet_destruct(threadSet1);
+        stPinchThreadSet_destruct(threadSet2);
+        stList_destruct(threadNames);
+        cactusDisk_destruct(flower_getCactusDisk(flower1));
+        cactusDisk_destruct(flower_getCactusDisk(flower2));
+    }
+}
+
+CuSuite* finishingTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testFinishIndependentOfThreadNumber);
+    return suite;
+}
@@ -136,6 +136,95 @@ static void testBreakUpComponentGreedily(CuTest *testCase) {
     }
 }
 
+stList *stCaf_breakupComponentGreedily2(stList *adjacencyComponent, int64_t maximumAdjacencyComponentSize);
+
+/*
+ * The graph of an adjacency component as it was built before the graphs were flattened: a node per end, and an
+ * edge (weight, node1, node2) per pair of adjacent ends, counted in a hash.
+ */
+static void getAdjacencyComponentNodesAndEdges(stList *adjacencyComponent, stList **nodes, stList **edges) {
+    *nodes = stList_construct3(0, (void(*)(void *)) stIntTuple_destruct);
+    stHash *pinchEndsToNodes = stHash_construct3(stPinchEnd_hashFn, stPinchEnd_equalsFn, NULL, NULL);
+    for (int64_t i = 0; i < stList_length(adjacencyComponent); i++) {
+        stIntTuple *node = stIntTuple_construct1(i);
+        stList_append(*nodes, node);
+        stHash_insert(pinchEndsToNodes, stList_get(adjacencyComponent, i), node);
+    }
+    stHash *edgesToMultiplicity = stHash_construct3((uint64_t(*)(const void *)) stIntTuple_hashKey,
+            (int(*)(const void *, const void *)) stIntTuple_equalsFn, (void(*)(void *)) stIntTuple_destruct,
+            (void(*)(void *)) stIntTuple_destruct);
+    for (int64_t i = 0; i < stList_length(adjacencyComponent); i++) {
+        stPinchEnd *pinchEnd1 = stList_get(adjacencyComponent, i);
+        stPinchBlockIt segmentIt = stPinchBlock_getSegmentIterator(stPinchEnd_getBlock(pinchEnd1));
+        stPinchSegment *segment;
+        while ((segment = stPinchBlockIt_getNext(&segmentIt)) != NULL) {
+            bool traverse5Prime = stPinchEnd_traverse5Prime(stPinchEnd_getOrientation(pinchEnd1), segment);
+            stPinchSegment *segment2 = traverse5Prime ? stPinchSegment_get5Prime(segment) : stPinchSegment_get3Prime(segment);
+            while (segment2 != NULL) {
+                if (stPinchSegment_getBlock(segment2) != NULL) {
+                    stPinchEnd pinchEnd2 = stPinchEnd_constructStatic(stPinchSegment_getBlock(segment2),
+                            stPinchEnd_endOrientation(traverse5Prime, segment2));
+                    int64_t node2 = stIntTuple_get(stHash_search(pinchEndsToNodes, &pinchEnd2), 0);
+                    if (i != node2) { //Ignore self edges
+                        stIntTuple *edge = i < node2 ? stIntTuple_construct2(i, node2) : stIntTuple_construct2(node2, i);
+                        int64_t multiplicity = 1;
+                        if (stHash_search(edgesToMultiplicity, edge) != NULL) {
+                            stIntTuple *count = stHash_removeAndFreeKey(edgesToMultiplicity, edge);
+                            multiplicity += stIntTuple_get(count, 0);
+                            stIntTuple_destruct(count);
+                        }
+                        stHash_insert(edgesToMultiplicity, edge, stIntTuple_construct1(multiplicity));
+                    }
+                    break;
+                }
+                segment2 = traverse5Prime ? stPinchSegment_get5Prime(segment2) : stPinchSegment_get3Prime(segment2);
+            }
+        }
+    }
+    *edges = stList_construct3(0, (void(*)(void *)) stIntTuple_destruct);
+    stHashIterator *hashIt = stHash_getIterator(edgesToMultiplicity);
+    stIntTuple *edge;
+    while ((edge = stHash_getNext(hashIt)) != NULL) {
+        stIntTuple *count = stHash_search(edgesToMultiplicity, edge);
+        stList_append(*edges, stIntTuple_construct3(stIntTuple_get(count, 0), stIntTuple_get(edge, 0), stIntTuple_get(edge, 1)));
+    }
+    stHash_destructIterator(hashIt);
+    stHash_destruct(pinchEndsToNodes);
+    stHash_destruct(edgesToMultiplicity);
+}
+
+/*
+ * Checks the flattened graph of each adjacency component of a random pinch graph is broken up along the same edges,
+ * in the same order, as the graph built with hashes.
+ */
+static void testBreakUpAdjacencyComponentSameAsHashedGraph(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        stPinchThreadSet *threadSet = stPinchThreadSet_getRandomGraph();
+        stList *adjacencyComponents = stPinchThreadSet_getAdjacencyComponents(threadSet);
+        for (int64_t i = 0; i < stList_length(adjacencyComponents); i++) {
+            stList *adjacencyComponent = stList_get(adjacencyComponents, i);
+            int64_t maxSize = st_randomInt(1, stList_length(adjacencyComponent) + 1);
+            stList *nodes, *edges;
+            getAdjacencyComponentNodesAndEdges(adjacencyComponent, &nodes, &edges);
+            stList *expectedEdgesToDelete = stCaf_breakupComponentGreedily(nodes, edges, maxSize);
+            stList *edgesToDelete = stCaf_breakupComponentGreedily2(adjacencyComponent, maxSize);
+            CuAssertIntEquals(testCase, stList_length(expectedEdgesToDelete), stList_length(edgesToDelete));
+            for (int64_t j = 0; j < stList_length(edgesToDelete); j++) {
+                stIntTuple *expectedEdge = stList_get(expectedEdgesToDelete, j);
+                stIntTuple *edge = stList_get(edgesToDelete, j);
+                CuAssertIntEquals(testCase, stIntTuple_get(expectedEdge, 1), stIntTuple_get(edge, 0));
+                CuAssertIntEquals(testCase, stIntTuple_get(expectedEdge, 2), stIntTuple_get(edge, 1));
+            }
+            stList_destruct(edgesToDelete);
+            stList_destruct(expectedEdgesToDelete);
+            stList_destruct(edges);
+            stList_destruct(nodes);
+        }
+        stList_destruct(adjacencyComponents);
+        stPinchThreadSet_destruct(threadSet);
+    }
+}
+
 static int64_t getSizeOfLargestAdjacencyComponent(stList *adjacencyComponents) {
     int64_t largestAdjacencyComponentSizeInGraph = 0;
     for (int64_t i = 0; i < stList_length(adjacencyComponents); i++) {
@@ -184,5 +273,6 @@ CuSuite* giantComponentTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testBreakUpComponentGreedily);
     SUITE_ADD_TEST(suite, testBreakUpPinchGraphAdjacencyComponentsGreedily);
+    SUITE_ADD_TEST(suite, testBreakUpAdjacencyComponentSameAsHashedGraph);
     return suite;
 }
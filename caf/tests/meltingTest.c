@@ -0,0 +1,132 @@
+#include "CuTest.h"
+#include "sonLib.h"
+#include "stCaf.h"
+#include "stPinchGraphs.h"
+
+#define THREAD_LENGTH 100
+
+// Applies the pinch to the thread set.
+static void applyPinch(stPinchThreadSet *threadSet, stPinch *pinch) {
+    stPinchThread_pinch(stPinchThreadSet_getThread(threadSet, pinch->name1), stPinchThreadSet_getThread(threadSet, pinch->name2),
+                        pinch->start1, pinch->start2, pinch->length, pinch->strand);
+}
+
+/*
+ * Makes a flower in a new cactus disk with a few random threads, and a pinch graph of them in threadSet1 with random
+ * pinches. If threadSet2 is not NULL it is given an empty pinch graph of the flower with the same pinches.
+ */
+static Flower *makeRandomPinchGraph(stList *threadNames, stPinchThreadSet **threadSet1, stPinchThreadSet **threadSet2) {
+    Flower *flower = testCommon_constructFlowerWithThreads(st_randomInt(2, 8), THREAD_LENGTH, threadNames);
+    *threadSet1 = stCaf_setup(flower);
+    if (threadSet2 != NULL) {
+        *threadSet2 = stCaf_constructEmptyPinchGraph(flower);
+    }
+    int64_t pinchNumber = st_randomInt(0, 100);
+    for (int64_t i = 0; i < pinchNumber; i++) {
+        stPinch pinch = testCommon_getRandomPinch(threadNames, THREAD_LENGTH);
+        applyPinch(*threadSet1, &pinch);
+        if (threadSet2 != NULL) {
+            applyPinch(*threadSet2, &pinch);
+        }
+    }
+    return flower;
+}
+
+// Checks each base of each thread is aligned to the same number of bases in both thread sets.
+static void checkSameAlignment(CuTest *testCase, stPinchThreadSet *threadSet1, stPinchThreadSet *threadSet2,
+                               stList *threadNames) {
+    CuAssertIntEquals(testCase, stPinchThreadSet_getTotalBlockNumber(threadSet1),
+                      stPinchThreadSet_getTotalBlockNumber(threadSet2));
+    for (int64_t i = 0; i < stList_length(threadNames); i++) {
+        Name name = *(Name *)stList_get(threadNames, i);
+        stPinchThread *thread1 = stPinchThreadSet_getThread(threadSet1, name);
+        stPinchThread *thread2 = stPinchThreadSet_getThread(threadSet2, name);
+        for (int64_t j = stPinchThread_getStart(thread1); j < stPinchThread_getStart(thread1) + stPinchThread_getLength(thread1); j++) {
+            stPinchBlock *block1 = stPinchSegment_getBlock(stPinchThread_getSegment(thread1, j));
+            stPinchBlock *block2 = stPinchSegment_getBlock(stPinchThread_getSegment(thread2, j));
+            CuAssertIntEquals(testCase, block1 == NULL ? 0 : stPinchBlock_getDegree(block1),
+                              block2 == NULL ? 0 : stPinchBlock_getDegree(block2));
+        }
+    }
+}
+
+// Checks melting a sequence of rounds with a shared cactus graph gives the same graph as melting them one at a time.
+static void testMeltRounds(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        stList *threadNames = stList_construct3(0, free);
+        stPinchThreadSet *threadSet1, *threadSet2;
+        Flower *flower = makeRandomPinchGraph(threadNames, &threadSet1, &threadSet2);
+
+        int64_t minimumChainLengths[] = { 2, 4, 8, 16, 32 };
+        int64_t roundNumber = st_randomInt(1, 6);
+        for (int64_t i = 0; i < roundNumber; i++) {
+            stCaf_melt(flower, threadSet1, NULL, NULL, 0, minimumChainLengths[i], 0, INT64_MAX);
+        }
+        stCaf_meltRounds(flower, threadSet2, minimumChainLengths, roundNumber);
+        checkSameAlignment(testCase, threadSet1, threadSet2, threadNames);
+
+        stPinchThreadSet_destruct(threadSet1);
+        stPinchThreadSet_destruct(threadSet2);
+        stList_destruct(threadNames);
+        cactusDisk_destruct(flower_getCactusDisk(flower));
+    }
+}
+
+// Checks every block of the cactus graph is in exactly one chain, and the chain lengths add up to the aligned bases.
+static void testGetChainLengths(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        stList *threadNames = stList_construct3(0, free);
+        stPinchThreadSet *threadSet;
+        Flower *flower = makeRandomPinchGraph(threadNames, &threadSet, NULL);
+
+        stCactusNode *startCactusNode;
+        stList *deadEndComponent;
+        stCactusGraph *cactusGraph = stCaf_getCactusGraphForThreadSet(flower, threadSet, &startCactusNode,
+                                                                      &deadEndComponent, 0, INT64_MAX, 0.0, 0, INT64_MAX);
+        stCafChains *chains = stCaf_getChainLengths(cactusGraph, 1);
+        stCafChains *chainLengths = stCaf_getChainLengths(cactusGraph, 0);
+        CuAssertIntEquals(testCase, chains->chainNumber, chainLengths->chainNumber);
+        CuAssertPtrEquals(testCase, NULL, chainLengths->blocks);
+
+        int64_t totalChainLength = 0;
+        for (int64_t i = 0; i < chains->chainNumber; i++) {
+            CuAssertPtrEquals(testCase, chains->chainEnds[i], chainLengths->chainEnds[i]);
+            CuAssertIntEquals(testCase, chains->lengths[i], chainLengths->lengths[i]);
+            CuAssertTrue(testCase, chains->blockOffsets[i] <= chains->blockOffsets[i + 1]);
+            totalChainLength += chains->lengths[i];
+        }
+
+        // Each block is in one chain, thread ends aside
+        stSet *blocks = stSet_construct();
+        for (int64_t i = 0; i < chains->blockOffsets[chains->chainNumber]; i++) {
+            CuAssertPtrEquals(testCase, NULL, stSet_search(blocks, chains->blocks[i]));
+            stSet_insert(blocks, chains->blocks[i]);
+        }
+        int64_t totalBlockLength = 0;
+        stPinchThreadSetBlockIt blockIt = stPinchThreadSet_getBlockIt(threadSet);
+        stPinchBlock *block;
+        while ((block = stPinchThreadSetBlockIt_getNext(&blockIt)) != NULL) {
+            totalBlockLength += stPinchBlock_getLength(block);
+            stPinchSegment *segment = stPinchBlock_getFirst(block);
+            if (stPinchSegment_get5Prime(segment) != NULL && stPinchSegment_get3Prime(segment) != NULL) {
+                CuAssertTrue(testCase, stSet_search(blocks, block) != NULL);
+            }
+        }
+        CuAssertIntEquals(testCase, totalBlockLength, totalChainLength);
+
+        stSet_destruct(blocks);
+        stCaf_destructChainLengths(chains);
+        stCaf_destructChainLengths(chainLengths);
+        stCactusGraph_destruct(cactusGraph); // Also frees the adjacency components, including deadEndComponent
+        stPinchThreadSet_destruct(threadSet);
+        stList_destruct(threadNames);
+        cactusDisk_destruct(flower_getCactusDisk(flower));
+    }
+}
+
+CuSuite* meltingTestSuite(void) {
+    CuSuite* suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, testMeltRounds);
+    SUITE_ADD_TEST(suite, testGetChainLengths);
+    return suite;
+}
@@ -113,8 +113,73 @@ static void testPinchIteratorFromFile(CuTest *testCase) {
     }
 }
 
+static void testPinchIteratorFromBinaryFile(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        stList *pairwiseAlignments = getRandomPairwiseAlignments();
+        st_logInfo("Doing a random pinch iterator from binary file test %" PRIi64 " with %" PRIi64 " alignments\n", test, stList_length(pairwiseAlignments));
+        //Put alignments in a binary pinch file
+        char *tempFile = "tempFileForPinchIteratorTest.bin";
+        FILE *fileHandle = fopen(tempFile, "wb");
+        assert(fileHandle != NULL);
+        stPinchIterator_writeBinaryHeader(fileHandle);
+        for (int64_t i = 0; i < stList_length(pairwiseAlignments); i++) {
+            stPinchIterator_writeBinaryPinches(fileHandle, stList_get(pairwiseAlignments, i));
+        }
+        fclose(fileHandle);
+        //Get an iterator
+        stPinchIterator *pinchIterator = stPinchIterator_constructFromBinaryFile(tempFile);
+        //Now test it
+        testIterator(testCase, pinchIterator, pairwiseAlignments);
+        //Cleanup
+        stPinchIterator_destruct(pinchIterator);
+        stFile_rmtree(tempFile);
+        stList_destruct(pairwiseAlignments);
+    }
+}
+
+static void testSortBinaryFileByScore(CuTest *testCase) {
+    for (int64_t test = 0; test < 100; test++) {
+        stList *pairwiseAlignments = getRandomPairwiseAlignments();
+        for (int64_t i = 0; i < stList_length(pairwiseAlignments); i++) {
+            ((Paf *)stList_get(pairwiseAlignments, i))->score = st_randomInt(0, 5);
+        }
+        //Put alignments in a binary pinch file
+        char *tempFile = "tempFileForPinchIteratorTest.bin";
+        char *sortedFile = "tempFileForPinchIteratorTest.sorted.bin";
+        FILE *fileHandle = fopen(tempFile, "wb");
+        assert(fileHandle != NULL);
+        stPinchIterator_writeBinaryHeader(fileHandle);
+        for (int64_t i = 0; i < stList_length(pairwiseAlignments); i++) {
+            stPinchIterator_writeBinaryPinches(fileHandle, stList_get(pairwiseAlignments, i));
+        }
+        fclose(fileHandle);
+        //Sort it, with a memory budget that forces a merge of many runs half the time
+        stPinchIterator_sortBinaryFileByScore(tempFile, sortedFile, test % 2 == 0 ? 1000000 : 32 * st_randomInt(1, 5));
+        //The alignments in the order the pinches should come out: descending by score, else in input order
+        stList *sortedAlignments = stList_construct();
+        for (int64_t score = 4; score >= 0; score--) {
+            for (int64_t i = 0; i < stList_length(pairwiseAlignments); i++) {
+                if (((Paf *)stList_get(pairwiseAlignments, i))->score == score) {
+                    stList_append(sortedAlignments, stList_get(pairwiseAlignments, i));
+                }
+            }
+        }
+        //Now test it
+        stPinchIterator *pinchIterator = stPinchIterator_constructFromBinaryFile(sortedFile);
+        testIterator(testCase, pinchIterator, sortedAlignments);
+        //Cleanup
+        stPinchIterator_destruct(pinchIterator);
+        stFile_rmtree(tempFile);
+        stFile_rmtree(sortedFile);
+        stList_destruct(sortedAlignments);
+        stList_destruct(pairwiseAlignments);
+    }
+}
+
 CuSuite* pinchIteratorTestSuite(void) {
     CuSuite* suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, testPinchIteratorFromFile);
+    SUITE_ADD_TEST(suite, testPinchIteratorFromBinaryFile);
+    SUITE_ADD_TEST(suite, testSortBinaryFileByScore);
     return suite;
 }
@@ -45,26 +45,44 @@ void usage() {
     fprintf(stderr, "-r --referenceEvent : [Required] The name of the reference event\n");
     fprintf(stderr, "-t --runChecks : Run cactus checks after each stage, used for debugging\n");
     fprintf(stderr, "-T --threads : (int > 0) Use up to this many threads [default: all available]\n");
+    fprintf(stderr, "-P --profile : Write the wall time, cpu time and peak memory of each stage to this file as JSON\n");
+    fprintf(stderr, "-J --cafTelemetry : Write statistics of the pinch graph after each annealing and melting round to this file as JSON lines\n");
+    fprintf(stderr, "-C --checkpointDir : Write a snapshot of the cactus disk to this directory after the caf, bar and reference stages\n");
+    fprintf(stderr, "-R --resumeFrom : [caf|bar|reference] Load the snapshot written after this stage from --checkpointDir and continue from there\n");
     fprintf(stderr, "-h --help : Print this help message\n");
 }
 
-static char *convertAlignments(char *alignmentsFile, Flower *flower) {
+static char *convertAlignments(char *alignmentsFile, Flower *flower, int64_t *bytesConverted) {
     char *tempFile = getTempFile();
-    convertAlignmentCoordinates(alignmentsFile, tempFile, flower);
+    *bytesConverted += convertAlignmentCoordinates(alignmentsFile, tempFile, flower);
     return tempFile;
 }
 
-static RecordHolder *getMergedRecordHolders(stHash *recordHolders, Flower *flower) {
-    stList *children = stList_construct();
-    getChildFlowers(flower, children);
-    RecordHolder *rh = recordHolder_construct();
-    for(int64_t i=0; i<stList_length(children); i++) {
-        RecordHolder *rh2 = stHash_search(recordHolders, stList_get(children, i));
-        assert(rh2 != NULL);
-        recordHolder_transferAll(rh, rh2);
+/*
+ * The stages after which a snapshot of the cactus disk is written, in the order they are run.
+ */
+#define CHECKPOINT_NONE 0
+#define CHECKPOINT_CAF 1
+#define CHECKPOINT_BAR 2
+#define CHECKPOINT_REFERENCE 3
+
+static const char *checkpointNames[] = { "none", "caf", "bar", "reference" };
+
+static char *getSnapshotFile(char *checkpointDir, int64_t checkpoint) {
+    return stString_print("%s/%s.snapshot", checkpointDir, checkpointNames[checkpoint]);
+}
+
+static void writeCheckpoint(CactusDisk *cactusDisk, char *checkpointDir, int64_t checkpoint, time_t startTime) {
+    if (checkpointDir == NULL) {
+        return;
     }
-    stList_destruct(children);
-    return rh;
+    cactusProfiler_startStage("checkpoint %s", checkpointNames[checkpoint]);
+    char *snapshotFile = getSnapshotFile(checkpointDir, checkpoint);
+    cactusDisk_writeSnapshot(cactusDisk, snapshotFile);
+    cactusProfiler_endStage();
+    st_logInfo("Wrote the %s checkpoint to %s, %" PRIi64 " seconds have elapsed\n", checkpointNames[checkpoint],
+               snapshotFile, time(NULL) - startTime);
+    free(snapshotFile);
 }
 
 static void callBottomUp(Flower *flower, RecordHolder *rh, void *extraArg) {
@@ -75,35 +93,46 @@ static void callHalFn(Flower *flower, RecordHolder *rh, void *extraArg) {
     makeHalFormatNoDb(flower, rh, (Name)extraArg, NULL);
 }
 
-static RecordHolder *doBottomUpTraversal(stList *flowerLayers,
+typedef struct _bottomUpTraversal {
+    void (*bottomUpFn)(Flower *, RecordHolder *, void *);
+    void *extraArgs;
+    Flower *rootFlower;
+} BottomUpTraversal;
+
+static void *mergeRecordHoldersAndCallBottomUp(Flower *flower, void **childResults, int64_t childNumber, void *extraArg) {
+    BottomUpTraversal *traversal = extraArg;
+    RecordHolder *rh = recordHolder_construct();
+    for(int64_t i=0; i<childNumber; i++) {
+        recordHolder_transferAll(rh, childResults[i]);
+        recordHolder_destruct(childResults[i]);
+    }
+    if(flower != traversal->rootFlower) { // The caller finishes the root flower
+        traversal->bottomUpFn(flower, rh, traversal->extraArgs);
+    }
+    return rh;
+}
+
+/*
+ * Calls bottomUpFn on each flower below the root flower, as soon as it has been called on all of the flower's
+ * children, with the records produced by the children. Returns the records produced by the children of the root.
+ */
+static RecordHolder *doBottomUpTraversal(Flower *rootFlower,
                                          void (*bottomUpFn)(Flower *, RecordHolder *, void *), void *extraArgs) {
-    // Bottom-up reference coordinates phase
-    stHash *recordHolders = stHash_construct();
-    for(int64_t i=stList_length(flowerLayers)-1; i>0 ; i--) {
-        stList *flowers = stList_get(flowerLayers, i);
+    BottomUpTraversal traversal = { bottomUpFn, extraArgs, rootFlower };
+    return traverseFlowersBottomUp(rootFlower, mergeRecordHoldersAndCallBottomUp, &traversal);
+}
 
-        // List to keep the RecordHolder for each flower
-        stList *recordHoldersForFlowers = stList_construct3(stList_length(flowers), NULL);
+static void callMakeReference(Flower *flower, void *extraArg) {
+    void **args = extraArg;
+    cactus_make_reference_for_flower(flower, args[0], args[1]);
+}
 
-#if defined(_OPENMP)
-#pragma omp parallel for schedule(dynamic)
-#endif
-        for (int64_t j = 0; j < stList_length(flowers); j++) {
-            stList_set(recordHoldersForFlowers, j, getMergedRecordHolders(recordHolders, stList_get(flowers, j)));
-            bottomUpFn(stList_get(flowers, j), stList_get(recordHoldersForFlowers, j), extraArgs);
-        }
+static void callTopDown(Flower *flower, void *extraArg) {
+    topDown(flower, (Name)extraArg);
+}
 
-        // Make new map of flowers in the layer to RecordHolders
-        stHash_destruct(recordHolders);
-        recordHolders = stHash_construct();
-        for (int64_t j = 0; j < stList_length(flowers); j++) {
-            stHash_insert(recordHolders, stList_get(flowers, j), stList_get(recordHoldersForFlowers, j));
-        }
-        stList_destruct(recordHoldersForFlowers);
-    }
-    RecordHolder *rh = getMergedRecordHolders(recordHolders, stList_get(stList_get(flowerLayers, 0), 0));
-    stHash_destruct(recordHolders);
-    return rh;
+static void callBar(Flower *flower, void *extraArg) {
+    bar_alignFlower(flower, extraArg);
 }
 
 // check if a reference fasta was provided with the --sequences option
@@ -122,12 +151,6 @@ static bool refSequenceProvided(char *sequenceFilesAndEvents, char *referenceEve
     return found_ref;
 }
 
-int flower_sizeCmpFn(const void *a, const void *b) {
-    // Sort by number of caps the flowers contains
-    int64_t i = flower_getCapNumber((Flower *)a), j = flower_getCapNumber((Flower *)b);
-    return i < j ? 1 : (i > j ? -1 : 0); // Sort in descending order
-}
-
 int main(int argc, char *argv[]) {
     time_t startTime = time(NULL);
 
@@ -146,6 +169,10 @@ int main(int argc, char *argv[]) {
     char *speciesTree = NULL;
     char *outgroupEvents = NULL;
     char *referenceEventString = NULL;
+    char *profileFile = NULL;
+    char *cafTelemetryFile = NULL;
+    char *checkpointDir = NULL;
+    int64_t resumeFrom = CHECKPOINT_NONE;
     bool runChecks = 0;
 
     ///////////////////////////////////////////////////////////////////////////
@@ -176,11 +203,15 @@ int main(int argc, char *argv[]) {
                 { "referenceEvent", required_argument, 0, 'r' },
                 { "runChecks", no_argument, 0, 't' },
                 { "threads", required_argument, 0, 'T' }, 
+                { "profile", required_argument, 0, 'P' },
+                { "cafTelemetry", required_argument, 0, 'J' },
+                { "checkpointDir", required_argument, 0, 'C' },
+                { "resumeFrom", required_argument, 0, 'R' },
                 { 0, 0, 0, 0 } };
 
         int option_index = 0;
 
-        int64_t key = getopt_long(argc, argv, "l:p:s:a:S:c:g:o:hr:F:G:tT:", long_options, &option_index);
+        int64_t key = getopt_long(argc, argv, "l:p:s:a:S:c:g:o:hr:F:G:tT:P:J:C:R:", long_options, &option_index);
 
         if (key == -1) {
             break;
@@ -234,6 +265,25 @@ int main(int argc, char *argv[]) {
                 omp_set_num_threads(num_threads);
                 break;
             }
+            case 'P':
+                profileFile = optarg;
+                break;
+            case 'J':
+                cafTelemetryFile = optarg;
+                break;
+            case 'C':
+                checkpointDir = optarg;
+                break;
+            case 'R':
+                for (resumeFrom = CHECKPOINT_CAF; resumeFrom <= CHECKPOINT_REFERENCE; resumeFrom++) {
+                    if (strcmp(optarg, checkpointNames[resumeFrom]) == 0) {
+                        break;
+                    }
+                }
+                if (resumeFrom > CHECKPOINT_REFERENCE) {
+                    st_errAbort("--resumeFrom (-R) must be one of caf, bar or reference, not %s", optarg);
+                }
+                break;
             case 'h':
                 usage();
                 return 0;
@@ -265,6 +315,9 @@ int main(int argc, char *argv[]) {
     if (referenceEventString == NULL) {
         st_errAbort("must supply --referenceEvent (-r)");
     }
+    if (resumeFrom != CHECKPOINT_NONE && checkpointDir == NULL) {
+        st_errAbort("must supply --checkpointDir (-C) to use --resumeFrom (-R)");
+    }
 
     //////////////////////////////////////////////
     //Set up logging
@@ -287,26 +340,51 @@ int main(int argc, char *argv[]) {
     st_logInfo("Species tree: %s\n", speciesTree);
     st_logInfo("Outgroup events: %s\n", outgroupEvents);
     st_logInfo("Reference event: %s\n", referenceEventString);
+    st_logInfo("Profile file: %s\n", profileFile);
+    st_logInfo("Caf telemetry file: %s\n", cafTelemetryFile);
+    st_logInfo("Checkpoint directory: %s\n", checkpointDir);
+    st_logInfo("Resume from: %s\n", checkpointNames[resumeFrom]);
+
+    if (profileFile != NULL) {
+        cactusProfiler_enable();
+    }
+    if (cafTelemetryFile != NULL) {
+        stCaf_enableTelemetry(cafTelemetryFile);
+    }
 
     //////////////////////////////////////////////
     //Parse stuff
     //////////////////////////////////////////////
 
     // Load the params file
+    cactusProfiler_startStage("setup");
     CactusParams *params = cactusParams_load(paramsFile);
     st_logInfo("Loaded the parameters files, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
 
-    // Load the cactus disk
-    CactusDisk *cactusDisk = cactusDisk_construct();
+    CactusDisk *cactusDisk;
+    Flower *flower;
+    if (resumeFrom != CHECKPOINT_NONE) {
+        // Load the cactus disk from the checkpoint, skipping the stages that precede it
+        char *snapshotFile = getSnapshotFile(checkpointDir, resumeFrom);
+        cactusDisk = cactusDisk_loadSnapshot(snapshotFile, &flower);
+        cactusProfiler_endStage();
+        st_logInfo("Loaded the %s checkpoint from %s, %" PRIi64 " seconds have elapsed\n", checkpointNames[resumeFrom],
+                   snapshotFile, time(NULL) - startTime);
+        free(snapshotFile);
+    } else {
+        // Load the cactus disk
+        cactusDisk = cactusDisk_construct();
 
-    st_logInfo("Set up the cactus disk, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
+        st_logInfo("Set up the cactus disk, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
 
-    //////////////////////////////////////////////
-    //Call cactus setup
-    //////////////////////////////////////////////
+        //////////////////////////////////////////////
+        //Call cactus setup
+        //////////////////////////////////////////////
 
-    Flower *flower = cactus_setup_first_flower(cactusDisk, params, speciesTree, outgroupEvents, sequenceFilesAndEvents);
-    st_logInfo("Established the first Flower in the hierarchy, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
+        flower = cactus_setup_first_flower(cactusDisk, params, speciesTree, outgroupEvents, sequenceFilesAndEvents);
+        cactusProfiler_endStage();
+        st_logInfo("Established the first Flower in the hierarchy, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
+    }
 
     if(runChecks) {
         flower_checkRecursive(flower);
@@ -324,57 +402,73 @@ int main(int argc, char *argv[]) {
     // Check if we got the reference sequence as input
     bool skipReferencePhase = refSequenceProvided(sequenceFilesAndEvents, referenceEventString);
 
-    //////////////////////////////////////////////
-    //Convert alignment coordinates
-    //////////////////////////////////////////////
+    bool convertedAlignments = resumeFrom == CHECKPOINT_NONE;
+    if (convertedAlignments) {
+        //////////////////////////////////////////////
+        //Convert alignment coordinates
+        //////////////////////////////////////////////
+
+        cactusProfiler_startStage("convert");
+        struct timespec convertStart, convertEnd;
+        clock_gettime(CLOCK_MONOTONIC, &convertStart);
+        int64_t bytesConverted = 0;
+        alignmentsFile = convertAlignments(alignmentsFile, flower, &bytesConverted);
+        if(secondaryAlignmentsFile != NULL) {
+            secondaryAlignmentsFile = convertAlignments(secondaryAlignmentsFile, flower, &bytesConverted);
+        }
+        if(constraintAlignmentsFile != NULL) {
+            constraintAlignmentsFile = convertAlignments(constraintAlignmentsFile, flower, &bytesConverted);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &convertEnd);
+        cactusProfiler_endStage();
+        double convertSeconds = (convertEnd.tv_sec - convertStart.tv_sec) + (convertEnd.tv_nsec - convertStart.tv_nsec) / 1.0e9;
+        st_logInfo("Converted alignment coordinates (%" PRIi64 " bytes at %.1f MB/s), %" PRIi64 " seconds have elapsed\n",
+                   bytesConverted, convertSeconds > 0 ? bytesConverted / (1.0e6 * convertSeconds) : 0.0, time(NULL) - startTime);
 
-    alignmentsFile = convertAlignments(alignmentsFile, flower);
-    if(secondaryAlignmentsFile != NULL) {
-        secondaryAlignmentsFile = convertAlignments(secondaryAlignmentsFile, flower);
-    }
-    if(constraintAlignmentsFile != NULL) {
-        constraintAlignmentsFile = convertAlignments(constraintAlignmentsFile, flower);
-    }
-    st_logInfo("Converted alignment coordinates, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
+        //////////////////////////////////////////////
+        //Strip the unique IDs
+        //////////////////////////////////////////////
 
-    //////////////////////////////////////////////
-    //Strip the unique IDs
-    //////////////////////////////////////////////
+        stripUniqueIdsFromLeafSequences(flower);
+        st_logInfo("Stripped any unique IDs, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
 
-    stripUniqueIdsFromLeafSequences(flower);
-    st_logInfo("Stripped any unique IDs, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
+        //////////////////////////////////////////////
+        //Call cactus caf
+        //////////////////////////////////////////////
 
-    //////////////////////////////////////////////
-    //Call cactus caf
-    //////////////////////////////////////////////
+        assert(!flower_builtBlocks(flower));
+        cactusProfiler_startStage("caf");
+        caf(flower, params, alignmentsFile, secondaryAlignmentsFile, constraintAlignmentsFile, referenceEvent);
+        cactusProfiler_endStage();
+        assert(flower_builtBlocks(flower));
+        st_logInfo("Ran cactus caf, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
 
-    assert(!flower_builtBlocks(flower));
-    caf(flower, params, alignmentsFile, secondaryAlignmentsFile, constraintAlignmentsFile, referenceEvent);
-    assert(flower_builtBlocks(flower));
-    st_logInfo("Ran cactus caf, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
+        writeCheckpoint(cactusDisk, checkpointDir, CHECKPOINT_CAF, startTime);
+
+        if(runChecks) {
+            flower_checkRecursive(flower);
+            st_logInfo("Checked the flowers in the hierarchy created by CAF, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
+        }
 
-    if(runChecks) {
-        flower_checkRecursive(flower);
-        st_logInfo("Checked the flowers in the hierarchy created by CAF, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
     }
 
     //////////////////////////////////////////////
     //Call cactus bar
     //////////////////////////////////////////////
 
-    if (cactusParams_get_int(params, 2, "bar", "runBar")) {
-        stList *leafFlowers = stList_construct();
-        extendFlowers(flower, leafFlowers, 1); // Get nested flowers to complete
-        stList_sort(leafFlowers, flower_sizeCmpFn); // Sort by descending order of size, so that we start processing the
-// largest flower as quickly as possible
-        st_logInfo("Ran extended flowers ready for bar, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
-
-
-        bar(leafFlowers, params, cactusDisk, NULL);
+    if (resumeFrom < CHECKPOINT_BAR && cactusParams_get_int(params, 2, "bar", "runBar")) {
+        cactusProfiler_startStage("bar");
+        // Run bar on each nested flower as soon as it is made, while the rest of the hierarchy is still being searched
+        BarParameters *barParameters = barParameters_construct(params, NULL);
+        extendFlowersAndProcess(flower, 1, callBar, barParameters);
+        msa_release_poa_contexts(); // So the memory of the abpoa alignments is not held for the rest of the run
+        barParameters_destruct(barParameters);
         int64_t usePoa = cactusParams_get_int(params, 2, "bar", "partialOrderAlignment");
-        st_logInfo("Ran cactus bar (use poa:%i), %" PRIi64 " seconds have elapsed\n", (int)usePoa, time(NULL) - startTime);
+        st_logInfo("Extended flowers and ran cactus bar (use poa:%i), %" PRIi64 " seconds have elapsed\n", (int)usePoa, time(NULL) - startTime);
+
+        cactusProfiler_endStage();
 
-        stList_destruct(leafFlowers);
+        writeCheckpoint(cactusDisk, checkpointDir, CHECKPOINT_BAR, startTime);
 
         if(runChecks) {
             flower_checkRecursive(flower);
@@ -386,44 +480,38 @@ int main(int argc, char *argv[]) {
     //Call cactus reference
     //////////////////////////////////////////////
 
-    // Get the flowers in the tree so that level 0 contains just the root flower,
-    // level 1 contains the flowers that are children of the root flower, etc.
-    stList *flowerLayers = getFlowerHierarchyInLayers(flower);
-    for(int64_t i=0; i<stList_length(flowerLayers); i++) {
-        stList_sort(stList_get(flowerLayers, i), flower_sizeCmpFn); // Sort by descending order of size, so that we start processing the
-// largest flower as quickly as possible
-    }
-    st_logInfo("There are %" PRIi64 " layers in the flowers hierarchy\n", stList_length(flowerLayers));
+    // The traversals of the flower hierarchy below process each flower as soon as its parent (top-down) or
+    // its children (bottom-up) are done, rather than a layer of the hierarchy at a time
 
     RecordHolder *rh = NULL;
-    if (!skipReferencePhase) {
+    if (resumeFrom == CHECKPOINT_REFERENCE) {
+        st_logInfo("Skipped reference phase because it was completed before the %s checkpoint\n", checkpointNames[resumeFrom]);
+    } else if (!skipReferencePhase) {
         // Top-down this constructs the reference sequence
-        for(int64_t i=0; i<stList_length(flowerLayers); i++) {
-            stList *flowerLayer = stList_get(flowerLayers, i);
-            st_logInfo("In the %" PRIi64 " layer there are %" PRIi64 " flowers in the flowers hierarchy\n", i,
-                       stList_length(flowerLayer));
-            cactus_make_reference(flowerLayer, referenceEventString, cactusDisk, params);
-        }
+        cactusProfiler_startStage("reference");
+        ReferenceParameters *referenceParameters = referenceParameters_construct(params);
+        void *makeReferenceArgs[2] = { referenceEventString, referenceParameters };
+        traverseFlowersTopDown(flower, callMakeReference, makeReferenceArgs);
+        referenceParameters_destruct(referenceParameters);
+        cactusProfiler_endStage();
         st_logInfo("Ran cactus make reference, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
 
         // Bottom-up reference coordinates phase
-        RecordHolder *rh = doBottomUpTraversal(flowerLayers, callBottomUp, (void *)referenceEventName);
+        cactusProfiler_startStage("bottomUp");
+        RecordHolder *rh = doBottomUpTraversal(flower, callBottomUp, (void *)referenceEventName);
         bottomUpNoDb(flower, rh, referenceEventName, 1, generateJukesCantorMatrix);
         assert(recordHolder_size(rh) == 0);
         recordHolder_destruct(rh);
+        cactusProfiler_endStage();
         st_logInfo("Ran cactus make reference bottom up coordinates, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
 
         // Top-down reference coordinates phase
-        for(int64_t i=0; i<stList_length(flowerLayers); i++) {
-            stList *flowers = stList_get(flowerLayers, i);
-#if defined(_OPENMP)
-#pragma omp parallel for schedule(dynamic)
-#endif
-            for(int64_t j=0; j<stList_length(flowers); j++) {
-                topDown(stList_get(flowers, j), referenceEventName);
-            }
-        }
+        cactusProfiler_startStage("topDown");
+        traverseFlowersTopDown(flower, callTopDown, (void *)referenceEventName);
+        cactusProfiler_endStage();
         st_logInfo("Ran cactus make reference top down coordinates, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
+
+        writeCheckpoint(cactusDisk, checkpointDir, CHECKPOINT_REFERENCE, startTime);
     } else {
         st_logInfo("Skipped reference phase because input sequence was provided for %s\n", referenceEventString);
     }
@@ -437,18 +525,21 @@ int main(int argc, char *argv[]) {
     //Make c2h files, then build hal
     //////////////////////////////////////////////
 
-    rh = doBottomUpTraversal(flowerLayers, callHalFn, (void *)referenceEventName);
+    cactusProfiler_startStage("hal");
+    rh = doBottomUpTraversal(flower, callHalFn, (void *)referenceEventName);
     FILE *fileHandle = fopen(outputFile, "w");
     makeHalFormatNoDb(flower, rh, referenceEventName, fileHandle);
     fclose(fileHandle);
     assert(recordHolder_size(rh) == 0);
     recordHolder_destruct(rh);
+    cactusProfiler_endStage();
     st_logInfo("Ran cactus to hal stage, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
 
     //////////////////////////////////////////////
     //Get reference sequences
     //////////////////////////////////////////////
 
+    cactusProfiler_startStage("fasta");
     if(outputHalFastaFile != NULL) {
         fileHandle = fopen(outputHalFastaFile, "w");
         printFastaSequences(flower, fileHandle, referenceEventName);
@@ -462,24 +553,35 @@ int main(int argc, char *argv[]) {
         fclose(fileHandle);
         st_logInfo("Dumped reference sequences, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
     }
+    cactusProfiler_endStage();
 
     //////////////////////////////////////////////
     //Cleanup
     //////////////////////////////////////////////
 
-    st_system("rm %s", alignmentsFile);
-    if(secondaryAlignmentsFile != NULL) {
-        st_system("rm %s", secondaryAlignmentsFile);
-    }
-    if(constraintAlignmentsFile != NULL) {
-        st_system("rm %s", constraintAlignmentsFile);
+    if(convertedAlignments) {
+        st_system("rm %s", alignmentsFile);
+        if(secondaryAlignmentsFile != NULL) {
+            st_system("rm %s", secondaryAlignmentsFile);
+        }
+        if(constraintAlignmentsFile != NULL) {
+            st_system("rm %s", constraintAlignmentsFile);
+        }
     }
     st_logInfo("Cactus consolidated is done!, %" PRIi64 " seconds have elapsed\n", time(NULL) - startTime);
 
+    if (profileFile != NULL) {
+        cactusProfiler_writeJson(profileFile);
+        st_logInfo("Wrote the profile to %s\n", profileFile);
+    }
+    if (cafTelemetryFile != NULL) {
+        stCaf_disableTelemetry();
+        st_logInfo("Wrote the caf telemetry to %s\n", cafTelemetryFile);
+    }
+
     return 0; // Exit without cleaning
 
     // Cleanup the memory
-    stList_destruct(flowerLayers);
     cactusParams_destruct(params);
     cactusDisk_destruct(cactusDisk);
 
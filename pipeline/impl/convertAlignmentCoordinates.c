@@ -8,6 +8,12 @@
 #include "sonLib.h"
 #include "paf.h"
 #include "bioioC.h"
+#include "stPinchIterator.h"
+
+// OpenMP
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
 
 void stripUniqueIdsFromLeafSequences(Flower *flower) {
     Flower_SequenceIterator *flowerIt = flower_getSequenceIterator(flower);
@@ -31,7 +37,8 @@ void stripUniqueIdsFromLeafSequences(Flower *flower) {
 }
 
 /*
- * Iterates through a cigar file and converts the coordinates into cactus okay coordinates.
+ * Iterates through a paf file and converts the coordinates into cactus okay coordinates, writing the
+ * resulting pinches to a binary pinch file.
  */
 
 static stHash *makeSequenceHeaderToCapHash(Flower *flower) {
@@ -60,8 +67,7 @@ static stHash *makeSequenceHeaderToCapHash(Flower *flower) {
     return sequenceHeaderToCapsHash;
 }
 
-static void convertCoordinates(Paf *paf, FILE *outputCigarFileHandle,
-                               stHash *sequenceHeaderToCapHash) {
+static void convertCoordinates(Paf *paf, stHash *sequenceHeaderToCapHash) {
     Cap *cap1 = stHash_search(sequenceHeaderToCapHash, paf->query_name);
     Cap *cap2 = stHash_search(sequenceHeaderToCapHash, paf->target_name);
     if (cap1 == NULL) {
@@ -95,25 +101,145 @@ static void convertCoordinates(Paf *paf, FILE *outputCigarFileHandle,
     }
 }
 
-void convertAlignmentCoordinates(char *inputAlignmentFile, char *outputAlignmentFile, Flower *flower) {
+/*
+ * The input is read in chunks of this many bytes, each of which is cut at its last line boundary
+ * and converted in parallel.
+ */
+#define CONVERSION_CHUNK_SIZE (64 * 1024 * 1024)
+
+/*
+ * Number of slices each chunk is divided into per thread, so that threads finishing early can pick up more work.
+ */
+#define CONVERSION_SLICES_PER_THREAD 4
+
+/*
+ * Converts the lines in lines[lineStart, lineEnd) writing the pinches to a buffer, returned in *buffer.
+ */
+static size_t convertSlice(char **lines, int64_t lineStart, int64_t lineEnd, stHash *sequenceHeaderToCapHash,
+                           char **buffer, int64_t *pinchNumber) {
+    size_t bufferLength;
+    FILE *bufferHandle = open_memstream(buffer, &bufferLength);
+    if (bufferHandle == NULL) {
+        st_errAbort("Could not open a memory stream to convert alignments");
+    }
+    for (int64_t i = lineStart; i < lineEnd; i++) {
+        Paf *paf = paf_parse(lines[i], 1);
+        convertCoordinates(paf, sequenceHeaderToCapHash);
+        paf_check(paf);
+        *pinchNumber += stPinchIterator_writeBinaryPinches(bufferHandle, paf);
+        paf_destruct(paf);
+    }
+    fclose(bufferHandle);
+    return bufferLength;
+}
+
+/*
+ * Converts the complete lines in chunk[0, chunkLength), writing them in order to the output.
+ */
+static void convertChunk(char *chunk, int64_t chunkLength, FILE *outputAlignmentFileHandle,
+                         stHash *sequenceHeaderToCapHash, int64_t *pafNumber, int64_t *pinchNumber) {
+    // Split the chunk into lines, ignoring empty lines
+    stList *lineList = stList_construct();
+    char *line = chunk;
+    for (int64_t i = 0; i < chunkLength; i++) {
+        if (chunk[i] == '\n') {
+            chunk[i] = '\0';
+            if (line[0] != '\0') {
+                stList_append(lineList, line);
+            }
+            line = chunk + i + 1;
+        }
+    }
+    char **lines = (char **) stList_getBackingArray(lineList);
+    int64_t lineNumber = stList_length(lineList);
+    *pafNumber += lineNumber;
+
+    // Convert the slices in parallel
+    int64_t threadNumber = 1;
+#if defined(_OPENMP)
+    threadNumber = omp_get_max_threads();
+#endif
+    int64_t sliceNumber = threadNumber * CONVERSION_SLICES_PER_THREAD;
+    char **buffers = st_calloc(sliceNumber, sizeof(char *));
+    size_t *bufferLengths = st_calloc(sliceNumber, sizeof(size_t));
+    int64_t *pinchNumbers = st_calloc(sliceNumber, sizeof(int64_t));
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int64_t j = 0; j < sliceNumber; j++) {
+        bufferLengths[j] = convertSlice(lines, (lineNumber * j) / sliceNumber, (lineNumber * (j + 1)) / sliceNumber,
+                                        sequenceHeaderToCapHash, &buffers[j], &pinchNumbers[j]);
+    }
+
+    // Write out the slices in order
+    for (int64_t j = 0; j < sliceNumber; j++) {
+        if (bufferLengths[j] > 0 && fwrite(buffers[j], 1, bufferLengths[j], outputAlignmentFileHandle) != bufferLengths[j]) {
+            st_errAbort("Failed to write converted alignments");
+        }
+        *pinchNumber += pinchNumbers[j];
+        free(buffers[j]);
+    }
+    free(buffers);
+    free(bufferLengths);
+    free(pinchNumbers);
+    stList_destruct(lineList);
+}
+
+int64_t convertAlignmentCoordinates(char *inputAlignmentFile, char *outputAlignmentFile, Flower *flower) {
     stHash *sequenceHeaderToCapHash = makeSequenceHeaderToCapHash(flower);
     st_logDebug("Set up the flower disk and built hash\n");
 
     FILE *inputAlignmentFileHandle = fopen(inputAlignmentFile, "r");
+    if (inputAlignmentFileHandle == NULL) {
+        st_errAbort("Could not open alignments file: %s", inputAlignmentFile);
+    }
     FILE *outputAlignmentFileHandle = fopen(outputAlignmentFile, "w");
+    if (outputAlignmentFileHandle == NULL) {
+        st_errAbort("Could not open converted alignments file for writing: %s", outputAlignmentFile);
+    }
     st_logDebug("Opened files for writing\n");
 
-    Paf *paf;
-    while ((paf = paf_read(inputAlignmentFileHandle, 0)) != NULL) {
-        convertCoordinates(paf, outputAlignmentFileHandle, sequenceHeaderToCapHash);
-        paf_check(paf);
-        paf_write(paf, outputAlignmentFileHandle);
-        paf_destruct(paf);
+    stPinchIterator_writeBinaryHeader(outputAlignmentFileHandle);
+    int64_t pafNumber = 0, pinchNumber = 0, bytesRead = 0;
+    int64_t bufferSize = CONVERSION_CHUNK_SIZE, bufferLength = 0;
+    char *buffer = st_malloc(bufferSize + 1);
+    while (1) {
+        if (bufferLength == bufferSize) { // A single line is longer than the buffer, so grow it
+            bufferSize *= 2;
+            buffer = st_realloc(buffer, bufferSize + 1);
+        }
+        size_t i = fread(buffer + bufferLength, 1, bufferSize - bufferLength, inputAlignmentFileHandle);
+        if (ferror(inputAlignmentFileHandle)) {
+            st_errAbort("Error reading alignments file: %s", inputAlignmentFile);
+        }
+        bytesRead += i;
+        bufferLength += i;
+        bool endOfFile = i == 0;
+        if (endOfFile && bufferLength > 0 && buffer[bufferLength - 1] != '\n') {
+            buffer[bufferLength++] = '\n'; // Terminate the last line, for which the buffer has one spare byte
+        }
+        // Find the end of the last complete line in the buffer
+        int64_t chunkLength = bufferLength;
+        while (chunkLength > 0 && buffer[chunkLength - 1] != '\n') {
+            chunkLength--;
+        }
+        if (chunkLength == 0) {
+            if (endOfFile) {
+                break;
+            }
+            continue;
+        }
+        convertChunk(buffer, chunkLength, outputAlignmentFileHandle, sequenceHeaderToCapHash, &pafNumber, &pinchNumber);
+        // Move the incomplete final line to the start of the buffer
+        memmove(buffer, buffer + chunkLength, bufferLength - chunkLength);
+        bufferLength -= chunkLength;
     }
-    st_logDebug("Finished converting alignments\n");
+    st_logDebug("Finished converting %" PRIi64 " alignments into %" PRIi64 " pinches\n", pafNumber, pinchNumber);
 
     //Cleanup
+    free(buffer);
     fclose(inputAlignmentFileHandle);
     fclose(outputAlignmentFileHandle);
     stHash_destruct(sequenceHeaderToCapHash);
+    return bytesRead;
 }
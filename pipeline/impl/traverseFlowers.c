@@ -1,26 +1,133 @@
 #include "traverseFlowers.h"
 
-void extendFlowers(Flower *flower, stList *extendedFlowers, int64_t minFlowerSize) {
-    Flower_GroupIterator *groupIterator = flower_getGroupIterator(flower);
-    Group *group;
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+/*
+ * The names used by group_makeNestedFlower: the nested flower takes the group's name and the ends keep theirs, leaving
+ * the nested group and the chain it may start.
+ */
+#define NESTED_FLOWER_NAME_NUMBER 2
+
+/*
+ * The leaf groups of one flower to be made into nested flowers, and the interval of names reserved for them.
+ */
+typedef struct _leafGroupBatch {
+    stList *leafGroups;
+    int64_t firstName;
+    int64_t nameNumber;
+    stList *nestedFlowers;
+} LeafGroupBatch;
+
+static void leafGroupBatch_destruct(LeafGroupBatch *batch) {
+    stList_destruct(batch->leafGroups);
+    if (batch->nestedFlowers != NULL) {
+        stList_destruct(batch->nestedFlowers);
+    }
+    free(batch);
+}
+
+/*
+ * Adds a batch to batches for each flower in the hierarchy below flower, including flower, that has leaf groups of at
+ * least minFlowerSize bases, in depth first order, reserving the names of each batch as it is added.
+ */
+static void getLeafGroupBatches(Flower *flower, int64_t minFlowerSize, stList *batches) {
     assert(flower_builtBlocks(
             flower)); //This recursion depends on the block structure having been properly defined for all nodes.
+    LeafGroupBatch *batch = st_calloc(1, sizeof(LeafGroupBatch));
+    batch->leafGroups = stList_construct();
+    stList_append(batches, batch);
+    Flower_GroupIterator *groupIterator = flower_getGroupIterator(flower);
+    Group *group;
     while ((group = flower_getNextGroup(groupIterator)) != NULL) {
         if (group_isLeaf(group)) { // Has no nested flower
             int64_t size = group_getTotalBaseLength(group);
             assert(size >= 0);
             if (size >= minFlowerSize) {
-                Flower *nestedFlower = group_makeNestedFlower(group);
-                stList_append(extendedFlowers, nestedFlower);
+                stList_append(batch->leafGroups, group);
             }
         }
-        else { // Recursively search for more nested flowers to exnted
+        else {
             Flower *nestedFlower = group_getNestedFlower(group);
             assert(nestedFlower != NULL);
-            extendFlowers(nestedFlower, extendedFlowers, minFlowerSize);
+            getLeafGroupBatches(nestedFlower, minFlowerSize, batches);
         }
     }
     flower_destructGroupIterator(groupIterator);
+    batch->nameNumber = NESTED_FLOWER_NAME_NUMBER * stList_length(batch->leafGroups);
+    batch->firstName = batch->nameNumber > 0 ? cactusDisk_getUniqueIDInterval(flower_getCactusDisk(flower), batch->nameNumber) : 0;
+}
+
+/*
+ * Makes the nested flowers of the batch's leaf groups, taking their names from the batch's reserved interval, so that
+ * they are the same whichever thread makes them. Each new nested flower is passed to fn, as a task, or, if fn is NULL,
+ * kept in the batch.
+ */
+static void extendLeafGroupBatch(LeafGroupBatch *batch, CactusDisk *cactusDisk, void (*fn)(Flower *, void *),
+                                 void *extraArg) {
+    batch->nestedFlowers = stList_construct();
+    cactusDisk_setUniqueIDInterval(cactusDisk, batch->firstName, batch->nameNumber);
+    for (int64_t i = 0; i < stList_length(batch->leafGroups); i++) {
+        stList_append(batch->nestedFlowers, group_makeNestedFlower(stList_get(batch->leafGroups, i)));
+    }
+    if (!cactusDisk_restoreUniqueIDInterval(cactusDisk, batch->firstName, batch->nameNumber)) {
+        st_errAbort("Ran out of the %" PRIi64 " names reserved for nested flowers", batch->nameNumber);
+    }
+
+    if (fn != NULL) {
+        stList_sort(batch->nestedFlowers, flower_sizeCmpFn); // Start the largest flowers first
+        for (int64_t i = 0; i < stList_length(batch->nestedFlowers); i++) {
+            Flower *nestedFlower = stList_get(batch->nestedFlowers, i);
+#if defined(_OPENMP)
+#pragma omp task firstprivate(nestedFlower)
+#endif
+            fn(nestedFlower, extraArg);
+        }
+    }
+}
+
+/*
+ * Searches the hierarchy for the leaf groups to extend, reserving the names of their nested flowers serially, in the
+ * order of the hierarchy, then makes the nested flowers of each flower's leaf groups as a task. Each new nested flower
+ * is either passed to fn, as a task, or, if fn is NULL, added to extendedFlowers.
+ */
+static void extendFlowersP(Flower *flower, int64_t minFlowerSize, stList *extendedFlowers,
+                           void (*fn)(Flower *, void *), void *extraArg) {
+    CactusDisk *cactusDisk = flower_getCactusDisk(flower);
+    stList *batches = stList_construct3(0, (void (*)(void *))leafGroupBatch_destruct);
+    getLeafGroupBatches(flower, minFlowerSize, batches);
+#if defined(_OPENMP)
+#pragma omp parallel
+#pragma omp single
+#endif
+    for (int64_t i = 0; i < stList_length(batches); i++) {
+        LeafGroupBatch *batch = stList_get(batches, i);
+        if (stList_length(batch->leafGroups) > 0) {
+#if defined(_OPENMP)
+#pragma omp task firstprivate(batch)
+#endif
+            extendLeafGroupBatch(batch, cactusDisk, fn, extraArg);
+        }
+    }
+    if (fn == NULL) {
+        for (int64_t i = 0; i < stList_length(batches); i++) {
+            LeafGroupBatch *batch = stList_get(batches, i);
+            if (batch->nestedFlowers != NULL) {
+                stList_appendAll(extendedFlowers, batch->nestedFlowers);
+            }
+        }
+    }
+    stList_destruct(batches);
+}
+
+void extendFlowers(Flower *flower, stList *extendedFlowers, int64_t minFlowerSize) {
+    extendFlowersP(flower, minFlowerSize, extendedFlowers, NULL, NULL);
+}
+
+void extendFlowersAndProcess(Flower *flower, int64_t minFlowerSize,
+                             void (*fn)(Flower *nestedFlower, void *extraArg), void *extraArg) {
+    extendFlowersP(flower, minFlowerSize, NULL, fn, extraArg);
 }
 
 /*
@@ -58,3 +165,136 @@ stList *getFlowerHierarchyInLayers(Flower *rootFlower) {
     stList_destruct(flowers);
     return flowerLayers;
 }
+
+int flower_sizeCmpFn(const void *a, const void *b) {
+    // Sort by number of caps the flowers contains
+    int64_t i = flower_getCapNumber((Flower *)a), j = flower_getCapNumber((Flower *)b);
+    return i < j ? 1 : (i > j ? -1 : 0); // Sort in descending order
+}
+
+/*
+ * The flower hierarchy flattened into an array in breadth first order, so that the children
+ * of each flower are contiguous.
+ */
+typedef struct _flowerTreeNode {
+    Flower *flower;
+    int64_t parent; // Index of the parent flower, or -1 for the root
+    int64_t firstChild; // Index of the first child flower
+    int64_t childNumber;
+    int64_t pendingChildren; // Children yet to be processed in a bottom up traversal
+} FlowerTreeNode;
+
+typedef struct _flowerTree {
+    FlowerTreeNode *nodes;
+    int64_t nodeNumber;
+    void **results; // The result of processing each flower in a bottom up traversal
+} FlowerTree;
+
+static FlowerTree *flowerTree_construct(Flower *rootFlower) {
+    FlowerTree *tree = st_malloc(sizeof(FlowerTree));
+    int64_t maxNodes = 1;
+    tree->nodes = st_malloc(sizeof(FlowerTreeNode) * maxNodes);
+    tree->nodes[0].flower = rootFlower;
+    tree->nodes[0].parent = -1;
+    tree->nodeNumber = 1;
+    for (int64_t i = 0; i < tree->nodeNumber; i++) {
+        stList *children = stList_construct();
+        getChildFlowers(tree->nodes[i].flower, children);
+        // Largest first, so that the largest flowers are started as early as possible
+        stList_sort(children, flower_sizeCmpFn);
+        if (tree->nodeNumber + stList_length(children) > maxNodes) {
+            maxNodes = 2 * (tree->nodeNumber + stList_length(children));
+            tree->nodes = st_realloc(tree->nodes, sizeof(FlowerTreeNode) * maxNodes);
+        }
+        tree->nodes[i].firstChild = tree->nodeNumber;
+        tree->nodes[i].childNumber = stList_length(children);
+        tree->nodes[i].pendingChildren = stList_length(children);
+        for (int64_t j = 0; j < stList_length(children); j++) {
+            FlowerTreeNode *child = &tree->nodes[tree->nodeNumber++];
+            child->flower = stList_get(children, j);
+            child->parent = i;
+        }
+        stList_destruct(children);
+    }
+    tree->results = st_calloc(tree->nodeNumber, sizeof(void *));
+    return tree;
+}
+
+static void flowerTree_destruct(FlowerTree *tree) {
+    free(tree->nodes);
+    free(tree->results);
+    free(tree);
+}
+
+/*
+ * Processes the flower at index i, then, for as long as this was the last remaining child of
+ * its parent, the parent. Continuing with the parent in the same task keeps the child's results hot.
+ */
+static void traverseFlowersBottomUpP(FlowerTree *tree, int64_t i,
+                                     void *(*fn)(Flower *, void **, int64_t, void *), void *extraArg) {
+    while (1) {
+        FlowerTreeNode *node = &tree->nodes[i];
+        tree->results[i] = fn(node->flower, tree->results + node->firstChild, node->childNumber, extraArg);
+        if (node->parent == -1) {
+            return;
+        }
+        int64_t pendingChildren;
+#if defined(_OPENMP)
+#pragma omp flush
+#pragma omp atomic capture
+#endif
+        pendingChildren = --tree->nodes[node->parent].pendingChildren;
+        if (pendingChildren != 0) {
+            return;
+        }
+#if defined(_OPENMP)
+#pragma omp flush
+#endif
+        i = node->parent;
+    }
+}
+
+void *traverseFlowersBottomUp(Flower *rootFlower,
+                              void *(*fn)(Flower *flower, void **childResults, int64_t childNumber, void *extraArg),
+                              void *extraArg) {
+    FlowerTree *tree = flowerTree_construct(rootFlower);
+#if defined(_OPENMP)
+#pragma omp parallel
+#pragma omp single
+#endif
+    for (int64_t i = 0; i < tree->nodeNumber; i++) {
+        if (tree->nodes[i].childNumber == 0) {
+#if defined(_OPENMP)
+#pragma omp task firstprivate(i)
+#endif
+            traverseFlowersBottomUpP(tree, i, fn, extraArg);
+        }
+    }
+    void *rootResult = tree->results[0];
+    flowerTree_destruct(tree);
+    return rootResult;
+}
+
+/*
+ * Processes the flower at index i, then creates a task for each of its children.
+ */
+static void traverseFlowersTopDownP(FlowerTree *tree, int64_t i, void (*fn)(Flower *, void *), void *extraArg) {
+    FlowerTreeNode *node = &tree->nodes[i];
+    fn(node->flower, extraArg);
+    for (int64_t j = node->firstChild; j < node->firstChild + node->childNumber; j++) {
+#if defined(_OPENMP)
+#pragma omp task firstprivate(j)
+#endif
+        traverseFlowersTopDownP(tree, j, fn, extraArg);
+    }
+}
+
+void traverseFlowersTopDown(Flower *rootFlower, void (*fn)(Flower *flower, void *extraArg), void *extraArg) {
+    FlowerTree *tree = flowerTree_construct(rootFlower);
+#if defined(_OPENMP)
+#pragma omp parallel
+#pragma omp single
+#endif
+    traverseFlowersTopDownP(tree, 0, fn, extraArg);
+    flowerTree_destruct(tree);
+}
@@ -10,9 +10,11 @@
 #include "cactus.h"
 
 /*
- * Converts input alignments coordinates into coordinates used by cactus.
+ * Converts input alignments coordinates into coordinates used by cactus. The output is written as a binary
+ * pinch file, to be read with stPinchIterator_constructFromBinaryFile.
+ * Alignments are converted in parallel. Returns the number of bytes of input alignments read.
  */
-void convertAlignmentCoordinates(char *inputAlignmentFile, char *outputAlignmentFile, Flower *flower);
+int64_t convertAlignmentCoordinates(char *inputAlignmentFile, char *outputAlignmentFile, Flower *flower);
 
 /*
  * Strips unique identifiers from sequence IDs (which are added for leaf genomes)
@@ -12,10 +12,19 @@
 
 /*
  * Used in bar recursion to recursively find all alignment subproblems
- * in the hierarchy for bar to complete.
+ * in the hierarchy for bar to complete. The nested flowers are made in parallel, but
+ * their names and their order in extendedFlowers do not depend on the number of threads.
  */
 void extendFlowers(Flower *flower, stList *extendedFlowers, int64_t minFlowerSize);
 
+/*
+ * As extendFlowers, but calls fn on each extended flower, in parallel, as soon as it is made, so that
+ * the flowers can be processed while the rest of the nested flowers are still being made.
+ * fn must only modify the flower it is given and the flowers nested within it.
+ */
+void extendFlowersAndProcess(Flower *flower, int64_t minFlowerSize,
+                             void (*fn)(Flower *nestedFlower, void *extraArg), void *extraArg);
+
 /*
  * Get all the child flowers of a given flower, putting them in children.
  */
@@ -27,5 +36,26 @@ void getChildFlowers(Flower *flower, stList *children);
  */
 stList *getFlowerHierarchyInLayers(Flower *rootFlower);
 
+/*
+ * Compares flowers by the number of caps they contain, for sorting in descending order of size.
+ */
+int flower_sizeCmpFn(const void *a, const void *b);
+
+/*
+ * Calls fn on every flower in the hierarchy below and including rootFlower, in parallel, calling it on a
+ * flower as soon as it has been called on all the flower's children, rather than waiting for whole layers of the
+ * hierarchy to finish. childResults contains the values returned by fn for each of the childNumber children of
+ * the flower. Returns the value returned by fn for rootFlower.
+ */
+void *traverseFlowersBottomUp(Flower *rootFlower,
+                              void *(*fn)(Flower *flower, void **childResults, int64_t childNumber, void *extraArg),
+                              void *extraArg);
+
+/*
+ * Calls fn on every flower in the hierarchy below and including rootFlower, in parallel, calling it on a
+ * flower as soon as it has returned for the flower's parent.
+ */
+void traverseFlowersTopDown(Flower *rootFlower, void (*fn)(Flower *flower, void *extraArg), void *extraArg);
+
 #endif /* TRAVERSE_FLOWERS_H_ */
 
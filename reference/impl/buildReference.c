@@ -5,6 +5,7 @@
 #include "stCheckEdges.h"
 #include "stMatchingAlgorithms.h"
 #include "stReferenceProblem2.h"
+#include "cactusReference.h"
 #include <math.h>
 
 // OpenMP
@@ -1169,60 +1170,71 @@ void buildReferenceTopDown(Flower *flower, const char *referenceEventHeader, int
 ////////////////////////////////////
 ////////////////////////////////////
 
-void cactus_make_reference(stList *flowers, char *referenceEventString,
-                           CactusDisk *cactusDisk, CactusParams *params) {
-    ///////////////////////////////////////////////////////////////////////////
-    // Build the reference
-    ///////////////////////////////////////////////////////////////////////////
-
-    int64_t permutations = cactusParams_get_int(params, 2, "reference", "permutations");
-    double theta = cactusParams_get_float(params, 2, "reference", "theta");
-    double phi = cactusParams_get_float(params, 2, "reference", "phi");
+struct _referenceParameters {
+    int64_t permutations;
+    double theta;
+    double phi;
+    int64_t maxWalkForCalculatingZ;
+    bool ignoreUnalignedGaps;
+    double wiggle;
+    int64_t numberOfNsForScaffoldGap;
+    int64_t minNumberOfSequencesToSupportAdjacency;
+    bool makeScaffolds;
+    stList *(*matchingAlgorithm)(stList *edges, int64_t nodeNumber);
+    double (*temperatureFn)(double);
+};
+
+ReferenceParameters *referenceParameters_construct(CactusParams *params) {
+    ReferenceParameters *rp = st_malloc(sizeof(ReferenceParameters));
+    rp->permutations = cactusParams_get_int(params, 2, "reference", "permutations");
+    rp->theta = cactusParams_get_float(params, 2, "reference", "theta");
+    rp->phi = cactusParams_get_float(params, 2, "reference", "phi");
     bool useSimulatedAnnealing = cactusParams_get_int(params, 2, "reference", "useSimulatedAnnealing");
-    int64_t maxWalkForCalculatingZ = cactusParams_get_int(params, 2, "reference", "maxWalkForCalculatingZ");
-    bool ignoreUnalignedGaps = cactusParams_get_int(params, 2, "reference", "ignoreUnalignedGaps");
-    double wiggle = cactusParams_get_float(params, 2, "reference", "wiggle");
-    int64_t numberOfNsForScaffoldGap = cactusParams_get_int(params, 2, "reference", "numberOfNs");
-    int64_t minNumberOfSequencesToSupportAdjacency = cactusParams_get_int(params, 2, "reference", "minNumberOfSequencesToSupportAdjacency");
-    bool makeScaffolds = cactusParams_get_int(params, 2, "reference", "makeScaffolds");
-
-    stList *(*matchingAlgorithm)(stList *edges, int64_t nodeNumber) = chooseMatching_greedy;
+    rp->maxWalkForCalculatingZ = cactusParams_get_int(params, 2, "reference", "maxWalkForCalculatingZ");
+    rp->ignoreUnalignedGaps = cactusParams_get_int(params, 2, "reference", "ignoreUnalignedGaps");
+    rp->wiggle = cactusParams_get_float(params, 2, "reference", "wiggle");
+    rp->numberOfNsForScaffoldGap = cactusParams_get_int(params, 2, "reference", "numberOfNs");
+    rp->minNumberOfSequencesToSupportAdjacency = cactusParams_get_int(params, 2, "reference", "minNumberOfSequencesToSupportAdjacency");
+    rp->makeScaffolds = cactusParams_get_int(params, 2, "reference", "makeScaffolds");
+
+    rp->matchingAlgorithm = chooseMatching_greedy;
     char *matchAlgorithmString = cactusParams_get_string(params, 2, "reference", "matchingAlgorithm");
     if (strcmp("greedy", matchAlgorithmString) == 0) {
-        matchingAlgorithm = chooseMatching_greedy;
+        rp->matchingAlgorithm = chooseMatching_greedy;
     } else if (strcmp("maxCardinality", matchAlgorithmString) == 0) {
-        matchingAlgorithm = chooseMatching_maximumCardinalityMatching;
+        rp->matchingAlgorithm = chooseMatching_maximumCardinalityMatching;
     } else if (strcmp("maxWeight", matchAlgorithmString) == 0) {
-        matchingAlgorithm = chooseMatching_maximumWeightMatching;
+        rp->matchingAlgorithm = chooseMatching_maximumWeightMatching;
     } else if (strcmp("blossom5", matchAlgorithmString) == 0) {
-        matchingAlgorithm = chooseMatching_blossom5;
+        rp->matchingAlgorithm = chooseMatching_blossom5;
     } else {
         stThrowNew(REFERENCE_BUILDING_EXCEPTION, "Input error: unrecognized matching algorithm: %s", matchAlgorithmString);
     }
     free(matchAlgorithmString);
 
-    /*st_logDebug("The reference event string: %s\n", referenceEventString);
-    st_logDebug("The theta parameter has been set to %lf\n", theta);
-    st_logDebug("The ignore unaligned gaps parameter is %i\n", ignoreUnalignedGaps);
-    st_logDebug("The number of permutations is %" PRIi64 "\n", permutations);
-    st_logDebug("Simulated annealing is %" PRIi64 "\n", useSimulatedAnnealing);
-    st_logDebug("Max number of segments in thread to calculate z-score between is %" PRIi64 "\n",
-            maxWalkForCalculatingZ);
-    st_logDebug("Wiggle is %f\n", wiggle);
-    st_logDebug("Max number of Ns for a scaffold gap is: %" PRIi64 "\n", numberOfNsForScaffoldGap);
-    st_logDebug("Min number of sequences to required to support an adjacency is: %" PRIi64 "\n",
-            minNumberOfSequencesToSupportAdjacency);
-    st_logDebug("Make scaffolds is: %i\n", makeScaffolds);*/
-
-    double (*temperatureFn)(double) = useSimulatedAnnealing ? exponentiallyDecreasingTemperatureFn : constantTemperatureFn;
+    rp->temperatureFn = useSimulatedAnnealing ? exponentiallyDecreasingTemperatureFn : constantTemperatureFn;
+    return rp;
+}
+
+void referenceParameters_destruct(ReferenceParameters *referenceParameters) {
+    free(referenceParameters);
+}
+
+void cactus_make_reference_for_flower(Flower *flower, char *referenceEventString, ReferenceParameters *rp) {
+    st_logDebug("Processing flower %" PRIi64 "\n", flower_getName(flower));
+    buildReferenceTopDown(flower, referenceEventString, rp->permutations, rp->matchingAlgorithm, rp->temperatureFn,
+                          rp->theta, rp->phi, rp->maxWalkForCalculatingZ, rp->ignoreUnalignedGaps, rp->wiggle,
+                          rp->numberOfNsForScaffoldGap, rp->minNumberOfSequencesToSupportAdjacency, rp->makeScaffolds);
+}
+
+void cactus_make_reference(stList *flowers, char *referenceEventString,
+                           CactusDisk *cactusDisk, CactusParams *params) {
+    ReferenceParameters *referenceParameters = referenceParameters_construct(params);
 
 #pragma omp parallel for
     for(int64_t i=0; i<stList_length(flowers); i++) {
-        Flower *flower = stList_get(flowers, i);
-        st_logDebug("Processing flower %" PRIi64 "\n", flower_getName(flower));
-        buildReferenceTopDown(flower, referenceEventString, permutations, matchingAlgorithm, temperatureFn, theta,
-                              phi, maxWalkForCalculatingZ, ignoreUnalignedGaps, wiggle, numberOfNsForScaffoldGap,
-                              minNumberOfSequencesToSupportAdjacency, makeScaffolds);
+        cactus_make_reference_for_flower(stList_get(flowers, i), referenceEventString, referenceParameters);
     }
-}
 
+    referenceParameters_destruct(referenceParameters);
+}
@@ -26,6 +26,21 @@ extern const char *REFERENCE_BUILDING_EXCEPTION;
  */
 void cactus_make_reference(stList *flowers, char *referenceEventString, CactusDisk *cactusDisk, CactusParams *params);
 
+typedef struct _referenceParameters ReferenceParameters;
+
+/*
+ * Reads the parameters for building the reference from the "reference" section of the params.
+ */
+ReferenceParameters *referenceParameters_construct(CactusParams *params);
+
+void referenceParameters_destruct(ReferenceParameters *referenceParameters);
+
+/*
+ * Builds the reference for a single flower. The reference must already have been built for the
+ * flower's parent, but flowers in different subtrees may be processed concurrently.
+ */
+void cactus_make_reference_for_flower(Flower *flower, char *referenceEventString, ReferenceParameters *referenceParameters);
+
 /*
  * Construct a reference for the flower, top down.
  */
@@ -3,6 +3,23 @@
 #include "bioioC.h"
 #include <stdio.h>
 #include <ctype.h>
+#include <zlib.h>
+#include <sys/stat.h>
+
+// OpenMP
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+/*
+ * The number of files parsed in parallel per thread before their sequences are added to the flower, as long as
+ * their estimated parsed size is within BATCH_MAX_BYTES. Bounds the parsed but not yet added sequences held in memory.
+ * A batch always has at least one file, however large.
+ */
+#define FILES_PER_THREAD_PER_BATCH 2
+#define BATCH_MAX_BYTES 4000000000
+#define GZIP_EXPANSION_FACTOR 4 // Estimate of the parsed size of a gzipped fasta relative to the file
+#define FASTA_READ_BUFFER_SIZE 262144
 
 void checkBranchLengthsAreDefined(stTree *tree) {
     if (isinf(stTree_getBranchLength(tree))) {
@@ -40,16 +57,19 @@ void makeEventHeadersAlphaNumericFn(stTree *tree) {
 
 bool getCompleteStatus(const char *fileName) {
     int64_t i = strlen(fileName);
+    if (i >= 3 && strcmp(fileName + i - 3, ".gz") == 0) {
+        i -= 3; // Gzipped files are specified complete by the name of the uncompressed file
+    }
     if (i >= 9) {
         const char *cA = fileName + i - 9;
-        if (strcmp(cA, ".complete") == 0) {
+        if (strncmp(cA, ".complete", 9) == 0) {
             st_logDebug("The file %s is specified complete, the sequences will be attached\n", fileName);
             return 1;
         }
     }
     if (i >= 12) {
         const char *cA = fileName + i - 12;
-        if (strcmp(cA, ".complete.fa") == 0) {
+        if (strncmp(cA, ".complete.fa", 12) == 0) {
             st_logDebug("The file %s is specified complete, the sequences will be attached\n", fileName);
             return 1;
         }
@@ -83,19 +103,153 @@ void processSequence(void* destination, const char *fastaHeader, const char *str
     p->totalSequenceNumber++;
 }
 
-static int64_t assignSequences(CactusDisk *cactusDisk, Flower *flower, EventTree *eventTree, char *sequenceFilesAndEvents) {
+/*
+ * A fasta file to be added to the flower, with the event its sequences belong to.
+ */
+typedef struct _inputFile {
+    char *fileName;
+    Event *event;
+    bool isComplete;
+    stList *records; // The parsed FastaRecords, in file order, or NULL if not yet parsed
+    int64_t parsedSize; // Estimate of the bytes of the parsed records
+} InputFile;
+
+/*
+ * Estimates the bytes held by the records of the fasta file once parsed, from the size of the file.
+ */
+static int64_t getParsedSizeEstimate(const char *fileName) {
+    struct stat fileStat;
+    if (stat(fileName, &fileStat) != 0) {
+        st_errAbort("Could not get the size of file: %s\n", fileName);
+    }
+    int64_t size = fileStat.st_size;
+    int64_t length = strlen(fileName);
+    if (length >= 3 && strcmp(fileName + length - 3, ".gz") == 0) {
+        size *= GZIP_EXPANSION_FACTOR;
+    }
+    return size;
+}
+
+typedef struct _fastaRecord {
+    char *header;
+    char *string;
+    int64_t length;
+} FastaRecord;
+
+static void fastaRecord_destruct(FastaRecord *record) {
+    free(record->header);
+    free(record->string);
+    free(record);
+}
+
+/*
+ * Grows the array *string to hold at least length characters.
+ */
+static void ensureCapacity(char **string, int64_t *maxLength, int64_t length) {
+    if (length > *maxLength) {
+        *maxLength = length * 2;
+        *string = st_realloc(*string, *maxLength);
+    }
+}
+
+static void finishRecord(stList *records, char *header, char *string, int64_t length) {
+    FastaRecord *record = st_malloc(sizeof(FastaRecord));
+    record->header = header;
+    record->string = st_realloc(string, length + 1); // Trim to size
+    record->string[length] = '\0';
+    record->length = length;
+    stList_append(records, record);
+}
+
+/*
+ * Parses a fasta file, which may be gzipped, returning a list of FastaRecords in file order. As with
+ * fastaReadToFunction, the header is the header line without the '>' and white space is removed from the sequence.
+ * Touches no shared state, so files can be parsed in parallel.
+ */
+static stList *readFastaFile(const char *fileName) {
+    gzFile fileHandle = gzopen(fileName, "r"); // Reads uncompressed files unchanged
+    if (fileHandle == NULL) {
+        st_errAbort("Could not open fasta file: %s\n", fileName);
+    }
+    stList *records = stList_construct3(0, (void (*)(void *)) fastaRecord_destruct);
+    char *buffer = st_malloc(FASTA_READ_BUFFER_SIZE);
+    char *header = NULL, *string = NULL;
+    int64_t headerLength = 0, maxHeaderLength = 0, stringLength = 0, maxStringLength = 0;
+    bool inHeader = 0;
+    int bytesRead;
+    while ((bytesRead = gzread(fileHandle, buffer, FASTA_READ_BUFFER_SIZE)) > 0) {
+        for (int64_t i = 0; i < bytesRead;) {
+            if (inHeader) {
+                // Copy up to the end of the line into the header
+                char *newline = memchr(buffer + i, '\n', bytesRead - i);
+                int64_t j = newline == NULL ? bytesRead : newline - buffer;
+                ensureCapacity(&header, &maxHeaderLength, headerLength + (j - i) + 1);
+                memcpy(header + headerLength, buffer + i, j - i);
+                headerLength += j - i;
+                if (newline != NULL) {
+                    while (headerLength > 0 && header[headerLength - 1] == '\r') {
+                        headerLength--;
+                    }
+                    header[headerLength] = '\0';
+                    inHeader = 0;
+                    j++;
+                }
+                i = j;
+            } else if (buffer[i] == '>') {
+                // Start a new record
+                if (header != NULL) {
+                    finishRecord(records, header, string, stringLength);
+                }
+                header = NULL;
+                string = NULL;
+                headerLength = maxHeaderLength = stringLength = maxStringLength = 0;
+                ensureCapacity(&header, &maxHeaderLength, 1);
+                inHeader = 1;
+                i++;
+            } else {
+                // Copy sequence characters up to the next header, skipping white space
+                int64_t j = i;
+                while (j < bytesRead && buffer[j] != '>') {
+                    j++;
+                }
+                ensureCapacity(&string, &maxStringLength, stringLength + (j - i) + 1);
+                for (; i < j; i++) {
+                    if (!isspace(buffer[i])) {
+                        if (header == NULL) {
+                            st_errAbort("Found sequence before the first fasta header in file: %s\n", fileName);
+                        }
+                        string[stringLength++] = buffer[i];
+                    }
+                }
+            }
+        }
+    }
+    if (bytesRead < 0) {
+        int errorNumber;
+        st_errAbort("Error reading fasta file %s: %s\n", fileName, gzerror(fileHandle, &errorNumber));
+    }
+    if (header != NULL) {
+        header[headerLength] = '\0';
+        finishRecord(records, header, string, stringLength);
+    } else {
+        free(string); // Only white space was read
+    }
+    free(buffer);
+    gzclose(fileHandle);
+    return records;
+}
+
+/*
+ * Gets the list of InputFiles, in the order their sequences are added, expanding directories into their files.
+ */
+static stList *getInputFiles(EventTree *eventTree, char *sequenceFilesAndEvents) {
     stList *sequenceFilesAndEventsList = stString_split(sequenceFilesAndEvents);
     if (stList_length(sequenceFilesAndEventsList) % 2 != 0) {
         stList_destruct(sequenceFilesAndEventsList);
         st_errAbort("Sequences weren't provided in a proper "
                     "'event seq' space-separated format");
     }
-    ProcessSequenceVars p; // Struct to pass around storing variables for
-    // making sequences
-    p.totalSequenceNumber = 0;
-    p.flower = flower;
-    p.cactusDisk = cactusDisk;
-
+    stList *inputFiles = stList_construct();
     for (int64_t i = 0; i < stList_length(sequenceFilesAndEventsList); i += 2) {
         char *eventName = stList_get(sequenceFilesAndEventsList, i);
         char *fileName = stList_get(sequenceFilesAndEventsList, i+1);
@@ -106,34 +260,86 @@ static int64_t assignSequences(CactusDisk *cactusDisk, Flower *flower, EventTree
             st_errAbort("File does not exist: %s\n", fileName);
         }
 
-        // Set the global "event" variable, which is needed for the
-        // function provided to fastaReadToFunction.
-        p.event = eventTree_getEventByHeader(eventTree, eventName);
-        if (p.event == NULL) {
+        Event *event = eventTree_getEventByHeader(eventTree, eventName);
+        if (event == NULL) {
             st_errAbort("No such event: %s", eventName);
         }
+        stList *fileNames = stList_construct();
         if (stFile_isDir(fileName)) {
             st_logInfo("Processing directory: %s\n", fileName);
             stList *filesInDir = stFile_getFileNamesInDirectory(fileName);
             for (int64_t j = 0; j < stList_length(filesInDir); j++) {
                 char *absChildFileName = stFile_pathJoin(fileName, stList_get(filesInDir, j));
                 assert(stFile_exists(absChildFileName));
-                p.isComplete = getCompleteStatus(absChildFileName); //decide if the sequences in the file should be free or attached.
-                FILE *fileHandle = fopen(absChildFileName, "r");
-                fastaReadToFunction(fileHandle, &p, processSequence);
-                fclose(fileHandle);
-                free(absChildFileName);
+                stList_append(fileNames, absChildFileName);
             }
             stList_destruct(filesInDir);
         } else {
-            st_logInfo("Processing file: %s\n", fileName);
-            p.isComplete = getCompleteStatus(fileName); //decide if the sequences in the file should be free or attached.
-            FILE *fileHandle = fopen(fileName, "r");
-            fastaReadToFunction(fileHandle, &p, processSequence);
-            fclose(fileHandle);
+            stList_append(fileNames, stString_copy(fileName));
         }
+        for (int64_t j = 0; j < stList_length(fileNames); j++) {
+            InputFile *inputFile = st_calloc(1, sizeof(InputFile));
+            inputFile->fileName = stList_get(fileNames, j);
+            inputFile->event = event;
+            inputFile->isComplete = getCompleteStatus(inputFile->fileName); //decide if the sequences in the file should be free or attached.
+            inputFile->parsedSize = getParsedSizeEstimate(inputFile->fileName);
+            stList_append(inputFiles, inputFile);
+        }
+        stList_destruct(fileNames);
     }
     stList_destruct(sequenceFilesAndEventsList);
+    return inputFiles;
+}
+
+static int64_t assignSequences(CactusDisk *cactusDisk, Flower *flower, EventTree *eventTree, char *sequenceFilesAndEvents) {
+    /*
+     * Files are parsed in parallel, a batch at a time, each into its own list of records. The records of a batch are
+     * then added to the flower by this thread, in input order, so the names given to the sequences, ends and caps
+     * are the same for any number of threads.
+     */
+    stList *inputFiles = getInputFiles(eventTree, sequenceFilesAndEvents);
+    ProcessSequenceVars p; // Struct to pass around storing variables for
+    // making sequences
+    p.totalSequenceNumber = 0;
+    p.flower = flower;
+    p.cactusDisk = cactusDisk;
+
+    int64_t batchSize = FILES_PER_THREAD_PER_BATCH;
+#if defined(_OPENMP)
+    batchSize *= omp_get_max_threads();
+#endif
+    int64_t inputFileNumber = stList_length(inputFiles);
+    for (int64_t i = 0, batchEnd; i < inputFileNumber; i = batchEnd) {
+        int64_t batchBytes = ((InputFile *)stList_get(inputFiles, i))->parsedSize;
+        for (batchEnd = i + 1; batchEnd < inputFileNumber && batchEnd - i < batchSize; batchEnd++) {
+            int64_t parsedSize = ((InputFile *)stList_get(inputFiles, batchEnd))->parsedSize;
+            if (batchBytes + parsedSize > BATCH_MAX_BYTES) {
+                break;
+            }
+            batchBytes += parsedSize;
+        }
+#if defined(_OPENMP)
+#pragma omp parallel for schedule(dynamic)
+#endif
+        for (int64_t j = i; j < batchEnd; j++) {
+            InputFile *inputFile = stList_get(inputFiles, j);
+            st_logInfo("Processing file: %s\n", inputFile->fileName);
+            inputFile->records = readFastaFile(inputFile->fileName);
+        }
+        for (int64_t j = i; j < batchEnd; j++) {
+            InputFile *inputFile = stList_get(inputFiles, j);
+            p.event = inputFile->event;
+            p.isComplete = inputFile->isComplete;
+            for (int64_t k = 0; k < stList_length(inputFile->records); k++) {
+                FastaRecord *record = stList_get(inputFile->records, k);
+                processSequence(&p, record->header, record->string, record->length);
+            }
+            stList_destruct(inputFile->records);
+            free(inputFile->fileName);
+            free(inputFile);
+        }
+    }
+    stList_destruct(inputFiles);
 
     return p.totalSequenceNumber;
 }
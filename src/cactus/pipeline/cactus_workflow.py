@@ -63,9 +63,17 @@ def cactus_cons_with_resources(job, tree, ancestor_event, config_node, seq_id_ma
     if not mem:
         raise RuntimeError('Unable to parse memory requirement from <consolidatedMemory> node in configuration XML')
     
-    # abPOA needs a bunch of memory for its table, even for tiny alignments
-    if getOptionalAttrib(findRequiredNode(config_node, 'bar'), 'partialOrderAlignment', typeFn=bool, default=True):
-        mem = max(mem, int(4e9))
+    bar_node = findRequiredNode(config_node, 'bar')
+    if getOptionalAttrib(bar_node, 'partialOrderAlignment', typeFn=bool, default=True):
+        poa_node = findRequiredNode(bar_node, 'poa')
+        poa_memory = getOptionalAttrib(poa_node, 'partialOrderAlignmentMaxMemory', typeFn=int, default=0)
+        if getOptionalAttrib(poa_node, 'partialOrderAlignmentMinWindow', typeFn=int, default=0) > 0 and poa_memory > 0:
+            # when the window size is chosen, bar keeps each window within partialOrderAlignmentMaxMemory,
+            # but a window can be aligned on every thread at once
+            mem = max(mem, poa_memory * (cons_cores if cons_cores else 1))
+        else:
+            # abPOA needs a bunch of memory for its table, even for tiny alignments
+            mem = max(mem, int(4e9))
     # add function of paf size
     mem = max(mem, 10 * paf_id.size)
     